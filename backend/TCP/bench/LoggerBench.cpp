@@ -0,0 +1,134 @@
+// Cost of a log call on the logging thread, the way the transport logs on its hot path: one TRACE_SRC with a
+// few integers and a string per simulated packet, from several threads at once.
+// sync:  format, prefix, lock, write and flush on the caller (the default)
+// async: format into the thread's ring, the writer thread does the rest (Logger::enableAsync)
+// binary: copy the raw arguments into the thread's ring, the writer stores them unformatted (Logger::enableBinaryOutput)
+// off:   TRACE below the runtime level (Logger::setPriority), so only the level check runs
+// Reports ns per call on the logging threads, lines dropped because a ring was full, and how long the
+// writer took to catch up after the last call, as JSON. By default the threads log back to back, which no
+// ring survives; --burst N --gap-us G logs N lines, then pauses G us (not timed), like traffic does.
+// --timestamp ms|us|ticks picks Logger::setTimestamp for every mode.
+//
+//   make logbench ARGS="--threads 1,4 --lines 200000 --mode off,sync,async,binary --burst 100 --gap-us 1000 --ring 1024"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+struct LogBenchResult {
+    double ns_per_line = 0.0;
+    double drain_ms = 0.0;
+    uint64_t dropped = 0;
+};
+
+struct LogBenchConfig {
+    size_t lines = 200000;
+    size_t burst = 0;                                   // 0 = one burst of every line
+    std::chrono::microseconds gap{0};
+    size_t ring = Logger::DEFAULT_RING_CAPACITY;
+    std::string file = "log_bench.log";
+    LogTimestamp timestamp = LogTimestamp::MILLISECONDS;
+};
+
+static LogBenchResult run(const std::string& mode, size_t threads, const LogBenchConfig& config) {
+    const std::string& file = config.file;
+    std::remove(file.c_str());
+    Logger::enableFileOutput(file);
+    uint64_t droppedBefore = Logger::droppedLines();
+    if (mode == "async") Logger::enableAsync(Logger::DEFAULT_FLUSH_INTERVAL, config.ring);
+    if (mode == "binary") Logger::enableBinaryOutput(file, Logger::DEFAULT_FLUSH_INTERVAL, config.ring);
+    Logger::setPriority(mode == "off" ? LogLevel::INFO : LogLevel::TRACE);
+    Logger::setTimestamp(config.timestamp);
+
+    std::vector<double> elapsed(threads);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            // Not timed: the thread's first line allocates its ring.
+            TRACE_SRC("LogBench - thread %zu started", t);
+            size_t burst = config.burst ? config.burst : config.lines;
+            for (size_t i = 0; i < config.lines;) {
+                if (i && config.gap.count()) std::this_thread::sleep_for(config.gap);
+                auto start = std::chrono::steady_clock::now();
+                for (size_t end = std::min(config.lines, i + burst); i < end; i++) {
+                    TRACE_SRC("Client [IP=%u PORT=%u] - Packet[SEQ=%u SIZE=%u] Sent and appended (%s)", 2130706433u, static_cast<unsigned>(9000 + t), static_cast<unsigned>(i), 1020u, "ACK");
+                }
+                elapsed[t] += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    auto drainStart = std::chrono::steady_clock::now();
+    Logger::disableAsync();
+    LogBenchResult result;
+    result.drain_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - drainStart).count();
+    double total = 0.0;
+    for (double ns : elapsed) total += ns;
+    result.ns_per_line = total / static_cast<double>(threads * config.lines);
+    result.dropped = Logger::droppedLines() - droppedBefore;
+    return result;
+}
+
+static std::vector<std::string> split(const std::string& value) {
+    std::vector<std::string> items;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ',')) items.push_back(item);
+    return items;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> modes{"off", "sync", "async", "binary"};
+    std::vector<size_t> threadCounts{1, 4};
+    LogBenchConfig config;
+    std::string label = "local";
+    std::string timestamp = "ms";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if (flag == "--mode") modes = split(value);
+        else if (flag == "--threads") {
+            threadCounts.clear();
+            for (const std::string& item : split(value)) threadCounts.push_back(std::stoul(item));
+        }
+        else if (flag == "--lines") config.lines = std::stoul(value);
+        else if (flag == "--burst") config.burst = std::stoul(value);
+        else if (flag == "--gap-us") config.gap = std::chrono::microseconds(std::stoul(value));
+        else if (flag == "--ring") config.ring = std::stoul(value);
+        else if (flag == "--file") config.file = value;
+        else if (flag == "--timestamp" && (value == "ms" || value == "us" || value == "ticks")) {
+            config.timestamp = value == "ms" ? LogTimestamp::MILLISECONDS : value == "us" ? LogTimestamp::MICROSECONDS : LogTimestamp::TICKS;
+            timestamp = value;
+        }
+        else if (flag == "--label") label = value;
+        else {
+            std::cerr << "unknown flag " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "{\n  \"benchmark\": \"logger\",\n  \"label\": \"" << label << "\",\n  \"results\": [";
+    bool first = true;
+    for (const std::string& mode : modes) {
+        for (size_t threads : threadCounts) {
+            LogBenchResult r = run(mode, threads, config);
+            std::cout << (first ? "\n" : ",\n") << "    {\"mode\": \"" << mode << "\""
+                      << ", \"threads\": " << threads
+                      << ", \"lines_per_thread\": " << config.lines
+                      << ", \"burst\": " << config.burst
+                      << ", \"gap_us\": " << config.gap.count()
+                      << ", \"timestamp\": \"" << timestamp << "\""
+                      << ", \"ns_per_line\": " << r.ns_per_line
+                      << ", \"dropped\": " << r.dropped
+                      << ", \"drain_ms\": " << r.drain_ms << "}" << std::flush;
+            first = false;
+        }
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+    std::remove(config.file.c_str());
+    return 0;
+}
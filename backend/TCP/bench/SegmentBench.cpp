@@ -0,0 +1,240 @@
+// Microbenchmarks for the Segment codec and the flag/state helpers.
+// Reports ns/op and heap allocations/op for each case as JSON.
+// fanout_copy / fanout_shared compare stamping one broadcast segment for another peer by copying
+// and encoding the whole segment against stamping only the header over a SharedPayload.
+// lz4_compress / lz4_decompress time the payload codec on chat style text.
+// retransmit_heap / retransmit_ring track one sent segment until its ACK: a shared, locked record per
+// segment in a deque (the old bookkeeping) against a SegmentInfo in the Client's RetransmitQueue.
+//
+//   make microbench ARGS="--sizes 0,64,512,1000 --min-time 0.2"
+#include "Segment.hpp"
+#include "SharedPayload.hpp"
+#include "Lz4.hpp"
+#include "RetransmitQueue.hpp"
+#include "Flags.hpp"
+#include "Logger.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <sstream>
+
+static std::atomic<uint64_t> allocation_count{0};
+
+void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {std::free(p);}
+void operator delete[](void* p) noexcept {std::free(p);}
+void operator delete(void* p, std::size_t) noexcept {std::free(p);}
+void operator delete[](void* p, std::size_t) noexcept {std::free(p);}
+
+template<typename T>
+static inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Measurement {
+    double ns_per_op = 0.0;
+    double allocs_per_op = 0.0;
+    uint64_t iterations = 0;
+};
+
+// Runs body in growing batches until min_time has elapsed, then reports the per-op averages.
+static Measurement measure(const std::function<void()>& body, double min_time_s) {
+    using clock = std::chrono::steady_clock;
+    for (int i = 0; i < 1000; i++) body();
+
+    uint64_t batch = 1000;
+    while (true) {
+        uint64_t allocations_before = allocation_count.load(std::memory_order_relaxed);
+        auto start = clock::now();
+        for (uint64_t i = 0; i < batch; i++) body();
+        double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        uint64_t allocations = allocation_count.load(std::memory_order_relaxed) - allocations_before;
+
+        if (elapsed >= min_time_s || batch >= (1ULL << 32)) {
+            Measurement m;
+            m.iterations = batch;
+            m.ns_per_op = elapsed * 1e9 / batch;
+            m.allocs_per_op = static_cast<double>(allocations) / batch;
+            return m;
+        }
+        batch *= (elapsed < min_time_s / 10) ? 10 : 2;
+    }
+}
+
+static bool first_result = true;
+
+static void report(const std::string& name, size_t size, const Measurement& m) {
+    std::cout << (first_result ? "\n" : ",\n") << "    {\"case\": \"" << name << "\""
+              << ", \"payload\": " << size
+              << ", \"ns_per_op\": " << m.ns_per_op
+              << ", \"allocs_per_op\": " << m.allocs_per_op
+              << ", \"iterations\": " << m.iterations << "}" << std::flush;
+    first_result = false;
+}
+
+int main(int argc, char* argv[]) {
+    Logger::setPriority(LogLevel::CRITICAL);
+
+    std::vector<size_t> sizes{0, 64, 512, 1000};
+    double min_time = 0.2;
+    std::string label = "local";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if (flag == "--sizes") {
+            sizes.clear();
+            std::stringstream ss(value);
+            std::string item;
+            while (std::getline(ss, item, ',')) sizes.push_back(std::stoul(item));
+        }
+        else if (flag == "--min-time") min_time = std::stod(value);
+        else if (flag == "--label") label = value;
+        else {
+            std::cerr << "unknown flag " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    const uint32_t sourceIP = 0x7F000001;
+    const uint32_t destinationIP = 0x7F000002;
+    const uint8_t protocol = 6;
+    const uint8_t ackFlag = static_cast<uint8_t>(FLAGS::ACK);
+
+    std::cout << "{\n  \"benchmark\": \"segment_codec\",\n  \"label\": \"" << label << "\",\n  \"results\": [";
+
+    for (size_t size : sizes) {
+        std::vector<uint8_t> payload(size);
+        for (size_t i = 0; i < size; i++) payload[i] = static_cast<uint8_t>(i * 7);
+
+        Segment segment(9000, 9001, 1000, 2000, ackFlag, 1000, 0, destinationIP, payload);
+        std::vector<uint8_t> encoded = segment.encode(sourceIP, destinationIP, protocol);
+
+        report("encode", size, measure([&] {
+            std::vector<uint8_t> bytes = segment.encode(sourceIP, destinationIP, protocol);
+            doNotOptimize(bytes.data());
+        }, min_time));
+
+        report("decode", size, measure([&] {
+            std::unique_ptr<Segment> decoded = Segment::decode(sourceIP, destinationIP, protocol, encoded);
+            doNotOptimize(decoded.get());
+        }, min_time));
+
+        report("checksum", size, measure([&] {
+            uint16_t sum = Segment::create_checksum(sourceIP, destinationIP, protocol, encoded);
+            doNotOptimize(sum);
+        }, min_time));
+
+        report("check_checksum", size, measure([&] {
+            bool valid = Segment::check_checksum(sourceIP, destinationIP, protocol, encoded);
+            doNotOptimize(valid);
+        }, min_time));
+
+        std::vector<uint8_t> broadcast(4 * size + 1);
+        for (size_t i = 0; i < broadcast.size(); i++) broadcast[i] = static_cast<uint8_t>(i * 13);
+        std::shared_ptr<const SharedPayload> shared = SharedPayload::create(broadcast);
+        uint32_t begin = static_cast<uint32_t>(size + 1);
+
+        report("fanout_copy", size, measure([&] {
+            std::vector<uint8_t> slice(broadcast.begin() + begin, broadcast.begin() + begin + size);
+            Segment peer(9000, 9001, 1000, 2000, ackFlag, 1000, 0, destinationIP, std::move(slice));
+            peer.setStream(1, begin);
+            std::vector<uint8_t> bytes = peer.encode(sourceIP, destinationIP, protocol);
+            doNotOptimize(bytes.data());
+        }, min_time));
+
+        report("fanout_shared", size, measure([&] {
+            Segment peer(9000, 9001, 1000, 2000, ackFlag, 1000, 0, destinationIP, begin, begin + size);
+            peer.setStream(1, begin);
+            peer.setSharedPayload(shared, begin, static_cast<uint32_t>(size));
+            std::vector<uint8_t> header = peer.encodeHeader(sourceIP, destinationIP, protocol);
+            doNotOptimize(header.data());
+        }, min_time));
+
+        static const char text[] = "{\"from\":\"alice\",\"room\":\"general\",\"text\":\"are you joining the call later\"}\n";
+        std::vector<uint8_t> chat(size);
+        for (size_t i = 0; i < size; i++) chat[i] = static_cast<uint8_t>(text[i % (sizeof(text) - 1)]);
+        std::vector<uint8_t> compressed, restored;
+        bool shrinks = Lz4::compress(chat.data(), chat.size(), compressed);
+
+        report("lz4_compress", size, measure([&] {
+            std::vector<uint8_t> out;
+            bool ok = Lz4::compress(chat.data(), chat.size(), out);
+            doNotOptimize(ok);
+        }, min_time));
+
+        if (shrinks) {
+            report("lz4_decompress", size, measure([&] {
+                bool ok = Lz4::decompress(compressed.data(), compressed.size(), chat.size(), restored);
+                doNotOptimize(ok);
+            }, min_time));
+        }
+    }
+
+    // 32 segments stay in flight; each op sends one more and ACKs the oldest.
+    struct HeapRecord {
+        SegmentInfo info;
+        std::mutex mtx;
+    };
+    std::deque<std::shared_ptr<HeapRecord>> heapQueue;
+    RetransmitQueue ring;
+    uint32_t seq = 0;
+    for (int i = 0; i < 32; i++) {
+        heapQueue.push_back(std::make_shared<HeapRecord>());
+        ring.push_back(SegmentInfo{});
+    }
+
+    report("retransmit_heap", 0, measure([&] {
+        auto record = std::make_shared<HeapRecord>();
+        record->info.seq = seq++;
+        std::function<void()> stamp = [record] {
+            std::lock_guard<std::mutex> lock(record->mtx);
+            record->info.time_sent = Clock::now();
+        };
+        heapQueue.push_back(record);
+        stamp();
+        doNotOptimize(heapQueue.front()->info.seq);
+        heapQueue.pop_front();
+    }, min_time));
+
+    report("retransmit_ring", 0, measure([&] {
+        ring.push_back(SegmentInfo{0, Clock::now(), seq++, 1000, 0, ackFlag, 0});
+        doNotOptimize(ring.front().seq);
+        ring.pop_front();
+    }, min_time));
+
+    uint8_t flag = 0;
+    report("decodeFlags", 0, measure([&] {
+        FlagType type = decodeFlags(flag++ & 0x3F);
+        doNotOptimize(type);
+    }, min_time));
+
+    report("flagsToStr", 0, measure([&] {
+        std::string str = flagsToStr(flag++ & 0x3F);
+        doNotOptimize(str.data());
+    }, min_time));
+
+    uint8_t state = 0;
+    report("stateToStr", 0, measure([&] {
+        std::string str = stateToStr(state++ % 10);
+        doNotOptimize(str.data());
+    }, min_time));
+
+    std::cout << "\n  ]\n}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,413 @@
+// Loopback throughput / latency benchmark for Connection.
+// Sweeps payload size, advertised window and loss rate and prints one JSON document.
+//
+//   make bench ARGS="--payload 64,1024 --window 1000,16000 --loss 0,0.02 --messages 2000 --duration 10"
+//   make bench ARGS="--loss 0.07 --fec 0,4"      (XOR parity every 4 data segments vs plain retransmission)
+//   make bench ARGS="--payload 16384 --window 65000 --gso 0,1"  (one sendmsg per segment vs UDP GSO/GRO trains)
+//   make bench ARGS="--uring 0,1"                (two I/O threads per Connection vs io_uring on the connection thread)
+//   make bench ARGS="--payload 64 --loss 0 --interval-us 1000 --busy-poll 0,20000"  (one-way latency, blocking vs busy poll)
+//   make bench ARGS="--window 1000 --autotune 0,1"  (fixed receive buffer vs one grown with the reader)
+//   make bench ARGS="--payload 16384 --messages 4000 --wscale 0,1"  (receive window capped at 64 KB vs scaled)
+//   make bench ARGS="--threads 'tcp-receiver=1;tcp-sender=2;tcp-connection=3'"     (ThreadPlacement, layout on stderr)
+//
+// Loss is injected by an in-process relay that forwards like tests/MiddleManTest.cpp, but with a
+// seeded drop decision and port rewriting so Connection's destination port check still passes.
+#include "Connection.hpp"
+#include "Logger.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <sys/resource.h>
+
+struct BenchConfig {
+    size_t payload = 64;
+    uint32_t window = 1000;
+    double loss = 0.0;
+    uint8_t fec_group = 0;
+    bool offload = false;
+    bool uring = false;
+    size_t busy_poll_us = 0;
+    bool autotune = true;
+    bool wscale = true;
+    size_t interval_us = 0;                     // 0: queue every message at once, else pace one per interval
+    bool proxy = false;
+    size_t messages = 2000;
+    double duration_s = 10.0;
+    uint64_t seed = 1;
+    uint16_t base_port = 9400;
+};
+
+struct BenchResult {
+    bool established = false;
+    bool completed = false;
+    size_t messages_delivered = 0;
+    size_t bytes_delivered = 0;
+    bool intact = true;
+    double elapsed_s = 0.0;
+    double goodput_mbps = 0.0;
+    double segments_per_s = 0.0;
+    double p50_ms = 0.0;
+    double p99_ms = 0.0;
+    double p999_ms = 0.0;
+    double retransmission_ratio = 0.0;
+    uint64_t data_segments_sent = 0;
+    uint64_t retransmissions = 0;
+    uint64_t fec_parity_sent = 0;
+    uint64_t fec_recovered = 0;
+    uint64_t send_timestamps = 0;
+    double srtt_ms = 0.0;
+    double rto_ms = 0.0;
+    double user_us_per_segment = 0.0;                   // process CPU (both ends) per data segment sent
+    double sys_us_per_segment = 0.0;
+};
+
+static double cpuSeconds(const struct timeval& tv) {return tv.tv_sec + tv.tv_usec / 1e6;}
+
+// UDP relay between sender and receiver. Rewrites the header ports so each side
+// believes it talks to the relay port, and drops datagrams with a seeded RNG.
+class LossyRelay {
+    private:
+        int socketfd = -1;
+        uint16_t relayPort, clientPort, serverPort;
+        double loss;
+        std::mt19937_64 rng;
+        std::atomic<bool> running{false};
+        std::thread relayThread;
+
+        static void rewritePort(std::vector<uint8_t>& packet, size_t offset, uint16_t value) {
+            uint16_t old = static_cast<uint16_t>((packet[offset] << 8) | packet[offset + 1]);
+            uint16_t checksum = static_cast<uint16_t>((packet[16] << 8) | packet[17]);
+            uint32_t sum = static_cast<uint16_t>(~checksum) + static_cast<uint16_t>(~old) + value;
+            sum = (sum & 0xFFFF) + (sum >> 16);
+            sum = (sum & 0xFFFF) + (sum >> 16);
+            checksum = static_cast<uint16_t>(~sum);
+            packet[offset] = value >> 8;
+            packet[offset + 1] = value & 0xFF;
+            packet[16] = checksum >> 8;
+            packet[17] = checksum & 0xFF;
+        }
+
+        void forward() {
+            std::vector<uint8_t> packet(65536);
+            std::bernoulli_distribution drop(loss);
+            sockaddr_in client{}, server{};
+            client.sin_family = server.sin_family = AF_INET;
+            client.sin_addr.s_addr = server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            client.sin_port = htons(clientPort);
+            server.sin_port = htons(serverPort);
+
+            while (running) {
+                sockaddr_in from{};
+                socklen_t len = sizeof(from);
+                ssize_t n = recvfrom(socketfd, packet.data(), packet.size(), 0, (sockaddr*)&from, &len);
+                if (n < Segment::HEADER_SIZE) continue;
+                if (loss > 0.0 && drop(rng)) continue;
+
+                std::vector<uint8_t> msg(packet.begin(), packet.begin() + n);
+                if (ntohs(from.sin_port) == clientPort) {
+                    rewritePort(msg, 0, relayPort);
+                    rewritePort(msg, 2, serverPort);
+                    sendto(socketfd, msg.data(), msg.size(), 0, (sockaddr*)&server, sizeof(server));
+                } else if (ntohs(from.sin_port) == serverPort) {
+                    rewritePort(msg, 0, relayPort);
+                    rewritePort(msg, 2, clientPort);
+                    sendto(socketfd, msg.data(), msg.size(), 0, (sockaddr*)&client, sizeof(client));
+                }
+            }
+        }
+
+    public:
+        LossyRelay(uint16_t relayPort, uint16_t clientPort, uint16_t serverPort, double loss, uint64_t seed)
+        : relayPort(relayPort), clientPort(clientPort), serverPort(serverPort), loss(loss), rng(seed) {}
+
+        ~LossyRelay() {stop();}
+
+        bool start() {
+            if ((socketfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) return false;
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(relayPort);
+            if (bind(socketfd, (const sockaddr*)&addr, sizeof(addr)) < 0) return false;
+            timeval tv{0, 100000};
+            setsockopt(socketfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            running = true;
+            relayThread = std::thread(&LossyRelay::forward, this);
+            return true;
+        }
+
+        void stop() {
+            running = false;
+            if (relayThread.joinable()) relayThread.join();
+            if (socketfd >= 0) close(socketfd);
+            socketfd = -1;
+        }
+};
+
+static double percentile(std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+}
+
+static uint8_t patternByte(size_t message, size_t offset) {
+    return static_cast<uint8_t>((message * 31 + offset) & 0xFF);
+}
+
+static BenchResult runBench(const BenchConfig& config) {
+    using clock = std::chrono::steady_clock;
+    BenchResult result;
+
+    uint16_t receiverPort = config.base_port;
+    uint16_t senderPort = config.base_port + 1;
+    uint16_t relayPort = config.base_port + 2;
+    bool proxy = config.proxy || config.loss > 0.0;
+    uint16_t target = proxy ? relayPort : receiverPort;
+    uint16_t peerOfReceiver = proxy ? relayPort : senderPort;
+
+    ThreadSafeQueue<std::vector<uint8_t>> senderInput, receiverInput;
+    std::map<uint16_t, Client> senderClients, receiverClients;
+
+    std::unique_ptr<LossyRelay> relay;
+    if (proxy) {
+        relay = std::make_unique<LossyRelay>(relayPort, senderPort, receiverPort, config.loss, config.seed);
+        if (!relay->start()) return result;
+    }
+
+    auto receiver = std::make_unique<Connection>(receiverPort, "127.0.0.1", receiverInput, receiverClients);
+    receiver->setWindowSize(config.window);
+    receiver->setWindowAutotune(config.autotune);
+    receiver->setWindowScaling(config.wscale);
+    auto sender = std::make_unique<Connection>(senderPort, target, "127.0.0.1", "127.0.0.1", senderInput, senderClients);
+    sender->setFecGroupSize(config.fec_group);
+    receiver->setFecGroupSize(config.fec_group);                     // negotiated in the handshake, both sides offer it
+    sender->setSegmentOffload(config.offload);
+    receiver->setSegmentOffload(config.offload);
+    sender->setIoUring(config.uring);
+    receiver->setIoUring(config.uring);
+    sender->setBusyPoll(std::chrono::microseconds(config.busy_poll_us));
+    receiver->setBusyPoll(std::chrono::microseconds(config.busy_poll_us));
+    receiver->connect();
+    sender->connect();
+
+    // The Client maps belong to the communication threads while they run; the handshake is read from the atomic Stats.
+    auto established = [&] {return sender->getStats().connections_established && receiver->getStats().connections_established;};
+    auto handshakeDeadline = clock::now() + std::chrono::seconds(30);
+    while (clock::now() < handshakeDeadline && !established()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    result.established = established();
+    if (!result.established) return result;
+    // Nothing adds or removes a receiver client from here until it is torn down, so the lookup does not race
+    // the map; of the Client only its thread safe receivedData queue is touched.
+    Client& peer = receiverClients.at(peerOfReceiver);
+
+    std::vector<clock::time_point> sentAt(config.messages);
+    std::vector<double> latencies;
+    latencies.reserve(config.messages);
+    size_t receivedBytes = 0;
+
+    struct rusage usageBefore, usageAfter;
+    getrusage(RUSAGE_SELF, &usageBefore);
+    auto start = clock::now();
+    auto deadline = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(config.duration_s));
+    // Paced runs measure one-way latency without queueing behind earlier messages; the reader spins so its own
+    // wake-ups do not show up in the numbers.
+    size_t queued = 0;
+    auto queueDue = [&]() {
+        for (; queued < config.messages; queued++) {
+            if (config.interval_us && clock::now() < start + std::chrono::microseconds(queued * config.interval_us)) break;
+            std::vector<uint8_t> message(config.payload);
+            for (size_t j = 0; j < config.payload; j++) message[j] = patternByte(queued, j);
+            sentAt[queued] = clock::now();
+            senderInput.push(std::move(message));
+        }
+    };
+    queueDue();
+
+    auto last = start;
+    std::vector<uint8_t> chunk;
+    while (latencies.size() < config.messages && clock::now() < deadline) {
+        queueDue();
+        if (!peer.receivedData.tryPop(chunk)) {
+            if (config.interval_us) std::this_thread::yield();
+            else std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+        auto now = clock::now();
+        for (uint8_t byte : chunk) {
+            size_t message = receivedBytes / config.payload;
+            if (byte != patternByte(message, receivedBytes % config.payload)) result.intact = false;
+            receivedBytes++;
+            if (receivedBytes % config.payload == 0) {
+                latencies.push_back(std::chrono::duration<double, std::milli>(now - sentAt[message]).count());
+            }
+        }
+        last = now;
+    }
+
+    getrusage(RUSAGE_SELF, &usageAfter);
+    result.completed = latencies.size() == config.messages;
+    result.messages_delivered = latencies.size();
+    result.bytes_delivered = receivedBytes;
+    result.elapsed_s = std::chrono::duration<double>((result.completed ? last : clock::now()) - start).count();
+
+    const Connection::Stats& stats = sender->getStats();
+    result.data_segments_sent = stats.data_segments_sent;
+    result.retransmissions = stats.retransmissions;
+    result.fec_parity_sent = stats.fec_parity_sent;
+    result.fec_recovered = receiver->getStats().fec_recovered;
+    result.send_timestamps = stats.send_timestamps;
+
+    // Destroying the connections joins their communication threads (and keeps the Clients), so the sender's
+    // RTT estimate is read once nothing writes it any more.
+    sender.reset();
+    receiver.reset();
+    result.srtt_ms = senderClients.at(target).getTransmissionInfo().estimatedRTT;
+    result.rto_ms = senderClients.at(target).getTransmissionInfo().timeout_interval;
+    if (result.elapsed_s > 0.0) {
+        result.goodput_mbps = receivedBytes / result.elapsed_s / 1e6;
+        result.segments_per_s = result.data_segments_sent / result.elapsed_s;
+    }
+    if (result.data_segments_sent) {
+        result.retransmission_ratio = static_cast<double>(result.retransmissions) / result.data_segments_sent;
+        result.user_us_per_segment = (cpuSeconds(usageAfter.ru_utime) - cpuSeconds(usageBefore.ru_utime)) * 1e6 / result.data_segments_sent;
+        result.sys_us_per_segment = (cpuSeconds(usageAfter.ru_stime) - cpuSeconds(usageBefore.ru_stime)) * 1e6 / result.data_segments_sent;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    result.p50_ms = percentile(latencies, 0.50);
+    result.p99_ms = percentile(latencies, 0.99);
+    result.p999_ms = percentile(latencies, 0.999);
+    return result;
+}
+
+template<typename T>
+static std::vector<T> parseList(const std::string& arg) {
+    std::vector<T> values;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        std::stringstream value(item);
+        double parsed;
+        value >> parsed;
+        values.push_back(static_cast<T>(parsed));
+    }
+    return values;
+}
+
+int main(int argc, char* argv[]) {
+    Logger::setPriority(LogLevel::CRITICAL);
+
+    std::vector<size_t> payloads{64, 1024};
+    std::vector<uint32_t> windows{1000, 16000};
+    std::vector<double> losses{0.0, 0.02};
+    std::vector<uint8_t> fecGroups{0};
+    std::vector<uint8_t> offloads{0};
+    std::vector<uint8_t> urings{0};
+    std::vector<size_t> busyPolls{0};
+    std::vector<uint8_t> autotunes{1};
+    std::vector<uint8_t> wscales{1};
+    BenchConfig base;
+    std::string label = "local";
+    bool placed = false;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if (flag == "--payload") payloads = parseList<size_t>(value);
+        else if (flag == "--window") windows = parseList<uint32_t>(value);
+        else if (flag == "--loss") losses = parseList<double>(value);
+        else if (flag == "--fec") fecGroups = parseList<uint8_t>(value);
+        else if (flag == "--gso") offloads = parseList<uint8_t>(value);
+        else if (flag == "--uring") urings = parseList<uint8_t>(value);
+        else if (flag == "--busy-poll") busyPolls = parseList<size_t>(value);
+        else if (flag == "--autotune") autotunes = parseList<uint8_t>(value);
+        else if (flag == "--wscale") wscales = parseList<uint8_t>(value);
+        else if (flag == "--interval-us") base.interval_us = std::stoul(value);
+        else if (flag == "--threads") {
+            if (!ThreadPlacement::configure(value)) return 1;
+            placed = true;
+        }
+        else if (flag == "--messages") base.messages = std::stoul(value);
+        else if (flag == "--duration") base.duration_s = std::stod(value);
+        else if (flag == "--seed") base.seed = std::stoull(value);
+        else if (flag == "--port") base.base_port = static_cast<uint16_t>(std::stoi(value));
+        else if (flag == "--proxy") base.proxy = (value == "1" || value == "true");
+        else if (flag == "--label") label = value;
+        else {
+            std::cerr << "unknown flag " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "{\n  \"benchmark\": \"transport_loopback\",\n  \"label\": \"" << label << "\",\n"
+              << "  \"messages\": " << base.messages << ",\n  \"duration_cap_s\": " << base.duration_s << ",\n"
+              << "  \"seed\": " << base.seed << ",\n  \"runs\": [";
+
+    // Every combination of the swept flags, in flag order.
+    std::vector<BenchConfig> configs{base};
+    auto sweep = [&configs](const auto& values, auto apply) {
+        std::vector<BenchConfig> expanded;
+        for (const BenchConfig& config : configs) {
+            for (const auto& value : values) {
+                expanded.push_back(config);
+                apply(expanded.back(), value);
+            }
+        }
+        configs.swap(expanded);
+    };
+    sweep(payloads, [](BenchConfig& c, size_t v) {c.payload = v;});
+    sweep(windows, [](BenchConfig& c, uint32_t v) {c.window = v;});
+    sweep(losses, [](BenchConfig& c, double v) {c.loss = v;});
+    sweep(fecGroups, [](BenchConfig& c, uint8_t v) {c.fec_group = v;});
+    sweep(offloads, [](BenchConfig& c, uint8_t v) {c.offload = v;});
+    sweep(urings, [](BenchConfig& c, uint8_t v) {c.uring = v;});
+    sweep(busyPolls, [](BenchConfig& c, size_t v) {c.busy_poll_us = v;});
+    sweep(autotunes, [](BenchConfig& c, uint8_t v) {c.autotune = v;});
+    sweep(wscales, [](BenchConfig& c, uint8_t v) {c.wscale = v;});
+
+    bool first = true;
+    uint16_t port = base.base_port;
+    for (BenchConfig& config : configs) {
+        config.base_port = port;
+        port += 4;
+
+        BenchResult r = runBench(config);
+        std::cout << (first ? "\n" : ",\n") << "    {"
+                  << "\"payload\": " << config.payload
+                  << ", \"window\": " << config.window
+                  << ", \"loss\": " << config.loss
+                  << ", \"fec_group\": " << static_cast<unsigned>(config.fec_group)
+                  << ", \"gso\": " << (config.offload ? "true" : "false")
+                  << ", \"uring\": " << (config.uring ? "true" : "false")
+                  << ", \"busy_poll_us\": " << config.busy_poll_us
+                  << ", \"autotune\": " << (config.autotune ? "true" : "false")
+                  << ", \"wscale\": " << (config.wscale ? "true" : "false")
+                  << ", \"interval_us\": " << config.interval_us
+                  << ", \"proxy\": " << ((config.proxy || config.loss > 0.0) ? "true" : "false")
+                  << ", \"established\": " << (r.established ? "true" : "false")
+                  << ", \"completed\": " << (r.completed ? "true" : "false")
+                  << ", \"intact\": " << (r.intact ? "true" : "false")
+                  << ", \"messages_delivered\": " << r.messages_delivered
+                  << ", \"elapsed_s\": " << r.elapsed_s
+                  << ", \"goodput_MBps\": " << r.goodput_mbps
+                  << ", \"segments_per_s\": " << r.segments_per_s
+                  << ", \"latency_ms\": {\"p50\": " << r.p50_ms << ", \"p99\": " << r.p99_ms << ", \"p999\": " << r.p999_ms << "}"
+                  << ", \"data_segments_sent\": " << r.data_segments_sent
+                  << ", \"retransmissions\": " << r.retransmissions
+                  << ", \"retransmission_ratio\": " << r.retransmission_ratio
+                  << ", \"fec_parity_sent\": " << r.fec_parity_sent
+                  << ", \"fec_recovered\": " << r.fec_recovered
+                  << ", \"send_timestamps\": " << r.send_timestamps
+                  << ", \"srtt_ms\": " << r.srtt_ms
+                  << ", \"rto_ms\": " << r.rto_ms
+                  << ", \"cpu_us_per_segment\": {\"user\": " << r.user_us_per_segment << ", \"sys\": " << r.sys_us_per_segment << "}"
+                  << "}" << std::flush;
+        first = false;
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+    if (placed) std::cerr << ThreadPlacement::report();
+    return 0;
+}
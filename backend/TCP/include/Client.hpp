@@ -6,16 +6,29 @@
 #include <map>
 #include <cstring> 
 #include <queue>
+#include <deque>
 #include <ctime>
 
+#include "Clock.hpp"
 #include "Segment.hpp"
-#include "SegmentInfo.hpp"
+#include "RetransmitQueue.hpp"
+#include "SequenceNumber.hpp"
+#include "SharedPayload.hpp"
+#include "PathMtu.hpp"
+#include "ReceiveWindow.hpp"
+#include "Fec.hpp"
 #include "ThreadSafeQueue.hpp"
 
 class Client {
     private:    
+        // RFC 6298 constants (ms)
         inline static constexpr double ALPHA = 0.125;
         inline static constexpr double BETA = 0.25;
+        inline static constexpr double K = 4.0;
+        inline static constexpr double CLOCK_GRANULARITY = 1.0;
+        inline static constexpr double INITIAL_RTO = 1000.0;
+        inline static constexpr double MIN_RTO = 200.0;
+        inline static constexpr double MAX_RTO = 60000.0;
 
         uint16_t port{0};                                               // PORT
         uint32_t IP{0};                                                 // IP
@@ -24,34 +37,89 @@ class Client {
         uint32_t last_ack{0};                                           // Last Segment ACK from Client
         uint8_t state{0};                                               // CURRENT STATE
 
-        std::map<uint32_t, std::unique_ptr<Segment>> messageBuffer{};   // Message Buffer holding out of order packets
-        std::queue<std::shared_ptr<SegmentInfo>> messagesSent;          // QUEUE holding un-ACK messages (can retransmit)
-        std::shared_ptr<SegmentInfo> tracker_segment{};                 // Last Time Sent a message
+        std::map<uint32_t, std::unique_ptr<Segment>, SeqLess> messageBuffer{};   // Message Buffer holding out of order packets
+        size_t reassembly_bytes{0};                                     // stream pending maps, messageBuffer but for stream payload
+        RetransmitQueue messagesSent;                                   // QUEUE holding un-ACK messages (can retransmit)
+        SegmentInfo tracker_segment{};                                  // segment timed for the next RTT sample
+        bool tracking{false};                                           // tracker_segment is valid
 
-        uint16_t totalSizeOfMessagesSent{0};                            // total size of QUEUE in bytes
-        uint32_t lastByteSent{0};                                       // Last Byte Sent from Data
-        uint16_t windowSize{0};
+        uint32_t totalSizeOfMessagesSent{0};                            // total size of QUEUE in bytes
+        uint32_t windowSize{0};                                         // peer's receive window in bytes (scaled)
+        bool window_scaling{false};                                     // both sides sent WINDOW_SCALE on SYN / SYN_ACK
+        uint8_t peer_window_scale{0};                                   // shift applied to the window fields the peer sends
         bool isFinSent{false};                                          // True when we have created a FIN and appended to the queue
+        bool compression{false};                                        // both sides offered Lz4 in the handshake
+        bool fast_open{false};                                          // peer's SYN carried a FAST_OPEN option (server side)
 
         // ms
         struct TransmissionInfo {
-            double estimatedRTT=0.0;
-            double deviationRTT=0.0;
-            double timeout_interval=10000.0;
-            uint8_t number_of_timeouts=0;
+            double estimatedRTT=0.0;                                    // SRTT
+            double deviationRTT=0.0;                                    // RTTVAR
+            double timeout_interval=INITIAL_RTO;                        // RTO currently armed (includes backoff)
+            uint8_t number_of_timeouts=0;                               // consecutive timeouts since the last new ACK
+            bool hasSample=false;
         };
 
         TransmissionInfo transmission_info;
+        Clock::time_point timer_start{};                                // last time the retransmission timer was restarted by a new ACK
+        Clock::time_point persist_deadline{Clock::time_point::max()};   // next zero window probe, max = not armed
+        uint8_t persist_backoff{0};                                     // probes answered with a closed window so far
+        Clock::time_point time_wait_start{};                            // entered TIME_WAIT, or last re-ACK'd the peer's FIN_ACK there
+
+        PathMtu path_mtu;                                               // segment size confirmed for the path to this client
+        Fec fec;                                                        // parity groups sent to / received from this client
+        ReceiveWindow receive_window;                                   // our receive buffer for this client's data
+
+        // Per client send streams; stream 0 is the default byte stream (received through receivedData).
+        // Queued payloads are shared with the other clients they were broadcast to, never copied.
+        // Offsets are 64 bit so a stream never wraps; segments carry the low 32 bits (unwrapOffset).
+        struct SendChunk {
+            std::shared_ptr<const SharedPayload> payload;
+            uint64_t offset{0};                                         // stream offset of payload->data()[0]
+        };
+
+        struct SendStream {
+            std::deque<SendChunk> chunks;                               // chunks not yet fully ACK'd
+            uint64_t end_offset{0};                                     // stream offset after the last queued byte
+            uint64_t next_offset{0};                                    // next stream offset to send
+            uint64_t acked_offset{0};                                   // everything below was ACK'd
+        };
+
+        struct ReceiveStream {
+            uint64_t next_offset{0};                                    // next stream offset to deliver
+            std::map<uint64_t, std::vector<uint8_t>> pending;           // data ahead of next_offset
+        };
+
+        std::map<uint16_t, SendStream> sendStreams;
+        std::map<uint16_t, ReceiveStream> receiveStreams;
+        uint16_t lastStreamScheduled{0};                                // round robin cursor across streams
+
+        std::vector<uint8_t> frameBuffer;                               // MESSAGE_STREAM bytes not yet forming a whole message
+        std::queue<std::vector<uint8_t>> receivedMessages;              // complete messages waiting for Connection
+        bool message_stream_broken{false};                              // a bad length prefix: no later frame boundary can be trusted
+
+        void ackStreamData(uint16_t id, uint64_t endOffset);
+        const SendChunk* findSendChunk(uint16_t id, uint64_t offset) const;
+        void onStreamData(uint16_t id, std::vector<uint8_t> bytes);
+        void extractFrames();
 
         std::string filename;                                           // FILENAME FOR DATA RECEIVED
         std::ofstream file;                                             // ofstream of file
     public:
+        // Stream reserved for length prefixed messages (Connection::sendMessage / receiveMessage)
+        inline static constexpr uint16_t MESSAGE_STREAM = 0xFFFF;
+        inline static constexpr uint32_t FRAME_HEADER_SIZE = 4;
+        inline static constexpr uint32_t MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+
+        static std::vector<uint8_t> frameMessage(const std::vector<uint8_t>& message);
+
         Client() = default;
         Client(const Client&) = delete;
         Client& operator=(const Client&) = delete;
         // Client(Client&&) noexcept = default;
         // Client& operator = (Client&&) noexcept = default;
         ThreadSafeQueue<std::vector<uint8_t>> receivedData;
+        ThreadSafeQueue<std::pair<uint16_t, std::vector<uint8_t>>> streamData;  // in order data per stream id (> 0)
         
         explicit Client(
             uint16_t port,
@@ -71,11 +139,17 @@ class Client {
         uint32_t getExpectedAck() const;
         uint32_t getLastAck() const;
         uint8_t getState() const;
-        uint32_t getLastByteSent() const;
         bool getIsFinSent() const;
-        uint16_t getWindowSize() const;
-        std::shared_ptr<SegmentInfo> getTrackerSeg();
+        bool getCompression() const;
+        bool getFastOpen() const;
+        uint32_t getWindowSize() const;
+        bool getWindowScaling() const;
+        uint8_t getPeerWindowScale() const;
+        bool hasTrackerSeg() const;
         TransmissionInfo& getTransmissionInfo();
+        PathMtu& getPathMtu();
+        Fec& getFec();
+        ReceiveWindow& getReceiveWindow();
         
         void setPort(uint16_t p);
         void setIP(uint32_t ip);
@@ -83,30 +157,69 @@ class Client {
         void setExpectedAck(uint32_t ack);
         void setLastAck(uint32_t ack);
         void setState(uint8_t s);
-        void setLastByteSent(uint32_t size);
-        void setTrackerSeg(std::shared_ptr<SegmentInfo> seg);
+        void setTrackerSeg(const SegmentInfo& seg);
         
+        double baseTimeout() const;                                     // RTO without backoff (ms)
         void updateTransmissionInfo(double sampleRTT);
         void doubleTimeoutInterval();
+        void resetBackoff();
+        Clock::time_point getRetransmitDeadline();
+
+        // Persist timer (RFC 9293 3.8.6.1): runs while the peer's window is too small for a segment and
+        // nothing is in flight to bring a window update back, backing off like the RTO.
+        void armPersistTimer();
+        void stopPersistTimer();
+        void onWindowProbe();
+        Clock::time_point getPersistDeadline() const;
+
+        void restartTimeWait();
+        Clock::time_point getTimeWaitStart() const;
 
-        void checkTrackerSegment(uint32_t seqNum);
+        // ackTime is when the ACK arrived (kernel RX stamp); unset means now.
+        void checkTrackerSegment(uint32_t seqNum, Clock::time_point ackTime = {});
+        bool setTrackerSendTime(uint32_t seqNum, Clock::time_point time);
+        void invalidateTracker(uint32_t seqNum);
 
         void setIsFinSent(bool fin);
-        void setWindowSize(uint16_t size);
+        void setCompression(bool enabled);
+        void setFastOpen(bool enabled);
+        void setWindowSize(uint32_t size);                              // bytes, e.g. the unscaled window of a SYN
+        void setPeerWindow(uint16_t window);                            // window field of a non SYN segment
+        void enableWindowScaling(uint8_t peerScale, uint8_t ownScale);
 
         bool checkItemMessageBuffer(uint32_t seq);
         bool popItemMessageBuffer(uint32_t seq, std::unique_ptr<Segment>& val);
         void setItemMessageBuffer(uint32_t seq, std::unique_ptr<Segment> val);
 
-        void pushMessage(std::shared_ptr<SegmentInfo> seg);
-        std::chrono::steady_clock::time_point getMessageTimeSent();
+        void pushMessage(const SegmentInfo& seg);
+        Clock::time_point getMessageTimeSent();
         uint32_t getFrontSeqNum();
-        bool popMessage(std::shared_ptr<SegmentInfo>& seg);
+        bool popMessage(SegmentInfo& seg);
         bool checkFront(uint32_t ackNum);
-        void copyFront(std::shared_ptr<SegmentInfo>& seg);
+        bool copyFront(SegmentInfo& seg);
+        void splitFront(uint16_t maxSegmentSize);
+        bool rewindSynData(uint32_t ackNum);                            // SYN_ACK that only covered the SYN: resend its data after the handshake
+
+        void queueStreamData(uint16_t id, std::shared_ptr<const SharedPayload> payload);
+        bool hasUnsentStreamData() const;
+        bool nextSendStream(uint16_t& id);
+        uint64_t getStreamNextOffset(uint16_t id) const;
+        uint64_t getStreamUnsent(uint16_t id) const;
+        void setStreamNextOffset(uint16_t id, uint64_t offset);
+        bool getStreamSlice(uint16_t id, uint64_t start, uint64_t end, std::shared_ptr<const SharedPayload>& payload, uint32_t& begin) const;
+        void deliverStream(uint16_t id, uint32_t wireOffset, const std::vector<uint8_t>& bytes);
+        bool popReceivedMessage(std::vector<uint8_t>& message);
+        // Once a length prefix is out of range the rest of MESSAGE_STREAM is dropped, never re-framed.
+        bool isMessageStreamBroken() const;
+
+        // Received bytes counted against the receive window: not yet read by the application, and still
+        // waiting for earlier data (out of order segments, stream data ahead of its stream).
+        size_t unreadBytes() const;
+        size_t reassemblyBytes() const;
+        void onDataDelivered(size_t bytes);
 
         bool hasMessages() const;
-        uint16_t sizeMessageSent() const;
+        uint32_t sizeMessageSent() const;
         size_t numMessageSentAvailable() const;
 
         void openFile();
@@ -0,0 +1,44 @@
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Time source for the transport. Defaults to steady_clock; the network simulator
+// switches it to a virtual clock so timers and RTT samples follow simulated time.
+class Clock {
+    private:
+        inline static std::atomic<bool> simulated{false};
+        inline static std::atomic<int64_t> simulated_ns{0};
+
+    public:
+        using time_point = std::chrono::steady_clock::time_point;
+        using duration = std::chrono::steady_clock::duration;
+
+        static time_point now() {
+            if (simulated.load(std::memory_order_relaxed)) {
+                return time_point(std::chrono::duration_cast<duration>(std::chrono::nanoseconds(simulated_ns.load(std::memory_order_relaxed))));
+            }
+            return std::chrono::steady_clock::now();
+        }
+
+        static bool isSimulated() {return simulated.load(std::memory_order_relaxed);}
+
+        static void enableSimulation(time_point start = time_point(std::chrono::seconds(1))) {
+            setTime(start);
+            simulated = true;
+        }
+
+        static void disableSimulation() {simulated = false;}
+
+        static void setTime(time_point t) {
+            simulated_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+        }
+
+        static void advance(duration d) {
+            simulated_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        }
+};
+
+#endif
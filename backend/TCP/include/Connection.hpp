@@ -2,7 +2,9 @@
 #define CONNECTION_HPP 
 
 #include "SocketHandler.hpp"
+#include "UringSocketHandler.hpp"
 #include "Client.hpp"
+#include "FastOpen.hpp"
 #include "Flags.hpp"
 #include <map>
 #include <ctime>
@@ -10,29 +12,74 @@
 //TODO: DEFINE DEFAULT START, SEND, 
 class Connection {
     
+    public:
+        // Counters readable from other threads while the connection runs.
+        struct Stats {
+            std::atomic<uint64_t> connections_established{0};         // clients that finished the handshake
+            std::atomic<uint64_t> segments_sent{0};
+            std::atomic<uint64_t> data_segments_sent{0};
+            std::atomic<uint64_t> data_bytes_sent{0};
+            std::atomic<uint64_t> retransmissions{0};
+            std::atomic<uint64_t> mtu_probes_sent{0};
+            std::atomic<uint64_t> fec_parity_sent{0};
+            std::atomic<uint64_t> fec_recovered{0};                   // segments rebuilt from parity instead of waiting for a retransmission
+            std::atomic<uint64_t> compressed_segments{0};
+            std::atomic<uint64_t> compression_bytes_saved{0};         // payload bytes compression kept off the wire
+            std::atomic<uint64_t> segments_received{0};
+            std::atomic<uint64_t> send_timestamps{0};                 // RTT tracker send times replaced by a kernel TX stamp
+            std::atomic<uint64_t> window_probes{0};                   // one byte probes sent into a closed peer window
+            std::atomic<uint64_t> window_updates{0};                  // ACKs sent only because reading reopened our window
+            std::atomic<uint64_t> fast_open_data_sent{0};             // bytes sent on a SYN with a cached cookie
+            std::atomic<uint64_t> fast_open_accepted{0};              // SYNs whose data was delivered before the handshake finished
+        };
 
     private:
+        struct StreamInput {
+            uint16_t peer;                                  // client port, 0 = every client
+            uint16_t stream;
+            std::vector<uint8_t> bytes;
+        };
+
         static constexpr uint16_t MAX_DATA_SIZE = 1000;
         static constexpr time_t MAX_SEGMENT_LIFE = 20; // typical value is 2 minutes 
+        static constexpr std::chrono::milliseconds MAX_IDLE_WAIT{1};
+        // Data on a SYN has to fit the base PLPMTU next to every option the SYN may carry.
+        static constexpr uint16_t MAX_SYN_DATA = PathMtu::BASE_PLPMTU - Segment::HEADER_SIZE - Segment::COMPRESSION_OPTION_SIZE
+            - Segment::WINDOW_SCALE_OPTION_SIZE - Segment::FAST_OPEN_OPTION_SIZE;
         uint16_t source_port;
         uint16_t destination_port;
         std::string source_ip_str;
         std::string destination_ip_str;    
         uint32_t sourceIP;
         uint32_t destinationIP;
-        uint16_t window_size{1000};
+        uint32_t window_size{1000};                                 // initial receive buffer per client
+        uint32_t receive_buffer_max{4 * 1024 * 1024};               // autotuning stops here
+        bool window_autotune{true};
+        bool window_scaling{true};                                  // offer / accept WINDOW_SCALE in the handshake
+        bool fast_open{false};                                      // send / accept data on SYN with a cookie
+        FastOpen fast_open_cookies;
         uint16_t urgent_pointer{0};
         uint32_t default_sequence_number{1000};
         uint32_t default_ack_number{0};
+        uint8_t fec_group_size{0};                                  // data segments per parity segment, 0 = FEC off
+        bool compression{false};                                    // offer / accept Lz4 payload compression in the handshake
+        bool segment_offload{false};                                // let the transport batch segments (UDP GSO/GRO)
+        bool io_uring{false};                                       // default transport: UringSocketHandler over SocketHandler
+        std::chrono::microseconds busy_poll{0};                     // spin this long after the last work, 0 = off
         
-        ThreadSafeQueue<std::unique_ptr<Segment>> receiverQueue;
-        ThreadSafeQueue<std::pair<std::unique_ptr<Segment>, std::function<void()>>> senderQueue;
+        ReceiverQueue receiverQueue;
+        SenderQueue senderQueue;
         ThreadSafeQueue<std::vector<uint8_t>>& inputQueue;
+        ThreadSafeQueue<StreamInput> streamQueue;                                  // unicast and per stream input
+        ThreadSafeQueue<std::pair<uint16_t, std::vector<uint8_t>>> messageQueue;  // received messages (client port, message)
+        std::map<uint16_t, size_t> unreadMessageBytes;                             // bytes in messageQueue per client port
+        mutable std::mutex unreadMessageMtx;
+        ThreadSafeQueue<std::pair<uint16_t, uint32_t>> connectQueue;              // addClient (port, IP)
+        std::vector<uint16_t> pendingSyns;                                         // clients whose SYN goes out once input is queued
         
-        std::unique_ptr<SocketHandler> socketHandler;
+        std::unique_ptr<Transport> transport;
         
         std::map<uint16_t, Client>& clients;
-        std::vector<uint8_t> sendBuffer; 
         
 
         std::atomic<bool> running{false};
@@ -42,14 +89,33 @@ class Connection {
         std::condition_variable safeToClose;
         bool canCloseDown = false;
 
+        Stats stats;
+
         void communicate();
+        void openTarget();
+        void sendSyn(Client& client);
         
-        void createMessage(uint16_t srcPort, uint16_t dstPrt, uint32_t seqNum, uint32_t ackNum, uint8_t flag, uint16_t window, uint16_t urgentPtr, uint32_t dstIP, uint8_t state, uint32_t start, uint32_t end);
+        void queueSegment(std::unique_ptr<Segment> seg);
+        void createMessage(uint16_t srcPort, uint16_t dstPrt, uint32_t seqNum, uint32_t ackNum, uint8_t flag, uint16_t urgentPtr, uint32_t dstIP, uint8_t state, uint64_t start, uint64_t end, uint16_t streamId = 0);
         void resendMessages(uint16_t port);
         void sendMessages(uint16_t port, size_t dataWritten=0);
 
         void messageHandler(std::unique_ptr<Segment> seg, size_t dataWritten=0);
+        size_t deliverPayload(Client& client, const Segment& seg);
+        void deliverStream(Client& client, const Segment& seg);
+        void queueStreamInput(StreamInput& input);
         void messageResendCheck();
+        void initClient(Client& client);
+        size_t unreadBytes(const Client& client) const;
+        uint16_t advertisedWindow(Client& client, bool syn = false);
+        void sendWindowProbe(Client& client);
+        void sendWindowUpdate(Client& client);
+        void probePathMtu(Client& client);
+        void handleProbe(std::unique_ptr<Segment> seg);
+        void protectSegment(Client& client, uint32_t seqNum, uint16_t streamId, uint64_t start, uint64_t end);
+        void sendParity(Client& client);
+        void handleParity(std::unique_ptr<Segment> seg);
+        void handleSegment(std::unique_ptr<Segment> seg);
 
     public:
 
@@ -70,12 +136,54 @@ class Connection {
         );
 
         Connection() = delete;
+        ~Connection();
         
         void connect();
+        void connect(const TransportFactory& factory, bool threaded = true);
         void disconnect();
 
-        uint16_t getWindowSize() const {return window_size;}
-        void setWindowSize(uint16_t val) {window_size = val;}
+        // Queue bytes on an independent ordered stream to every open client.
+        // Stream 0 is the inputQueue byte stream; other streams are delivered through Client::streamData
+        // and are not held up by losses on other streams.
+        void sendOnStream(uint16_t streamId, std::vector<uint8_t> bytes);
+
+        // Queue bytes for one client only; every client owns its send streams, so nothing is copied to other peers.
+        void sendTo(uint16_t peer, std::vector<uint8_t> bytes, uint16_t streamId = 0);
+
+        // Length prefixed messages on Client::MESSAGE_STREAM: each receiveMessage() returns exactly one
+        // message as it was sent, however it was split into or packed with others in segments.
+        bool sendMessage(uint16_t peer, const std::vector<uint8_t>& message);
+        bool broadcastMessage(const std::vector<uint8_t>& message);
+        bool receiveMessage(std::pair<uint16_t, std::vector<uint8_t>>& message);
+
+        // Manual driving (threaded == false), used by the NetworkSimulator.
+        bool step();
+        bool isRunning() const {return running;}
+        Clock::time_point nextDeadline();
+
+        // Receive window: every client gets a receive buffer of window_size bytes and is advertised what is left
+        // of it after data the application has not read yet. With autotuning the buffer grows with the rate the
+        // application reads at, up to the maximum. Windows above 64 KB need window scaling, which is used with a
+        // client only when both sides enabled it before the handshake. All four take effect for clients created afterwards.
+        uint32_t getWindowSize() const {return window_size;}
+        void setWindowSize(uint32_t val) {window_size = val;}
+
+        uint32_t getReceiveBufferMax() const {return receive_buffer_max;}
+        void setReceiveBufferMax(uint32_t val) {receive_buffer_max = val;}
+
+        bool getWindowAutotune() const {return window_autotune;}
+        void setWindowAutotune(bool enabled) {window_autotune = enabled;}
+
+        bool getWindowScaling() const {return window_scaling;}
+        void setWindowScaling(bool enabled) {window_scaling = enabled;}
+
+        // Fast open (RFC 7413): the first SYN to a server asks for a cookie, later SYNs to it carry the cookie and
+        // the first data queued for the client, which the server delivers without waiting for the handshake. A SYN
+        // without a valid cookie only opens the connection and its data is sent again afterwards. Used with a
+        // client only when both sides enabled it; the cookie cache lives as long as the Connection.
+        bool getFastOpen() const {return fast_open;}
+        void setFastOpen(bool enabled) {fast_open = enabled;}
+        FastOpen& getFastOpenCookies() {return fast_open_cookies;}
         
         uint16_t getUrgentPointer() const {return urgent_pointer;}
         void setUrgentPointer(uint16_t val) {urgent_pointer = val;}
@@ -85,8 +193,38 @@ class Connection {
 
         uint32_t getDefaultAckNumber() const {return default_ack_number;}
         void setDefaultAckNumber(uint32_t val) {default_ack_number = val;}
+
+        // Forward error correction: one XOR parity segment after every groupSize new data segments (redundancy
+        // 1/groupSize), which lets a peer rebuild one lost segment per group without a retransmission. 0 = off.
+        // Used with a client only when both sides enabled it before the handshake.
+        uint8_t getFecGroupSize() const {return fec_group_size;}
+        void setFecGroupSize(uint8_t groupSize) {fec_group_size = groupSize;}
+
+        // Payload compression is used with a client only when both sides enabled it before the handshake.
+        // Data segments that do not shrink are sent as they are.
+        bool getCompression() const {return compression;}
+        void setCompression(bool enabled) {compression = enabled;}
+
+        // Segments queued back to back for one peer leave in one UDP GSO send and arrive coalesced (GRO) when the
+        // kernel supports it; takes effect at connect().
+        bool getSegmentOffload() const {return segment_offload;}
+        void setSegmentOffload(bool enabled) {segment_offload = enabled;}
+
+        // connect() drives the socket through io_uring from the communication thread instead of two I/O threads,
+        // falling back to SocketHandler where the kernel lacks it; takes effect at connect().
+        bool getIoUring() const {return io_uring;}
+        void setIoUring(bool enabled) {io_uring = enabled;}
+
+        // Low latency mode: the communication thread and the transport's threads spin on non-blocking sockets and
+        // queues for this long after the last segment or input, then go back to sleeping; takes effect at connect().
+        std::chrono::microseconds getBusyPoll() const {return busy_poll;}
+        void setBusyPoll(std::chrono::microseconds spin) {busy_poll = spin;}
         
+        // Opens a connection to a peer from any thread. The SYN leaves from the communication thread after the
+        // input queued so far, so with fast open the first message can ride on it.
         void addClient(uint16_t port, uint32_t ip);
+
+        const Stats& getStats() const {return stats;}
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef FASTOPEN_HPP
+#define FASTOPEN_HPP
+
+#include <cstdint>
+#include <map>
+
+// TCP Fast Open (RFC 7413) cookies, both sides of them.
+// Server: a cookie is a MAC of the client's IP under a secret picked when the Connection is created, so
+// it proves the client received a SYN_ACK at that address before and its SYN data can be delivered
+// without waiting for the handshake. Nothing is stored per client.
+// Client: the cookie each server handed out, kept by server address for the next connection to it.
+class FastOpen {
+    public:
+        static constexpr uint8_t COOKIE_SIZE = 8;
+
+    private:
+        uint64_t key[2];                                        // SipHash key, never leaves the process
+        std::map<uint64_t, uint64_t> cookies;                   // (server IP << 16 | port) -> cookie
+
+        static uint64_t peerKey(uint32_t ip, uint16_t port) {return static_cast<uint64_t>(ip) << 16 | port;}
+
+    public:
+        FastOpen();
+
+        // Server side. Never 0, which on the wire means "no cookie yet, please send one".
+        uint64_t cookieFor(uint32_t clientIP) const;
+        bool validCookie(uint32_t clientIP, uint64_t cookie) const;
+
+        // Client side; 0 = none cached.
+        uint64_t cachedCookie(uint32_t serverIP, uint16_t serverPort) const;
+        void storeCookie(uint32_t serverIP, uint16_t serverPort, uint64_t cookie);
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef FEC_HPP
+#define FEC_HPP
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "Segment.hpp"
+#include "SequenceNumber.hpp"
+
+// XOR forward error correction for one Client.
+// The sender XORs every group of consecutive new data segments, covering sequence numbers [first, end), into
+// one parity segment: the stream id, size and stream offset of each segment followed by its payload, zero
+// padded to the longest one. A receiver holding all but one segment of the group rebuilds the missing one
+// from the parity instead of waiting a retransmission timeout for it.
+class Fec {
+    public:
+        static constexpr uint16_t PREFIX_SIZE = 8;                      // [stream id:16][size:16][stream offset:32]
+        static constexpr uint16_t PARITY_OVERHEAD = Segment::PARITY_OPTION_SIZE + PREFIX_SIZE;
+        static constexpr size_t MAX_CACHED_SEGMENTS = 1024;
+
+        struct Parity {
+            uint32_t first{0};
+            uint32_t end{0};
+            uint8_t count{0};
+            std::vector<uint8_t> bytes;
+        };
+
+        struct Recovered {
+            uint32_t seq{0};
+            uint16_t stream_id{0};
+            uint32_t stream_offset{0};
+            std::vector<uint8_t> data;
+        };
+
+    private:
+        struct Received {
+            uint16_t stream_id{0};
+            uint32_t stream_offset{0};
+            std::vector<uint8_t> data;
+        };
+
+        // Sender: the group being built
+        uint32_t group_first{0};
+        uint32_t group_end{0};
+        uint8_t group_count{0};
+        std::vector<uint8_t> parity;
+
+        // Both sides offered FEC in the handshake. Only then is parity sent, and the receiver keeps data segments
+        // from the first one on until the parity of their group arrives; other peers cost nothing.
+        bool enabled{false};
+        std::map<uint32_t, Received, SeqLess> received;
+
+    public:
+        bool isEnabled() const {return enabled;}
+        void setEnabled(bool on) {enabled = on;}
+        uint8_t getGroupCount() const {return group_count;}
+
+        // Adds a new data segment to the current group and returns how many it now holds.
+        uint8_t add(uint32_t seq, uint16_t streamId, uint32_t streamOffset, const uint8_t* data, uint16_t size);
+        Parity takeParity();
+
+        void onData(const Segment& seg);
+        // True when the parity rebuilt the one segment of its group that is missing.
+        bool onParity(const Segment& seg, Recovered& recovered);
+};
+
+#endif
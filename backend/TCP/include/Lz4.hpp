@@ -0,0 +1,22 @@
+#ifndef LZ4_HPP
+#define LZ4_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// In-tree codec for the LZ4 block format (no frame, no checksum), used for segment payload compression.
+// Greedy single probe hash matching, the same speed/ratio trade-off as LZ4's fast mode.
+class Lz4 {
+    public:
+        static constexpr uint8_t CODEC_ID = 1;                  // value of the COMPRESSION option
+        static constexpr size_t MAX_INPUT_SIZE = 65535;         // one segment payload; match positions are 16 bit
+
+        // Compresses [src, src + size) into out; false when the result would not be smaller than the input
+        // or the input is larger than MAX_INPUT_SIZE.
+        static bool compress(const uint8_t* src, size_t size, std::vector<uint8_t>& out);
+        // False on any malformed input or when the output is not exactly originalSize bytes.
+        static bool decompress(const uint8_t* src, size_t size, size_t originalSize, std::vector<uint8_t>& out);
+};
+
+#endif
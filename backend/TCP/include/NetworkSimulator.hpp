@@ -0,0 +1,140 @@
+#ifndef NETWORKSIMULATOR_HPP
+#define NETWORKSIMULATOR_HPP
+
+#include <map>
+#include <queue>
+#include <random>
+#include <functional>
+
+#include "Clock.hpp"
+#include "Transport.hpp"
+
+class Connection;
+class NetworkSimulator;
+
+// One direction of a simulated path. Defaults describe a perfect link.
+struct LinkConfig {
+    double bandwidth_bps = 0.0;                         // serialization rate, 0 = unlimited
+    std::chrono::microseconds delay{0};                 // one-way propagation delay
+    std::chrono::microseconds jitter{0};                // uniform extra delay in [0, jitter]
+    double loss = 0.0;                                  // random loss probability (good state)
+    double burst_start = 0.0;                           // Gilbert-Elliott P(good -> bad) per packet
+    double burst_end = 1.0;                             // Gilbert-Elliott P(bad -> good) per packet
+    double burst_loss = 1.0;                            // loss probability while in the bad state
+    double reorder = 0.0;                               // probability a packet is held back
+    std::chrono::microseconds reorder_delay{0};         // extra delay for held back packets
+    size_t queue_limit = 0;                             // bytes waiting for serialization, 0 = unlimited
+    size_t mtu = 0;                                     // IP MTU; larger datagrams are dropped (DF set), 0 = unlimited
+};
+
+// Transport that hands datagrams to a NetworkSimulator instead of a UDP socket.
+class SimulatedTransport : public Transport {
+    private:
+        NetworkSimulator& simulator;
+
+    public:
+        SimulatedTransport(
+            NetworkSimulator& simulator,
+            uint16_t port,
+            uint32_t selfIP,
+            ReceiverQueue& receiverQueue,
+            SenderQueue& senderQueue
+        );
+
+        void start() override;
+        void stop() override;
+
+        bool flush();
+        void deliver(const std::vector<uint8_t>& bytes, uint32_t sourceIP);
+};
+
+// Deterministic in-process network. Every random decision comes from one seeded
+// generator and every timer reads the virtual Clock, so a run with the same seed,
+// links and workload produces the same packet trace.
+class NetworkSimulator {
+    public:
+        struct Stats {
+            uint64_t packets_sent = 0;
+            uint64_t packets_delivered = 0;
+            uint64_t packets_lost = 0;
+            uint64_t packets_queue_dropped = 0;
+            uint64_t packets_too_big = 0;
+            uint64_t packets_reordered = 0;
+            uint64_t bytes_delivered = 0;
+        };
+
+        // Sees every datagram before the link's loss model; returning true drops it (counted as lost).
+        using DropFilter = std::function<bool(uint32_t fromIP, uint16_t fromPort, uint32_t toIP, uint16_t toPort, const std::vector<uint8_t>& bytes)>;
+
+    private:
+        struct Endpoint {
+            SimulatedTransport* transport = nullptr;
+        };
+
+        struct Link {
+            LinkConfig config;
+            Clock::time_point busy_until{};
+            bool bad_state = false;
+        };
+
+        struct Event {
+            Clock::time_point time;
+            uint64_t order;
+            uint64_t to;
+            uint32_t sourceIP;
+            std::vector<uint8_t> bytes;
+        };
+
+        struct EventLater {
+            bool operator()(const Event& a, const Event& b) const {
+                return a.time != b.time ? a.time > b.time : a.order > b.order;
+            }
+        };
+
+        std::mt19937_64 rng;
+        Clock::duration tick;
+        LinkConfig default_link;
+
+        std::map<uint64_t, Endpoint> endpoints;
+        std::map<std::pair<uint64_t, uint64_t>, Link> links;
+        std::vector<Connection*> connections;
+        std::priority_queue<Event, std::vector<Event>, EventLater> events;
+        uint64_t next_order = 0;
+        DropFilter drop_filter;
+        Stats stats;
+
+        static uint64_t key(uint32_t ip, uint16_t port) {return (static_cast<uint64_t>(ip) << 16) | port;}
+
+        Link& linkFor(uint64_t from, uint64_t to);
+        bool chance(double probability);
+        bool pump();
+        bool deliverDue();
+
+    public:
+        explicit NetworkSimulator(uint64_t seed, Clock::duration tick = std::chrono::milliseconds(1));
+        ~NetworkSimulator();
+
+        NetworkSimulator(const NetworkSimulator&) = delete;
+        NetworkSimulator& operator=(const NetworkSimulator&) = delete;
+
+        void setDefaultLink(const LinkConfig& config) {default_link = config;}
+        void setLink(uint32_t fromIP, uint16_t fromPort, uint32_t toIP, uint16_t toPort, const LinkConfig& config);
+        // Places losses exactly where a test needs them instead of leaving them to the seed.
+        void setDropFilter(DropFilter filter) {drop_filter = std::move(filter);}
+
+        TransportFactory transportFactory();
+        void attach(Connection& connection);
+
+        void registerEndpoint(SimulatedTransport* transport);
+        void unregisterEndpoint(SimulatedTransport* transport);
+        void transmit(uint32_t fromIP, uint16_t fromPort, uint32_t toIP, uint16_t toPort, std::vector<uint8_t> bytes);
+
+        // Drives all attached connections in virtual time until done() holds or limit elapses.
+        bool runUntil(const std::function<bool()>& done, Clock::duration limit);
+        void runFor(Clock::duration duration);
+
+        Clock::time_point now() const {return Clock::now();}
+        const Stats& getStats() const {return stats;}
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef PATHMTU_HPP
+#define PATHMTU_HPP
+
+#include <cstdint>
+
+#include "Clock.hpp"
+
+// Datagram packetization layer path MTU discovery (RFC 8899) for one Client.
+// Sizes are whole segments (header + options + data, i.e. the UDP payload). Probes are padding only
+// segments that the peer answers with a PROBE_ACK option; they never carry stream data, so a lost
+// probe just means the size did not fit.
+class PathMtu {
+    public:
+        enum class State : uint8_t {SEARCHING, SEARCH_COMPLETE};
+
+        static constexpr uint16_t BASE_PLPMTU = 1020;           // HEADER_SIZE + Connection::MAX_DATA_SIZE, what every peer accepts
+        static constexpr uint16_t MAX_PLPMTU = 8972;            // 9000 byte jumbo frame - IPv4 - UDP
+        static constexpr uint16_t SEARCH_GRANULARITY = 32;      // stop once the confirmed and failed sizes are this close
+        static constexpr uint8_t MAX_PROBES = 3;                // unanswered probes before a size counts as too big
+        inline static constexpr Clock::duration RAISE_TIMER = std::chrono::seconds(600);
+
+    private:
+        State state{State::SEARCHING};
+        uint16_t plpmtu{BASE_PLPMTU};                           // largest confirmed size, used for data
+        uint16_t failed_size{MAX_PLPMTU + 1};                   // smallest size known not to fit
+        uint16_t probed_size{0};                                // size of the probe in flight, 0 = none
+        uint8_t probe_count{0};                                 // probes sent for probed_size
+        Clock::time_point probe_deadline{};                     // probe timeout, or the next search while complete
+
+        uint16_t nextCandidate(uint16_t ceiling) const;
+        void completeSearch(Clock::time_point now);
+
+    public:
+        uint16_t getPlpmtu() const {return plpmtu;}
+        State getState() const {return state;}
+        Clock::time_point getDeadline() const {return probe_deadline;}
+
+        // Size of the probe to send now, or 0. ceiling is the largest size the peer's window could carry.
+        uint16_t probeToSend(Clock::time_point now, uint16_t ceiling);
+        void onProbeSent(Clock::time_point now, Clock::duration timeout);
+        void onProbeAck(uint16_t size, Clock::time_point now);
+
+        // Data at plpmtu keeps timing out: fall back to the base size and search again (black hole, 4.3).
+        void onBlackHole(Clock::time_point now);
+};
+
+#endif
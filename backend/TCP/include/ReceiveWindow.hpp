@@ -0,0 +1,59 @@
+#ifndef RECEIVEWINDOW_HPP
+#define RECEIVEWINDOW_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Clock.hpp"
+
+// Receive buffer of one Client and the window advertised from it. The window is whatever the buffer has
+// left once out of order segments and data the application has not read yet are counted, so a reader
+// that falls behind closes it instead of the data piling up in the receive queues.
+// With autotuning the buffer follows the reader the way Linux's dynamic right sizing does
+// (tcp_rcv_space_adjust): once per RTT it grows to twice what the application consumed during that RTT,
+// up to the maximum, so a reader that keeps up gets a window covering the bandwidth-delay product.
+// The buffer never shrinks. With window scaling (RFC 7323) the advertised window is carried in units of
+// 2^scale bytes, rounded down so the peer is never told about space that is not there.
+class ReceiveWindow {
+    public:
+        static constexpr uint32_t MAX_WINDOW = 65535;               // largest value of the header's window field
+        static constexpr uint8_t MAX_SCALE = 14;                    // RFC 7323: windows up to 1 GB
+
+        // Smallest shift that lets the window field cover a buffer of maxBuffer bytes.
+        static uint8_t scaleFor(uint32_t maxBuffer);
+
+    private:
+        uint32_t buffer{1000};                                      // current receive buffer
+        uint32_t max_buffer{MAX_WINDOW};
+        bool autotune{true};
+        uint8_t scale{0};                                           // shift of the windows we advertise, 0 until negotiated
+        uint32_t advertised{0};                                     // window carried by the last segment sent, in bytes
+
+        uint64_t delivered{0};                                      // bytes handed to the application so far
+        uint64_t delivered_at_start{0};                             // ... when the current measurement started
+        size_t unread_at_start{0};                                  // bytes the application had not read then
+        Clock::time_point period_start{};                           // unset until the first advertisement
+
+        void adjust(size_t unread, Clock::time_point now, Clock::duration rtt);
+
+    public:
+        void configure(uint32_t initial, uint32_t maximum, bool autotuning);
+
+        uint32_t getBuffer() const {return buffer;}
+        uint32_t getAdvertised() const {return advertised;}
+        uint8_t getScale() const {return scale;}
+        void setScale(uint8_t shift) {scale = shift;}
+
+        // In order bytes moved into the application's queues (receivedData, streamData, messages).
+        void onDelivered(size_t bytes) {delivered += bytes;}
+
+        // Window field for the next segment. unread: delivered but not yet read by the application;
+        // reassembly: held back waiting for earlier data. SYN and SYN_ACK windows are never scaled.
+        uint16_t advertise(size_t unread, size_t reassembly, Clock::time_point now, Clock::duration rtt, bool syn = false);
+
+        // The last window advertised could not carry a full segment and reading has since opened it by
+        // min(buffer / 2, segmentSize) (RFC 1122 4.2.3.3): tell the sender before it has to probe.
+        bool updateDue(size_t unread, size_t reassembly, uint32_t segmentSize) const;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef RETRANSMITQUEUE_HPP
+#define RETRANSMITQUEUE_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "SegmentInfo.hpp"
+
+// Unacknowledged segments of one Client, oldest first, in a power of two ring of SegmentInfo records.
+// Records are only added at the back (new sends) and removed or re-cut at the front (ACKs, retransmits),
+// so the ring grows by doubling and otherwise never allocates.
+class RetransmitQueue {
+    private:
+        inline static constexpr size_t INITIAL_CAPACITY = 64;
+
+        std::vector<SegmentInfo> slots;
+        size_t head{0};
+        size_t count{0};
+
+        size_t mask() const {return slots.size() - 1;}
+        void grow();
+
+    public:
+        bool empty() const {return count == 0;}
+        size_t size() const {return count;}
+
+        SegmentInfo& front() {return slots[head];}
+        const SegmentInfo& front() const {return slots[head];}
+
+        void push_back(const SegmentInfo& seg);
+        void push_front(const SegmentInfo& seg);
+        void pop_front();
+};
+
+#endif
@@ -5,6 +5,9 @@
 #include <vector>
 #include <memory>
 
+#include "Clock.hpp"
+
+class SharedPayload;
 
 class Segment { 
     private: 
@@ -20,15 +23,66 @@ class Segment {
         uint16_t urgent_pointer;
         uint32_t destinationIP;
 
-        uint32_t start;
-        uint32_t end;
-        std::vector<uint8_t> data;
+        uint16_t stream_id{0};                      // STREAM option, 0 = legacy single stream (no option sent)
+        uint32_t stream_offset{0};
+
+        uint8_t probe_option{0};                    // OPTION_PROBE / OPTION_PROBE_ACK, 0 = none
+        uint16_t probe_size{0};
+
+        uint8_t parity_count{0};                    // OPTION_PARITY: data segments covered, 0 = not a parity segment
+        uint32_t parity_first{0};
+        uint32_t parity_end{0};
+
+        uint8_t compression_offer{0};               // OPTION_COMPRESSION on SYN / SYN_ACK: codec id, 0 = none
+        uint16_t original_size{0};                  // OPTION_COMPRESSED: payload size before compression, 0 = raw
+        bool window_scale_option{false};            // OPTION_WINDOW_SCALE on SYN / SYN_ACK
+        uint8_t window_scale{0};
+        bool fast_open_option{false};               // OPTION_FAST_OPEN on SYN / SYN_ACK
+        uint64_t fast_open_cookie{0};               // 0 = cookie request
+        uint8_t fec_offer{0};                       // OPTION_FEC on SYN / SYN_ACK: parity group size, 0 = none
+
+        Clock::time_point receive_time{};           // kernel receive timestamp when the transport has one, else unset
+        bool send_timestamp{false};                 // transport reports when this segment left (RTT tracker)
+
+        uint64_t start{0};                          // stream offsets of an outgoing segment's data
+        uint64_t end{0};
+        std::vector<uint8_t> data;                  // payload of received segments and probe padding
+
+        std::shared_ptr<const SharedPayload> shared_payload;    // payload of outgoing stream segments (not copied per peer)
+        uint32_t shared_begin{0};
+        uint32_t shared_size{0};
+
+        void updateHeaderLength();
  
-        uint16_t create_checksum(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, const std::vector<uint8_t>& bytes);
-        static bool check_checksum(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, const std::vector<uint8_t>& bytes);
-        
     public:
         static constexpr uint8_t HEADER_SIZE = 20;
+        static constexpr uint16_t MAX_SEGMENT_SIZE = 65507;     // largest UDP payload over IPv4
+
+        // TCP style options (kind, length, value), padded to a 4 byte boundary
+        static constexpr uint8_t OPTION_END = 0;
+        static constexpr uint8_t OPTION_NOP = 1;
+        static constexpr uint8_t OPTION_STREAM = 253;   // [kind][len=8][stream id:16][stream offset:32]
+        static constexpr uint8_t STREAM_OPTION_SIZE = 8;
+        static constexpr uint8_t OPTION_PROBE = 252;    // [kind][len=4][probe size:16], payload is padding
+        static constexpr uint8_t OPTION_PROBE_ACK = 251;// [kind][len=4][size of the probe received:16]
+        static constexpr uint8_t PROBE_OPTION_SIZE = 4;
+        static constexpr uint8_t OPTION_PARITY = 250;   // [kind][len=12][first seq:32][end seq:32][count:8][reserved:8], payload is the XOR (Fec)
+        static constexpr uint8_t PARITY_OPTION_SIZE = 12;
+        static constexpr uint8_t OPTION_COMPRESSION = 249;  // [kind][len=4][codec:8][reserved:8], offered in SYN, accepted in SYN_ACK
+        static constexpr uint8_t COMPRESSION_OPTION_SIZE = 4;
+        static constexpr uint8_t OPTION_COMPRESSED = 248;   // [kind][len=4][original size:16], payload is an Lz4 block
+        static constexpr uint8_t COMPRESSED_OPTION_SIZE = 4;
+        static constexpr uint8_t OPTION_WINDOW_SCALE = 247; // [kind][len=4][shift:8][reserved:8], SYN / SYN_ACK only
+        static constexpr uint8_t WINDOW_SCALE_OPTION_SIZE = 4;
+        static constexpr uint8_t OPTION_FAST_OPEN = 246;    // [kind][len=12][reserved:16][cookie:64], or [kind][len=4][reserved:16] to ask for one
+        static constexpr uint8_t FAST_OPEN_OPTION_SIZE = 12;
+        static constexpr uint8_t FAST_OPEN_REQUEST_SIZE = 4;
+        static constexpr uint8_t OPTION_FEC = 245;          // [kind][len=4][group size:8][reserved:8], offered in SYN, accepted in SYN_ACK
+        static constexpr uint8_t FEC_OPTION_SIZE = 4;
+
+        static uint16_t create_checksum(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, const std::vector<uint8_t>& bytes);
+        static bool check_checksum(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, const std::vector<uint8_t>& bytes);
+        static uint16_t partial_sum(const uint8_t* bytes, size_t size);     // folded ones' complement sum, not inverted
 
         Segment(
             uint16_t srcPort,
@@ -39,8 +93,8 @@ class Segment {
             uint16_t window,
             uint16_t urgentPtr,
             uint32_t destinationIP,
-            uint32_t start,
-            uint32_t end
+            uint64_t start,
+            uint64_t end
         );
 
         Segment(
@@ -56,11 +110,16 @@ class Segment {
         );
         
         std::vector<uint8_t> encode(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol);
+        // Header and options only; the checksum still covers the payload, which the caller sends after it.
+        std::vector<uint8_t> encodeHeader(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, size_t capacity = 0);
         
         static std::unique_ptr<Segment> decode(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, const std::vector<uint8_t>& bytes);
         
         const std::vector<uint8_t>& getData() const;
         void setData(const std::vector<uint8_t>& payload);
+        void setSharedPayload(std::shared_ptr<const SharedPayload> payload, uint32_t begin, uint32_t size);
+        const uint8_t* payloadData() const;
+        size_t payloadSize() const;
 
         uint16_t getSrcPrt() const;
         uint16_t getDestPrt() const;
@@ -70,8 +129,24 @@ class Segment {
         uint16_t getWindowSize() const;
         uint16_t getUrgentPointer() const;
         uint32_t getDestinationIP() const;
-        uint32_t getStart() const;
-        uint32_t getEnd() const;
+        uint64_t getStart() const;
+        uint64_t getEnd() const;
+        uint16_t getStreamId() const;
+        uint32_t getStreamOffset() const;
+        uint8_t getHeaderSize() const;
+        uint8_t getProbeOption() const;
+        uint16_t getProbeSize() const;
+        uint8_t getParityCount() const;
+        uint32_t getParityFirst() const;
+        uint32_t getParityEnd() const;
+        uint8_t getCompressionOffer() const;
+        bool hasWindowScale() const;
+        uint8_t getWindowScale() const;
+        bool hasFastOpen() const;
+        uint64_t getFastOpenCookie() const;
+        uint8_t getFecOffer() const;
+        Clock::time_point getReceiveTime() const;
+        bool getSendTimestamp() const;
 
         void setSeqNum(uint32_t val);
         void setAckNum(uint32_t val);
@@ -79,8 +154,19 @@ class Segment {
         void setWindowSize(uint16_t val);
         void setUrgentPointer(uint16_t val);
         void setDestinationIP(uint32_t ip);
-        void setStart(uint32_t start);
-        void setEnd(uint32_t end);
+        void setStart(uint64_t start);
+        void setEnd(uint64_t end);
+        void setStream(uint16_t id, uint32_t offset);
+        void setProbe(uint8_t option, uint16_t size);
+        void setParity(uint32_t first, uint32_t end, uint8_t count);
+        void setCompressionOffer(uint8_t codec);
+        void setWindowScale(uint8_t shift);
+        void setFastOpen(uint64_t cookie);                  // 0 asks the server for a cookie
+        void setFecOffer(uint8_t groupSize);
+        void setReceiveTime(Clock::time_point time);
+        void setSendTimestamp(bool enabled);
+        // Replaces the payload with its Lz4 block when that is smaller; decode() restores it on the other side.
+        bool compressPayload();
 
 
         void printSegment();
@@ -2,51 +2,23 @@
 #define SEGMENTINFO_HPP
 
 #include <cstdint>
-#include <mutex>
-#include <functional>
-
-class SegmentInfo {
-    private:
-        uint32_t sequence_number = 0;
-        uint8_t flag = 0;
-        uint32_t start = 0;
-        uint32_t data_size = 0;
-        bool tracking = false;
-        std::chrono::steady_clock::time_point time_sent{};
-        mutable std::mutex mtx;
-    public:
-    
-        SegmentInfo() = default;
-
-        SegmentInfo(
-            uint32_t seqNum,
-            uint8_t flag,
-            uint32_t start,
-            uint32_t dataSize,
-            bool tracking
-        );
-
-
-        uint32_t getSeqNum() const;
-        uint8_t getFlag() const;
-        uint32_t getStart() const;
-        uint32_t getDataSize() const;
-        bool isTracking() const;
-        std::chrono::steady_clock::time_point getTimeSent() const;
-
-        void setSeqNum(uint32_t val);
-        void setFlag(uint8_t flag);
-        void setStart(uint32_t val);
-        void setDataSize(uint32_t val);
-        void setTracking(bool val);
-        void setTimeSent(std::chrono::steady_clock::time_point val);
-
-        void setTimeSent();
-        std::function<void()> LastTimeMessageSent(std::shared_ptr<SegmentInfo> self);
-
-        long long printableTimeSent();
-        
-
+#include <type_traits>
+
+#include "Clock.hpp"
+
+// Bookkeeping for one sent, not yet acknowledged segment. Plain data kept inline in the Client's
+// RetransmitQueue: two records per cache line, no heap object or lock per segment.
+struct SegmentInfo {
+    uint64_t start{0};                                  // stream offset of the first data byte
+    Clock::time_point time_sent{};                      // handed to the transport, set once per record
+    uint32_t seq{0};
+    uint32_t data_size{0};
+    uint16_t stream_id{0};                              // start/data_size are offsets within this stream
+    uint8_t flag{0};
+    uint8_t retransmits{0};                             // times resent after a timeout
 };
 
-#endif 
\ No newline at end of file
+static_assert(std::is_trivially_copyable_v<SegmentInfo>, "SegmentInfo is copied around as raw bytes");
+static_assert(sizeof(SegmentInfo) == 32, "two SegmentInfo per cache line");
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef SEQUENCENUMBER_HPP
+#define SEQUENCENUMBER_HPP
+
+#include <cstdint>
+
+// RFC 1982 serial number arithmetic for 32 bit sequence numbers: a comes before b when b is less than
+// 2^31 ahead of it, so ordering keeps working after the counter wraps (every 4 GB on a connection).
+inline bool seqLess(uint32_t a, uint32_t b) {return static_cast<int32_t>(a - b) < 0;}
+inline bool seqLessEqual(uint32_t a, uint32_t b) {return static_cast<int32_t>(a - b) <= 0;}
+inline bool seqGreater(uint32_t a, uint32_t b) {return seqLess(b, a);}
+inline bool seqGreaterEqual(uint32_t a, uint32_t b) {return seqLessEqual(b, a);}
+
+// Ordering for maps keyed by sequence number; valid while the keys span less than 2^31.
+struct SeqLess {
+    bool operator()(uint32_t a, uint32_t b) const {return seqLess(a, b);}
+};
+
+// Stream offsets are 64 bit internally and carry only their low 32 bits on the wire (STREAM option).
+// Restores the full offset closest to reference, the receiver's next expected offset.
+inline uint64_t unwrapOffset(uint32_t wire, uint64_t reference) {
+    int32_t delta = static_cast<int32_t>(wire - static_cast<uint32_t>(reference));
+    if (delta < 0 && static_cast<uint64_t>(-static_cast<int64_t>(delta)) > reference) return wire;
+    return reference + delta;
+}
+
+#endif
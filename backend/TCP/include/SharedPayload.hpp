@@ -0,0 +1,30 @@
+#ifndef SHAREDPAYLOAD_HPP
+#define SHAREDPAYLOAD_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Immutable stream data shared by every Client it was queued for (one copy per broadcast, not per peer).
+// Running ones' complement sums are kept every SUM_BLOCK bytes, so the payload checksum of any segment
+// cut from it costs two short edge sums instead of a pass over the payload for every peer.
+class SharedPayload {
+    private:
+        inline static constexpr uint32_t SUM_BLOCK = 64;
+
+        std::vector<uint8_t> bytes;
+        std::vector<uint64_t> block_sums;                       // block_sums[k] = unfolded sum of bytes [0, k * SUM_BLOCK)
+
+    public:
+        explicit SharedPayload(std::vector<uint8_t> bytes);
+
+        static std::shared_ptr<const SharedPayload> create(std::vector<uint8_t> bytes);
+
+        const uint8_t* data() const {return bytes.data();}
+        uint32_t size() const {return static_cast<uint32_t>(bytes.size());}
+
+        // Folded 16 bit sum of [begin, begin + length) as it lines up in a packet where bytes[begin] is a high byte.
+        uint16_t sum(uint32_t begin, uint32_t length) const;
+};
+
+#endif
@@ -1,43 +1,93 @@
 #ifndef SOCKETHANDLER_HPP
 #define SOCKETHANDLER_HPP
 
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <mutex>
+
 #include "NetCommon.hpp"
 #include "Segment.hpp"
+#include "SpscQueue.hpp"
 #include "ThreadSafeQueue.hpp"
+#include "Transport.hpp"
 
-class SocketHandler {
-    private:
-        ThreadSafeQueue<std::unique_ptr<Segment>>& receiverQueue;
-        ThreadSafeQueue<std::pair<std::unique_ptr<Segment>, std::function<void()>>>& senderQueue;
-        std::vector<uint8_t>& sendBuffer; 
+class SocketHandler : public Transport {
+    protected:
+        inline static constexpr size_t CONTROL_BUFFER_SIZE = 256;
 
         int socketfd;
-        uint16_t port;
-        uint32_t selfIP;
         std::atomic<bool> running{false};
+
+        // SO_TIMESTAMPING: software RX stamps on every datagram, TX stamps for segments that ask for one.
+        bool timestamping{false};
+        uint32_t stamped_sends{0};                              // kernel id (OPT_ID) of the next timestamped send
+        std::deque<std::pair<uint32_t, SendTimestamp>> pending_stamps;  // sending thread only
+
+        // sendmsg() arguments for one segment. The message points into the object itself, so it must not move
+        // while the kernel may still read it.
+        struct Outgoing {
+            std::vector<uint8_t> header;
+            struct sockaddr_in address{};
+            struct iovec iov[2]{};
+            struct msghdr message{};
+            alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(uint32_t))]{};
+            bool stamp{false};
+        };
+
+        static Clock::time_point fromKernelTime(const struct timespec& stamp);
+        static size_t findGroSize(struct msghdr& message);
+        static const struct timespec* findTimestamp(struct msghdr& message);
+
+        void openSocket();
+        void startThreads();
+        void prepareMessage(Segment& segment, Outgoing& out);
+        void finishSend(const Segment& segment, const Outgoing& out, int result);     // result: bytes sent or -errno
+        void deliverDatagram(const uint8_t* packet, size_t size, struct msghdr& message, uint32_t sourceIP, uint16_t sourcePort);
+        void readSendTimestamps();
+
+    private:
         std::thread receiverThread;
         std::thread senderThread;
-        
-        
-        std::function<void()> updateLastTimeSent;
+
+        // UDP GSO/GRO (Transport::setSegmentOffload): equally sized segments queued back to back for one peer leave
+        // in a single sendmsg(); coalesced datagrams are split again on receive.
+        static constexpr size_t MAX_TRAIN_SEGMENTS = 64;                // UDP_MAX_SEGMENTS on older kernels
+        static constexpr size_t MAX_TRAIN_BYTES = Segment::MAX_SEGMENT_SIZE;
+
+        // Transport::setBusyPoll: both threads spin instead of blocking while traffic is recent, and segments skip
+        // receiverQueue / senderQueue for one ring per direction. An idle sender parks on sendWake; pushSend()
+        // only takes sendWakeMtx when it finds the sender parked.
+        bool spinning{false};
+        std::unique_ptr<SpscQueue<std::unique_ptr<Segment>>> busyReceiveQueue;  // receiver thread -> popReceived()
+        std::unique_ptr<SpscQueue<std::unique_ptr<Segment>>> busySendQueue;     // pushSend() -> sender thread
+        std::atomic<bool> senderParked{false};
+        std::mutex sendWakeMtx;
+        std::condition_variable sendWake;
 
         void receive();
 
         void send();
+        bool nextSend(std::unique_ptr<Segment>& segment, Clock::time_point lastSend);
+        void parkSender();
+        void sendSegment(Segment& segment);
+        void collectTrain(std::vector<std::unique_ptr<Segment>>& train, std::unique_ptr<Segment>& carry);
+        void sendTrain(std::vector<std::unique_ptr<Segment>>& train);
 
     public:
 
         SocketHandler(
             uint16_t port,
             uint32_t selfIP,
-            ThreadSafeQueue<std::unique_ptr<Segment>>& receiverQueue,
-            ThreadSafeQueue<std::pair<std::unique_ptr<Segment>, std::function<void()>>>& senderQueue,
-            std::vector<uint8_t>& sendBuffer 
+            ReceiverQueue& receiverQueue,
+            SenderQueue& senderQueue
         );
 
-        void start();
+        void start() override;
 
-        void stop();
+        void stop() override;
+        bool pushSend(std::unique_ptr<Segment>& segment) override;
+        bool popReceived(std::unique_ptr<Segment>& segment) override;
 };
 
-#endif 
\ No newline at end of file
+#endif 
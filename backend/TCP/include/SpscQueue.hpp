@@ -0,0 +1,81 @@
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread. Neither side ever
+// blocks or sleeps: a full queue fails tryPush, an empty one tryPop, and the caller decides whether to spin.
+template<typename T>
+class SpscQueue {
+    private:
+        std::vector<T> slots;
+        size_t mask;
+        alignas(64) std::atomic<size_t> head{0};               // next slot to pop, written by the consumer
+        alignas(64) std::atomic<size_t> tail{0};               // next slot to push, written by the producer
+
+        static size_t roundUp(size_t capacity) {
+            size_t size = 1;
+            while (size < capacity) size <<= 1;
+            return size;
+        }
+
+    public:
+        explicit SpscQueue(size_t capacity) : slots(roundUp(capacity)), mask(slots.size() - 1) {}
+
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        // Moves from item only when it returns true.
+        bool tryPush(T&& item) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+            slots[t & mask] = std::move(item);
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(T& item) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) return false;
+            item = std::move(slots[h & mask]);
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // In place versions for large items: fill the slot claim() returns and publish() it, or read the slot
+        // peek() returns and release() it. nullptr = full / empty. Same one producer / one consumer rule.
+        T* claim() {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == slots.size()) return nullptr;
+            return &slots[t & mask];
+        }
+
+        void publish(size_t count = 1) {tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);}
+
+        T* peek() {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) return nullptr;
+            return &slots[h & mask];
+        }
+
+        void release(size_t count = 1) {head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);}
+
+        // Items spread over several consecutive slots: reserve(count) checks count slots are free, reserved(i) is
+        // the i-th of them, and publish(count) hands them over together. The consumer reads ready() items with
+        // peeked(i) and release(count)s them.
+        bool reserve(size_t count) {
+            return tail.load(std::memory_order_relaxed) + count - head.load(std::memory_order_acquire) <= slots.size();
+        }
+
+        T& reserved(size_t i) {return slots[(tail.load(std::memory_order_relaxed) + i) & mask];}
+
+        size_t ready() {return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed);}
+
+        T& peeked(size_t i) {return slots[(head.load(std::memory_order_relaxed) + i) & mask];}
+
+        bool empty() const {return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);}
+};
+
+#endif
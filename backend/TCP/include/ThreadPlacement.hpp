@@ -0,0 +1,168 @@
+#ifndef THREADPLACEMENT_HPP
+#define THREADPLACEMENT_HPP
+
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Logger.hpp"
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Where one named thread runs. Configured per name before the threads start and applied by each
+// thread itself as its first action (ThreadPlacement::apply).
+struct Placement {
+    std::vector<int> cpus;                      // allowed CPUs, empty = any
+    int fifo_priority{0};                       // 1..99 runs the thread SCHED_FIFO at that priority, 0 = normal
+    bool numa_local{false};                     // allocate memory on the node of the CPU the thread runs on
+};
+
+// Thread names used by the transport and the services on top of it: tcp-connection, tcp-receiver, tcp-sender,
+// vim-handler, ws-receiver, ws-sender. Threads with no placement keep floating but are still named and reported.
+class ThreadPlacement {
+    private:
+        inline static std::mutex mtx;
+        inline static std::map<std::string, Placement> placements;
+        inline static std::vector<std::string> layout;         // one line per started thread
+
+        static std::string cpuList(const std::vector<int>& cpus) {
+            std::string out;
+            for (size_t i = 0; i < cpus.size(); i++) {
+                size_t j = i;
+                while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) j++;
+                if (!out.empty()) out += ",";
+                out += std::to_string(cpus[i]);
+                if (j > i) out += "-" + std::to_string(cpus[j]);
+                i = j;
+            }
+            return out.empty() ? "any" : out;
+        }
+
+        // "2", "2,3", "4-7,12"
+        static bool parseCpus(const std::string& text, std::vector<int>& cpus) {
+            std::stringstream ss(text);
+            std::string range;
+            while (std::getline(ss, range, ',')) {
+                if (range.empty()) continue;
+                size_t dash = range.find('-');
+                try {
+                    int first = std::stoi(range.substr(0, dash));
+                    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                    if (first < 0 || last < first) return false;
+                    for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+                } catch (const std::exception&) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    public:
+        static void set(const std::string& name, const Placement& placement) {
+            std::lock_guard<std::mutex> lock(mtx);
+            placements[name] = placement;
+        }
+
+        // "tcp-receiver=2:fifo=50:numa;tcp-sender=3;tcp-connection=2,3" - one entry per thread name, separated by ';'.
+        static bool configure(const std::string& spec) {
+            std::stringstream entries(spec);
+            std::string entry;
+            while (std::getline(entries, entry, ';')) {
+                if (entry.empty()) continue;
+                size_t equals = entry.find('=');
+                if (equals == std::string::npos || equals == 0) {
+                    WARNING_SRC("ThreadPlacement[configure] - Expected name=cpus[:fifo=N][:numa], got '%s'", entry.c_str());
+                    return false;
+                }
+                Placement placement;
+                std::stringstream fields(entry.substr(equals + 1));
+                std::string field;
+                bool cpusField = true;
+                while (std::getline(fields, field, ':')) {
+                    bool valid = true;
+                    if (cpusField) valid = parseCpus(field, placement.cpus);
+                    else if (field == "numa") placement.numa_local = true;
+                    else if (field.rfind("fifo=", 0) == 0) {
+                        try {placement.fifo_priority = std::stoi(field.substr(5));}
+                        catch (const std::exception&) {valid = false;}
+                        valid = valid && placement.fifo_priority >= 1 && placement.fifo_priority <= 99;
+                    }
+                    else valid = false;
+                    if (!valid) {
+                        WARNING_SRC("ThreadPlacement[configure] - Invalid field '%s' in '%s'", field.c_str(), entry.c_str());
+                        return false;
+                    }
+                    cpusField = false;
+                }
+                set(entry.substr(0, equals), placement);
+            }
+            return true;
+        }
+
+        // Called by a thread on itself when it starts: names it, applies its placement and records the result.
+        static void apply(const std::string& name) {
+            Placement placement;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                auto it = placements.find(name);
+                if (it != placements.end()) placement = it->second;
+            }
+            std::ostringstream line;
+            line << name;
+#ifdef __linux__
+            pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());     // 15 characters + NUL
+            std::string problems;
+            if (!placement.cpus.empty()) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int cpu : placement.cpus) if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+                if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) problems += " affinity-failed";
+            }
+            if (placement.fifo_priority) {
+                struct sched_param param{};
+                param.sched_priority = placement.fifo_priority;
+                if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) problems += " fifo-not-permitted";
+            }
+            if (placement.numa_local && syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) != 0) problems += " mempolicy-failed";
+
+            // What the kernel actually gave the thread, not what was asked for.
+            std::vector<int> cpus;
+            cpu_set_t actual;
+            if (pthread_getaffinity_np(pthread_self(), sizeof(actual), &actual) == 0) {
+                for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) if (CPU_ISSET(cpu, &actual)) cpus.push_back(cpu);
+            }
+            int policy = SCHED_OTHER;
+            struct sched_param param{};
+            pthread_getschedparam(pthread_self(), &policy, &param);
+            unsigned cpu = 0, node = 0;
+            syscall(SYS_getcpu, &cpu, &node, nullptr);
+
+            line << " tid=" << syscall(SYS_gettid) << " cpus=" << cpuList(cpus)
+                 << " sched=" << (policy == SCHED_FIFO ? "fifo/" + std::to_string(param.sched_priority) : std::string("other"))
+                 << " numa=" << (placement.numa_local ? "local" : "default") << " on=cpu" << cpu << "/node" << node << problems;
+#else
+            line << " placement not supported on this platform";
+#endif
+            INFO_SRC("ThreadPlacement - %s", line.str().c_str());
+            std::lock_guard<std::mutex> lock(mtx);
+            layout.push_back(line.str());
+        }
+
+        // Every thread that has called apply() so far, in start order.
+        static std::string report() {
+            std::lock_guard<std::mutex> lock(mtx);
+            std::string out;
+            for (const std::string& line : layout) out += line + "\n";
+            return out;
+        }
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Clock.hpp"
+#include "Segment.hpp"
+#include "ThreadSafeQueue.hpp"
+
+using ReceiverQueue = ThreadSafeQueue<std::unique_ptr<Segment>>;
+using SenderQueue = ThreadSafeQueue<std::unique_ptr<Segment>>;
+
+// When a segment that asked for it (Segment::setSendTimestamp) actually left the host.
+struct SendTimestamp {
+    uint32_t ip{0};
+    uint16_t port{0};
+    uint32_t seq{0};
+    Clock::time_point time{};
+};
+
+// Datagram layer underneath Connection. SocketHandler is the UDP implementation (UringSocketHandler the same
+// socket driven through io_uring), SimulatedTransport plugs the same queues into the in-process NetworkSimulator.
+class Transport {
+    protected:
+        ReceiverQueue& receiverQueue;
+        SenderQueue& senderQueue;
+
+        uint16_t port;
+        uint32_t selfIP;
+
+        ThreadSafeQueue<SendTimestamp> sendTimestamps;          // filled by transports with kernel TX timestamps
+        bool segment_offload{false};                            // batch segments per peer (UDP GSO/GRO) where supported
+        Clock::duration busy_poll{Clock::duration::zero()};     // spin this long after the last packet before blocking
+        size_t receive_buffer{0};                               // kernel receive buffer: wanted before start(), granted after, 0 = default
+
+        std::vector<uint8_t> prepareOutgoing(Segment& segment);
+        std::vector<uint8_t> prepareHeader(Segment& segment);      // payload is sent from segment.payloadData() as is
+        std::unique_ptr<Segment> acceptIncoming(const std::vector<uint8_t>& bytes, uint32_t sourceIP);
+
+    public:
+        static constexpr uint8_t PROTOCOL = 6;                  // pseudo header protocol the checksums cover
+
+        Transport(
+            uint16_t port,
+            uint32_t selfIP,
+            ReceiverQueue& receiverQueue,
+            SenderQueue& senderQueue
+        );
+
+        Transport(const Transport&) = delete;
+        Transport& operator=(const Transport&) = delete;
+        virtual ~Transport() = default;
+
+        uint16_t getPort() const {return port;}
+        uint32_t getSelfIP() const {return selfIP;}
+        bool popSendTimestamp(SendTimestamp& stamp) {return sendTimestamps.tryPop(stamp);}
+        void setSegmentOffload(bool enabled) {segment_offload = enabled;}       // before start()
+        void setBusyPoll(Clock::duration spin) {busy_poll = spin;}              // before start(), zero = off
+        void setReceiveBuffer(size_t bytes) {receive_buffer = bytes;}           // before start()
+        size_t getReceiveBuffer() const {return receive_buffer;}
+
+        virtual void start() = 0;
+        virtual void stop() = 0;
+
+        // Transports without I/O threads (UringSocketHandler) do their socket work on the connection thread:
+        // poll() hands senderQueue to the kernel and moves completions into receiverQueue without blocking,
+        // wait() also blocks up to timeout for the first completion. Threaded transports return false from both.
+        virtual bool poll() {return false;}
+        virtual bool wait(Clock::duration timeout) {(void)timeout; return false;}
+
+        // Threaded transports spinning for busy poll (SocketHandler) trade segments with their I/O threads through
+        // lock-free rings instead: pushSend() takes a segment to send, false leaves it for senderQueue; popReceived()
+        // hands over one that arrived. Connection thread only.
+        virtual bool pushSend(std::unique_ptr<Segment>& segment) {(void)segment; return false;}
+        virtual bool popReceived(std::unique_ptr<Segment>& segment) {(void)segment; return false;}
+};
+
+using TransportFactory = std::function<std::unique_ptr<Transport>(uint16_t, uint32_t, ReceiverQueue&, SenderQueue&)>;
+
+#endif
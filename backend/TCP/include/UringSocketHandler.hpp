@@ -0,0 +1,56 @@
+#ifndef URINGSOCKETHANDLER_HPP
+#define URINGSOCKETHANDLER_HPP
+
+#include "SocketHandler.hpp"
+
+// SocketHandler without its two I/O threads: the socket is driven through an io_uring from the connection
+// thread (Transport::poll/wait). One multishot recvmsg stays posted on a ring of provided buffers, and
+// everything queued in senderQueue is submitted as one batch of sendmsg requests per poll, so receiving
+// costs no syscall and sending one per batch. Falls back to the threaded SocketHandler when the kernel
+// has no io_uring, no provided buffer rings (< 5.19) or no multishot recvmsg (< 6.0).
+// Segment offload only applies to receiving here (UDP_GRO); segments are not sent as GSO trains.
+class UringSocketHandler : public SocketHandler {
+    private:
+        struct Ring;                                            // raw io_uring state, defined in the .cpp
+        std::unique_ptr<Ring> ring;
+
+        static constexpr unsigned SQ_ENTRIES = 256;
+        static constexpr unsigned CQ_ENTRIES = 1024;
+        static constexpr unsigned SEND_SLOTS = 128;             // sends in flight; the rest waits in senderQueue
+        static constexpr unsigned BUFFER_COUNT = 64;            // provided receive buffers, a power of two
+        static constexpr uint16_t BUFFER_GROUP = 0;
+
+        struct SendSlot {
+            std::unique_ptr<Segment> segment;                   // kept alive until the kernel is done with it
+            Outgoing out;
+        };
+        std::vector<SendSlot> slots;
+        std::vector<uint32_t> free_slots;
+
+        bool setupRing();
+        void closeRing();
+        bool armReceive();
+        void submit(unsigned waitFor, Clock::duration timeout);
+        bool queueSends();
+        bool reap();
+        void handleReceive(int result, uint32_t flags);
+        void handleSend(uint32_t index, int result);
+
+    public:
+        UringSocketHandler(
+            uint16_t port,
+            uint32_t selfIP,
+            ReceiverQueue& receiverQueue,
+            SenderQueue& senderQueue
+        );
+        ~UringSocketHandler() override;
+
+        bool usingRing() const {return ring != nullptr;}
+
+        void start() override;
+        void stop() override;
+        bool poll() override;
+        bool wait(Clock::duration timeout) override;
+};
+
+#endif
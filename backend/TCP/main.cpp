@@ -6,6 +6,7 @@ int main(int argc, char*argv[]) {
 
     Logger::setPriority(LogLevel::TRACE);
     Logger::enableFileOutput();
+    Logger::enableAsync();
 
     INFO_SRC("main[main] - Initialized logger and enabled file output");
 
@@ -2,7 +2,11 @@
 #include "Flags.hpp"
 #include "Segment.hpp"
 #include "Logger.hpp"
+#include "Clock.hpp"
 #include "ThreadSafeQueue.hpp"
+
+#include <algorithm>
+
 Client::Client(
     uint16_t port,
     uint32_t IP,
@@ -33,8 +37,8 @@ Client::~Client() {
 }
 
 void Client::info() {
-    DEBUG_SRC("Client[IP=%u PORT=%u EXPSEQ=%u EXPACK=%u LASTACK=%u STATE=%s lastByteSent=%u totalSizeOfMessagesSent=%u isFineSent=%d]", 
-            IP, port, expected_sequence, expected_ack, last_ack, stateToStr(state).c_str(), lastByteSent, totalSizeOfMessagesSent,  static_cast<int>(isFinSent));
+    DEBUG_SRC("Client[IP=%u PORT=%u EXPSEQ=%u EXPACK=%u LASTACK=%u STATE=%s unsentData=%d totalSizeOfMessagesSent=%u isFineSent=%d]", 
+            IP, port, expected_sequence, expected_ack, last_ack, stateToStr(state).c_str(), static_cast<int>(hasUnsentStreamData()), totalSizeOfMessagesSent,  static_cast<int>(isFinSent));
 }
 
 uint16_t Client::getPort() const {return port;}
@@ -43,11 +47,14 @@ uint32_t Client::getExpectedSequence() const {return expected_sequence;}
 uint32_t Client::getExpectedAck() const {return expected_ack;}
 uint32_t Client::getLastAck() const {return last_ack;}
 uint8_t Client::getState() const {return state;}
-uint32_t Client::getLastByteSent() const {return lastByteSent;}
 bool Client::getIsFinSent() const {return isFinSent;}
-uint16_t Client::getWindowSize() const {return windowSize;}
+bool Client::getCompression() const {return compression;}
+bool Client::getFastOpen() const {return fast_open;}
+uint32_t Client::getWindowSize() const {return windowSize;}
+bool Client::getWindowScaling() const {return window_scaling;}
+uint8_t Client::getPeerWindowScale() const {return peer_window_scale;}
 std::string Client::getFileName() const {return filename;}
-std::shared_ptr<SegmentInfo> Client::getTrackerSeg() {return tracker_segment;}
+bool Client::hasTrackerSeg() const {return tracking;}
 
 void Client::setPort(uint16_t p) {port = p;}
 void Client::setIP(uint32_t ip) {IP = ip;}
@@ -56,68 +63,145 @@ void Client::setExpectedAck(uint32_t ack) {expected_ack = ack;}
 void Client::setLastAck(uint32_t ack) {last_ack = ack;}
 void Client::setState(uint8_t s) {
     DEBUG_SRC("Client [IP=%u PORT=%u] - State change: %s -> %s", IP, port, stateToStr(state).c_str(), stateToStr(s).c_str());
+    if (s == static_cast<uint8_t>(STATE::TIME_WAIT) && state != s) restartTimeWait();
     state = s;
 }
-void Client::setLastByteSent(uint32_t size) {lastByteSent = size;}
+void Client::restartTimeWait() {time_wait_start = Clock::now();}
+Clock::time_point Client::getTimeWaitStart() const {return time_wait_start;}
 void Client::setIsFinSent(bool fin) {isFinSent = fin;}
-void Client::setWindowSize(uint16_t size) {windowSize = size;}
-void Client::setTrackerSeg(std::shared_ptr<SegmentInfo> seg) {
-    tracker_segment = std::move(seg);
-    TRACE_SRC("Client[IP=%u PORT=%u] - New Tracker Seg -> SEQ=%u", IP, port, tracker_segment->getSeqNum());
+void Client::setCompression(bool enabled) {compression = enabled;}
+void Client::setFastOpen(bool enabled) {fast_open = enabled;}
+void Client::setWindowSize(uint32_t size) {windowSize = size;}
+void Client::setPeerWindow(uint16_t window) {windowSize = static_cast<uint32_t>(window) << peer_window_scale;}
+void Client::enableWindowScaling(uint8_t peerScale, uint8_t ownScale) {
+    window_scaling = true;
+    peer_window_scale = peerScale;
+    receive_window.setScale(ownScale);
+    DEBUG_SRC("Client [IP=%u PORT=%u] - Window scaling on, peer shift=%u own shift=%u", IP, port, peerScale, ownScale);
+}
+void Client::setTrackerSeg(const SegmentInfo& seg) {
+    tracker_segment = seg;
+    tracking = true;
+    TRACE_SRC("Client[IP=%u PORT=%u] - New Tracker Seg -> SEQ=%u", IP, port, tracker_segment.seq);
 }
 
 Client::TransmissionInfo& Client::getTransmissionInfo() {
     return transmission_info;
 }
 
-//BUG: IF values are too big ommit them as they will skew the calculations and caused larger delays. 
+PathMtu& Client::getPathMtu() {
+    return path_mtu;
+}
+
+Fec& Client::getFec() {
+    return fec;
+}
+
+ReceiveWindow& Client::getReceiveWindow() {
+    return receive_window;
+}
+
+double Client::baseTimeout() const {
+    if(!transmission_info.hasSample) return INITIAL_RTO;
+    double rto = transmission_info.estimatedRTT + std::max(CLOCK_GRANULARITY, K * transmission_info.deviationRTT);
+    return std::clamp(rto, MIN_RTO, MAX_RTO);
+}
+
+// RFC 6298 (2.2) / (2.3): RTTVAR is updated with the previous SRTT before SRTT itself.
 void Client::updateTransmissionInfo(double sampleRTT) {
-    if(transmission_info.estimatedRTT == 0.0) {
+    if(!transmission_info.hasSample) {
         transmission_info.estimatedRTT = sampleRTT;
         transmission_info.deviationRTT = sampleRTT / 2.0;
+        transmission_info.hasSample = true;
     } 
     else {
-        transmission_info.estimatedRTT = (1-ALPHA) * transmission_info.estimatedRTT + ALPHA * sampleRTT;
         transmission_info.deviationRTT = (1-BETA) * transmission_info.deviationRTT + BETA * std::abs(transmission_info.estimatedRTT - sampleRTT);
+        transmission_info.estimatedRTT = (1-ALPHA) * transmission_info.estimatedRTT + ALPHA * sampleRTT;
     }
 
-    transmission_info.timeout_interval = transmission_info.estimatedRTT + 4 * transmission_info.deviationRTT;
+    transmission_info.timeout_interval = baseTimeout();
     TRACE_SRC("Client[updateTransmissionInfo] - Client[%u:%u] timeout_interval=%.2f ms | estimatedRTT=%.2f ms | devRTT=%.2f ms", IP, port, transmission_info.timeout_interval, transmission_info.estimatedRTT, transmission_info.deviationRTT);
 }
 
-//FIXME: REDETERMINE THIS LOGIC ON NUMBER OF TIMEOUTS 
+// RFC 6298 (5.5): back off the timer, bounded by MAX_RTO.
 void Client::doubleTimeoutInterval() {
-    if(transmission_info.timeout_interval < 5000) {
-        transmission_info.timeout_interval = transmission_info.timeout_interval * 2.0;
-    }
+    transmission_info.timeout_interval = std::min(transmission_info.timeout_interval * 2.0, MAX_RTO);
     transmission_info.number_of_timeouts += 1;
+    timer_start = Clock::now();
+}
+
+// A new ACK ends the backoff and restarts the timer for the remaining in-flight data (5.3).
+void Client::resetBackoff() {
+    transmission_info.timeout_interval = baseTimeout();
+    transmission_info.number_of_timeouts = 0;
+    timer_start = Clock::now();
+}
+
+void Client::armPersistTimer() {
+    if(persist_deadline != Clock::time_point::max()) return;
+    double interval = std::min(baseTimeout() * static_cast<double>(1u << persist_backoff), MAX_RTO);
+    persist_deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(interval));
+    TRACE_SRC("Client[IP=%u PORT=%u] - Peer window closed (%u), probing in %.2f ms", IP, port, windowSize, interval);
+}
+
+void Client::stopPersistTimer() {
+    persist_deadline = Clock::time_point::max();
+    persist_backoff = 0;
+}
+
+// Disarmed until the probe's ACK shows whether the window is still closed.
+void Client::onWindowProbe() {
+    persist_deadline = Clock::time_point::max();
+    if(persist_backoff < 16) persist_backoff++;
+}
+
+Clock::time_point Client::getPersistDeadline() const {return persist_deadline;}
+
+Clock::time_point Client::getRetransmitDeadline() {
+    if(messagesSent.empty()) return Clock::time_point::max();
+    Clock::time_point sent = messagesSent.front().time_sent;
+    if(sent == Clock::time_point{}) return Clock::time_point::max();
+    auto rto = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(transmission_info.timeout_interval));
+    return std::max(sent, timer_start) + rto;
 }
 
-void Client::checkTrackerSegment(uint32_t seqNum) {
+void Client::checkTrackerSegment(uint32_t seqNum, Clock::time_point ackTime) {
     TRACE_SRC("Client[checkTrackerSegment] - Checking tracker segement for seqNum=%u", seqNum);
-    if(tracker_segment) {
-        TRACE_SRC("Client[checkTrackerSegment] - Checking tracker segement for seqNum=%u isTracking=%d", seqNum, tracker_segment->isTracking());
-        if(tracker_segment->getSeqNum() < seqNum && tracker_segment->isTracking()) {
-            auto now = std::chrono::steady_clock::now();
-            double sampleRTT = std::chrono::duration_cast<std::chrono::milliseconds>(now - tracker_segment->getTimeSent()).count();
-            if(sampleRTT < 1.0) {
-                sampleRTT = 1000.0;
-                TRACE_SRC("Client[checkTrackerSegment] - RTT too small, using default of 1 second");
-            }
-            else if (sampleRTT > 5000) {
-                sampleRTT = 5000;
-                TRACE_SRC("Client[checkTrackerSegment] - RTT too large, using default of 5 seconds to account for delay");
-            }
-            TRACE_SRC("Client[checkTrackerSegment] - Calculated sampleRTT=%.2f ms", sampleRTT);
+    if(tracking) {
+        TRACE_SRC("Client[checkTrackerSegment] - Checking tracker segement for seqNum=%u trackerSeq=%u", seqNum, tracker_segment.seq);
+        if(seqLess(tracker_segment.seq, seqNum)) {
+            auto now = (ackTime == Clock::time_point{}) ? Clock::now() : ackTime;
+            double sampleRTT = std::chrono::duration<double, std::milli>(now - tracker_segment.time_sent).count();
+            TRACE_SRC("Client[checkTrackerSegment] - Calculated sampleRTT=%.3f ms", sampleRTT);
             updateTransmissionInfo(sampleRTT);
-            tracker_segment = nullptr;
+            tracking = false;
         }
     } else {
         TRACE_SRC("Client[checkTrackerSegment] - No tracker segment present");
     }
 }
 
+// The transport saw the tracker leave later than it was handed over (queueing in the sender thread).
+bool Client::setTrackerSendTime(uint32_t seqNum, Clock::time_point time) {
+    if(!tracking || tracker_segment.seq != seqNum) return false;
+    TRACE_SRC("Client[setTrackerSendTime] - SEQ=%u left %.3f ms after hand off", seqNum, std::chrono::duration<double, std::milli>(time - tracker_segment.time_sent).count());
+    tracker_segment.time_sent = time;
+    return true;
+}
+
+// Karn's rule: an ACK for a retransmitted segment is ambiguous, so never sample it.
+void Client::invalidateTracker(uint32_t seqNum) {
+    if(tracking && tracker_segment.seq == seqNum) {
+        TRACE_SRC("Client[invalidateTracker] - SEQ=%u retransmitted, dropping RTT sample", seqNum);
+        tracking = false;
+    }
+}
+
 // MESSAGE BUFFER FUNCTIONS
+// A stream segment went through deliverStream when it arrived, so its payload is already counted where its
+// stream holds it (pending or unread); here it only waits for the connection sequence.
+static size_t bufferedBytes(const Segment& seg) {return seg.getStreamId() ? 0 : seg.getData().size();}
+
 bool Client::checkItemMessageBuffer(uint32_t seq) {
     bool exists = (messageBuffer.count(seq) > 0);
     if (!exists) {
@@ -132,6 +216,7 @@ bool Client::popItemMessageBuffer(uint32_t seq, std::unique_ptr<Segment>& val) {
         TRACE_SRC("Client [IP=%u PORT=%u] - Removed Packet[SEQ=%u]", it->second->getDestinationIP(), it->second->getDestPrt(), it->second->getSeqNum());
         val = std::move(it->second);   
         messageBuffer.erase(it);       
+        reassembly_bytes -= bufferedBytes(*val);
         return true;
     }
     WARNING_SRC("Client [IP=%u PORT=%u] - Packet[SEQ=%u] not found in MessageBuffer", IP, port, seq);
@@ -139,63 +224,298 @@ bool Client::popItemMessageBuffer(uint32_t seq, std::unique_ptr<Segment>& val) {
 }
 
 void Client::setItemMessageBuffer(uint32_t seq, std::unique_ptr<Segment> val) {
+    if (auto it = messageBuffer.find(seq); it != messageBuffer.end()) reassembly_bytes -= bufferedBytes(*it->second);
+    reassembly_bytes += bufferedBytes(*val);
     messageBuffer.insert_or_assign(seq, std::move(val));
     DEBUG_SRC("Client [IP=%u PORT=%u] - Received out of order Packet[SEQ=%u EXPSEQ=%u]", IP, port, seq, expected_ack);
 }
 
 // MESSAGES SENT FUNCTIONS
-void Client::pushMessage(std::shared_ptr<SegmentInfo> seg) {
-    uint16_t segSize = Segment::HEADER_SIZE + static_cast<uint16_t>(seg->getDataSize());
-    TRACE_SRC("Client [IP=%u PORT=%u] - Packet[SEQ=%u SIZE=%u] Sent and appended", IP, port, seg->getSeqNum(), segSize);
-    messagesSent.push(std::move(seg));
+void Client::pushMessage(const SegmentInfo& seg) {
+    uint32_t segSize = Segment::HEADER_SIZE + seg.data_size;
+    TRACE_SRC("Client [IP=%u PORT=%u] - Packet[SEQ=%u SIZE=%u] Sent and appended", IP, port, seg.seq, segSize);
+    messagesSent.push_back(seg);
     totalSizeOfMessagesSent += segSize;
     DEBUG_SRC("Client [IP=%u PORT=%u] - Increased Size of totalSizeOfMessagesSent\tSIZE: %u", IP, port, totalSizeOfMessagesSent);
 }
 
-bool Client::popMessage(std::shared_ptr<SegmentInfo>& seg) {
+bool Client::popMessage(SegmentInfo& seg) {
     if (messagesSent.empty()) return false;
-    uint16_t segSize = Segment::HEADER_SIZE + static_cast<uint16_t>(messagesSent.front()->getDataSize());
-    seg = std::move(messagesSent.front());
-    messagesSent.pop();
+    uint32_t segSize = Segment::HEADER_SIZE + messagesSent.front().data_size;
+    seg = messagesSent.front();
+    messagesSent.pop_front();
     totalSizeOfMessagesSent -= segSize;
     DEBUG_SRC("Client [IP=%u PORT=%u] - Packet[SEQ=%u, SIZE=%u] popped. TotalSentSize=%u", 
-        IP, port, seg->getSeqNum(), segSize, totalSizeOfMessagesSent);
+        IP, port, seg.seq, segSize, totalSizeOfMessagesSent);
+    return true;
+}
+
+// The front is about to be resent: hand out a copy and count the retransmission on the record.
+bool Client::copyFront(SegmentInfo& seg) {
+    if(messagesSent.empty()) return false;
+    SegmentInfo& front = messagesSent.front();
+    if(front.retransmits < UINT8_MAX) front.retransmits++;
+    uint32_t segSize = Segment::HEADER_SIZE + front.data_size;
+    seg = front;
+    DEBUG_SRC("Client [IP=%u PORT=%u] - Packet[SEQ=%u, SIZE=%u RETRANSMITS=%u] to be retransmitted.", 
+        IP, port, seg.seq, segSize, seg.retransmits);
     return true;
 }
 
-void Client::copyFront(std::shared_ptr<SegmentInfo>& seg) {
+// Re-cut the oldest unacknowledged segment when it no longer fits the path (PLPMTU fell back after a black hole).
+void Client::splitFront(uint16_t maxSegmentSize) {
     if(messagesSent.empty()) return;
-    uint16_t segSize = Segment::HEADER_SIZE + static_cast<uint16_t>(messagesSent.front()->getDataSize());
-    seg = messagesSent.front();
-    totalSizeOfMessagesSent += segSize;
-    DEBUG_SRC("Client [IP=%u PORT=%u] - Packet[SEQ=%u, SIZE=%u] to be retransmitted.", 
-        IP, port, seg->getSeqNum(), segSize);
+    SegmentInfo front = messagesSent.front();
+    uint32_t maxData = maxSegmentSize - Segment::HEADER_SIZE - (front.stream_id ? Segment::STREAM_OPTION_SIZE : 0);
+    if(front.data_size <= maxData) return;
+
+    SegmentInfo rest = front;
+    rest.seq += maxData;
+    rest.start += maxData;
+    rest.data_size -= maxData;
+    front.data_size = maxData;
+    messagesSent.pop_front();
+    messagesSent.push_front(rest);
+    messagesSent.push_front(front);
+    totalSizeOfMessagesSent += Segment::HEADER_SIZE;
+    DEBUG_SRC("Client [IP=%u PORT=%u] - Packet[SEQ=%u] split at %u bytes to fit SEGMENT_SIZE=%u", IP, port, front.seq, maxData, maxSegmentSize);
 }
 
-std::chrono::steady_clock::time_point Client::getMessageTimeSent() {
+Clock::time_point Client::getMessageTimeSent() {
     if(messagesSent.empty()) return {};
-    return messagesSent.front()->getTimeSent();
+    return messagesSent.front().time_sent;
+}
+
+// The server refused the data sent on our SYN (no cookie, or a stale one) and ACK'd the SYN alone. The record
+// stays as a plain SYN for checkFront and the stream is wound back so sendMessages sends the data again.
+bool Client::rewindSynData(uint32_t ackNum) {
+    if(messagesSent.empty()) return false;
+    SegmentInfo& front = messagesSent.front();
+    if(front.flag != static_cast<uint8_t>(FLAGS::SYN) || !front.data_size || ackNum != front.seq + 1) return false;
+    DEBUG_SRC("Client [IP=%u PORT=%u] - %u bytes sent on the SYN were not accepted, resending after the handshake", IP, port, front.data_size);
+    setStreamNextOffset(front.stream_id, front.start);
+    totalSizeOfMessagesSent -= front.data_size;
+    front.data_size = 0;
+    expected_sequence = front.seq + 1;
+    return true;
 }
 
 uint32_t Client::getFrontSeqNum() {
     if(messagesSent.empty()) return 0;
-    return messagesSent.front()->getSeqNum();
+    return messagesSent.front().seq;
 }
 
 bool Client::checkFront(uint32_t ackNum) {
     if (messagesSent.empty()) return false;
-    if (messagesSent.front()->getSeqNum() < ackNum) {
-        uint16_t segSize = Segment::HEADER_SIZE + static_cast<uint16_t>(messagesSent.front()->getDataSize());
+    const SegmentInfo& front = messagesSent.front();
+    if (seqLess(front.seq, ackNum)) {
+        uint32_t segSize = Segment::HEADER_SIZE + front.data_size;
         totalSizeOfMessagesSent -= segSize;
-        DEBUG_SRC("Client [IP=%u PORT=%u] - Deleting a Packet that has been sent and Ack'd\tSEQ: %u\tAckNumReceived: %u", IP, port, messagesSent.front()->getSeqNum(), ackNum);
-        messagesSent.pop();
+        DEBUG_SRC("Client [IP=%u PORT=%u] - Deleting a Packet that has been sent and Ack'd\tSEQ: %u\tAckNumReceived: %u", IP, port, front.seq, ackNum);
+        if (front.data_size) {
+            ackStreamData(front.stream_id, front.start + front.data_size);
+        }
+        messagesSent.pop_front();
+        resetBackoff();
         return true;
     } 
     else return false;
 }
 
+// STREAM FUNCTIONS
+void Client::queueStreamData(uint16_t id, std::shared_ptr<const SharedPayload> payload) {
+    if (!payload || payload->size() == 0) return;
+    SendStream& stream = sendStreams[id];
+    uint32_t size = payload->size();
+    stream.chunks.push_back(SendChunk{std::move(payload), stream.end_offset});
+    stream.end_offset += size;
+    TRACE_SRC("Client [IP=%u PORT=%u] - Stream[%u] queued %u bytes (unsent=%llu)", IP, port, id, size, static_cast<unsigned long long>(stream.end_offset - stream.next_offset));
+}
+
+bool Client::hasUnsentStreamData() const {
+    for (auto& [id, stream] : sendStreams) {
+        if (stream.next_offset < stream.end_offset) return true;
+    }
+    return false;
+}
+
+// Round robin: the first stream with unsent data after the one scheduled last, wrapping around.
+bool Client::nextSendStream(uint16_t& id) {
+    bool found = false;
+    uint16_t first = 0;
+    for (auto& [streamId, stream] : sendStreams) {
+        if (stream.next_offset == stream.end_offset) continue;
+        if (streamId > lastStreamScheduled) {
+            id = lastStreamScheduled = streamId;
+            return true;
+        }
+        if (!found) {
+            found = true;
+            first = streamId;
+        }
+    }
+    if (!found) return false;
+    id = lastStreamScheduled = first;
+    return true;
+}
+
+uint64_t Client::getStreamNextOffset(uint16_t id) const {
+    auto it = sendStreams.find(id);
+    return it == sendStreams.end() ? 0 : it->second.next_offset;
+}
+
+const Client::SendChunk* Client::findSendChunk(uint16_t id, uint64_t offset) const {
+    auto it = sendStreams.find(id);
+    if (it == sendStreams.end()) return nullptr;
+    const std::deque<SendChunk>& chunks = it->second.chunks;
+    auto chunk = std::upper_bound(chunks.begin(), chunks.end(), offset, [](uint64_t value, const SendChunk& c) {return value < c.offset;});
+    if (chunk == chunks.begin()) return nullptr;
+    --chunk;
+    if (offset >= chunk->offset + chunk->payload->size()) return nullptr;
+    return &*chunk;
+}
+
+uint64_t Client::getStreamUnsent(uint16_t id) const {
+    auto it = sendStreams.find(id);
+    if (it == sendStreams.end()) return 0;
+    return it->second.end_offset - it->second.next_offset;
+}
+
+void Client::setStreamNextOffset(uint16_t id, uint64_t offset) {
+    sendStreams[id].next_offset = offset;
+}
+
+// A range inside one payload is shared as is; a range spanning several payloads is gathered into a new one.
+bool Client::getStreamSlice(uint16_t id, uint64_t start, uint64_t end, std::shared_ptr<const SharedPayload>& payload, uint32_t& begin) const {
+    const SendChunk* chunk = findSendChunk(id, start);
+    if (chunk && end <= chunk->offset + chunk->payload->size()) {
+        payload = chunk->payload;
+        begin = static_cast<uint32_t>(start - chunk->offset);
+        return true;
+    }
+
+    std::vector<uint8_t> bytes;
+    bytes.reserve(end - start);
+    for (uint64_t offset = start; chunk && offset < end; chunk = findSendChunk(id, offset)) {
+        uint32_t from = static_cast<uint32_t>(offset - chunk->offset);
+        uint32_t to = static_cast<uint32_t>(std::min<uint64_t>(chunk->payload->size(), end - chunk->offset));
+        bytes.insert(bytes.end(), chunk->payload->data() + from, chunk->payload->data() + to);
+        offset += to - from;
+    }
+    if (bytes.size() != end - start) {
+        ERROR_SRC("Client [IP=%u PORT=%u] - Stream[%u] range [%llu, %llu) is no longer buffered", IP, port, id, static_cast<unsigned long long>(start), static_cast<unsigned long long>(end));
+        return false;
+    }
+    payload = SharedPayload::create(std::move(bytes));
+    begin = 0;
+    return true;
+}
+
+void Client::ackStreamData(uint16_t id, uint64_t endOffset) {
+    auto it = sendStreams.find(id);
+    if (it == sendStreams.end()) return;
+    SendStream& stream = it->second;
+    stream.acked_offset = std::max(stream.acked_offset, endOffset);
+
+    while (!stream.chunks.empty() && stream.chunks.front().offset + stream.chunks.front().payload->size() <= stream.acked_offset) {
+        TRACE_SRC("Client [IP=%u PORT=%u] - Stream[%u] released %u ACK'd bytes", IP, port, id, stream.chunks.front().payload->size());
+        stream.chunks.pop_front();
+    }
+}
+
+// Delivers stream data as soon as it is contiguous within its own stream, regardless of the
+// connection sequence order. Bytes that were already delivered (a retransmission or the in order
+// replay of an early segment) are dropped.
+void Client::deliverStream(uint16_t id, uint32_t wireOffset, const std::vector<uint8_t>& bytes) {
+    ReceiveStream& stream = receiveStreams[id];
+    uint64_t offset = unwrapOffset(wireOffset, stream.next_offset);
+    uint64_t end = offset + bytes.size();
+    if (end <= stream.next_offset) return;
+
+    if (offset > stream.next_offset) {
+        if (stream.pending.emplace(offset, bytes).second) reassembly_bytes += bytes.size();
+        TRACE_SRC("Client [IP=%u PORT=%u] - Stream[%u] holding offset=%llu (expected %llu)", IP, port, id, static_cast<unsigned long long>(offset), static_cast<unsigned long long>(stream.next_offset));
+        return;
+    }
+
+    onStreamData(id, std::vector<uint8_t>(bytes.begin() + (stream.next_offset - offset), bytes.end()));
+    stream.next_offset = end;
+
+    auto it = stream.pending.begin();
+    while (it != stream.pending.end() && it->first <= stream.next_offset) {
+        uint64_t pendingEnd = it->first + it->second.size();
+        if (pendingEnd > stream.next_offset) {
+            onStreamData(id, std::vector<uint8_t>(it->second.begin() + (stream.next_offset - it->first), it->second.end()));
+            stream.next_offset = pendingEnd;
+        }
+        reassembly_bytes -= it->second.size();
+        it = stream.pending.erase(it);
+    }
+}
+
+void Client::onStreamData(uint16_t id, std::vector<uint8_t> bytes) {
+    receive_window.onDelivered(bytes.size());
+    if (id != MESSAGE_STREAM) {
+        streamData.push(std::make_pair(id, std::move(bytes)));
+        return;
+    }
+    if (message_stream_broken) return;
+    frameBuffer.insert(frameBuffer.end(), bytes.begin(), bytes.end());
+    extractFrames();
+}
+
+// MESSAGE FRAMING: [length:32 big endian][message]
+std::vector<uint8_t> Client::frameMessage(const std::vector<uint8_t>& message) {
+    std::vector<uint8_t> frame;
+    frame.reserve(FRAME_HEADER_SIZE + message.size());
+    uint32_t size = static_cast<uint32_t>(message.size());
+    for (int i = FRAME_HEADER_SIZE - 1; i >= 0; --i) frame.push_back((size >> (8 * i)) & 0xFF);
+    frame.insert(frame.end(), message.begin(), message.end());
+    return frame;
+}
+
+void Client::extractFrames() {
+    size_t offset = 0;
+    while (frameBuffer.size() - offset >= FRAME_HEADER_SIZE) {
+        uint32_t size = 0;
+        for (uint32_t i = 0; i < FRAME_HEADER_SIZE; i++) size = (size << 8) | frameBuffer[offset + i];
+        if (size > MAX_MESSAGE_SIZE) {
+            ERROR_SRC("Client [IP=%u PORT=%u] - Message length %u exceeds MAX_MESSAGE_SIZE, dropping the rest of the message stream", IP, port, size);
+            message_stream_broken = true;
+            frameBuffer.clear();
+            frameBuffer.shrink_to_fit();
+            return;
+        }
+        if (frameBuffer.size() - offset < FRAME_HEADER_SIZE + size) break;
+
+        auto begin = frameBuffer.begin() + offset + FRAME_HEADER_SIZE;
+        receivedMessages.emplace(begin, begin + size);
+        offset += FRAME_HEADER_SIZE + size;
+        TRACE_SRC("Client [IP=%u PORT=%u] - Received message SIZE=%u", IP, port, size);
+    }
+    frameBuffer.erase(frameBuffer.begin(), frameBuffer.begin() + offset);
+}
+
+bool Client::isMessageStreamBroken() const {return message_stream_broken;}
+
+bool Client::popReceivedMessage(std::vector<uint8_t>& message) {
+    if (receivedMessages.empty()) return false;
+    message = std::move(receivedMessages.front());
+    receivedMessages.pop();
+    return true;
+}
+
+// A partial message in frameBuffer is not counted: the application cannot read it, so it would hold the
+// window shut on any message larger than the buffer.
+size_t Client::unreadBytes() const {
+    return receivedData.bytes() + streamData.bytes();
+}
+
+size_t Client::reassemblyBytes() const {return reassembly_bytes;}
+void Client::onDataDelivered(size_t bytes) {receive_window.onDelivered(bytes);}
+
 bool Client::hasMessages() const { return !messagesSent.empty();}
-uint16_t Client::sizeMessageSent() const {return totalSizeOfMessagesSent;}
+uint32_t Client::sizeMessageSent() const {return totalSizeOfMessagesSent;}
 size_t Client::numMessageSentAvailable() const {return messagesSent.size();}
 
 
@@ -1,5 +1,8 @@
 #include "Connection.hpp"
 #include "Logger.hpp"
+#include "Clock.hpp"
+#include "Lz4.hpp"
+#include "ThreadPlacement.hpp"
 
 
 // TODO: FUNCTION TO CREATE NEW CLIENT CONNECTIONS 
@@ -52,44 +55,113 @@ Connection::Connection (
 }
 
 
+Connection::~Connection() {
+    // Abort path for a connection that was never disconnected gracefully.
+    running = false;
+    if(communicationThread.joinable()) communicationThread.join();
+    if(transport) transport->stop();
+}
+
 void Connection::connect() {
+    connect([this](uint16_t port, uint32_t ip, ReceiverQueue& rq, SenderQueue& sq) -> std::unique_ptr<Transport> {
+        if (io_uring) return std::make_unique<UringSocketHandler>(port, ip, rq, sq);
+        return std::make_unique<SocketHandler>(port, ip, rq, sq);
+    });
+}
+
+void Connection::connect(const TransportFactory& factory, bool threaded) {
     running = true;
 
-    INFO_SRC("Connection[connect] - Attempting to initialize SocketHandler [IP:%u PORT:%u]", sourceIP, source_port);
+    INFO_SRC("Connection[connect] - Attempting to initialize Transport [IP:%u PORT:%u]", sourceIP, source_port);
     //TODO: CHANGE THE IP TYPE TO BE STR CONST CHAR* AND CONVERT IN SOCKET HANDLER
-    socketHandler = std::make_unique<SocketHandler>(source_port, sourceIP, receiverQueue, senderQueue, sendBuffer);
-    socketHandler->start();
+    transport = factory(source_port, sourceIP, receiverQueue, senderQueue);
+    transport->setSegmentOffload(segment_offload);
+    transport->setBusyPoll(busy_poll);
+    // Room for the per datagram overhead the kernel charges against the buffer, then never advertise more than it holds.
+    transport->setReceiveBuffer(2 * static_cast<size_t>(receive_buffer_max));
+    transport->start();
+    if (transport->getReceiveBuffer() && transport->getReceiveBuffer() / 2 < receive_buffer_max) {
+        WARNING_SRC("Connection[connect] - Kernel receive buffer is %zu bytes, receive window limited to %zu", transport->getReceiveBuffer(), transport->getReceiveBuffer() / 2);
+        receive_buffer_max = static_cast<uint32_t>(std::max<size_t>(transport->getReceiveBuffer() / 2, window_size));
+    }
 
     if (destination_port != 0 && !destination_ip_str.empty()) {
         INFO_SRC("Connection[connect] - Attempting to create target client [IP:%u PORT:%u]", destinationIP, destination_port);
-        clients.try_emplace(destination_port, destination_port, destinationIP, 0, 0, 0, static_cast<uint8_t>(STATE::NONE));
+        if (auto [it, inserted] = clients.try_emplace(destination_port, destination_port, destinationIP, 0, 0, 0, static_cast<uint8_t>(STATE::NONE)); inserted) initClient(it->second);
     }
 
-    communicationThread = std::thread(&Connection::communicate, this);
-    
-    INFO_SRC("Connection[connect] - Communication Thread Called");
+    if (threaded) {
+        communicationThread = std::thread(&Connection::communicate, this);
+        INFO_SRC("Connection[connect] - Communication Thread Called");
+    } else {
+        openTarget();
+        INFO_SRC("Connection[connect] - Manual mode, caller drives step()");
+    }
+}
+
+// A busy polling transport takes the segment straight onto its sender ring; otherwise it goes through senderQueue.
+void Connection::queueSegment(std::unique_ptr<Segment> seg) {
+    if (!transport || !transport->pushSend(seg)) senderQueue.push(std::move(seg));
 }
 
-void Connection::createMessage(uint16_t srcPort, uint16_t dstPrt, uint32_t seqNum, uint32_t ackNum, uint8_t flag, uint16_t window, uint16_t urgentPtr, uint32_t dstIP, uint8_t state, uint32_t start, uint32_t end) {
+void Connection::createMessage(uint16_t srcPort, uint16_t dstPrt, uint32_t seqNum, uint32_t ackNum, uint8_t flag, uint16_t urgentPtr, uint32_t dstIP, uint8_t state, uint64_t start, uint64_t end, uint16_t streamId) {
     if (auto clientIt = clients.find(dstPrt); clientIt != clients.end()) {
         Client& client = clientIt->second;
         DEBUG_SRC("Connection[createMessage] - New Packet Created To Send");
 
-        std::function<void()> func;
+        bool timed = false;
         if (flag == static_cast<uint8_t>(FLAGS::SYN) || flag == createFlag(FLAGS::SYN, FLAGS::ACK) || flag == static_cast<uint8_t>(FLAGS::FIN) || flag == createFlag(FLAGS::FIN, FLAGS::ACK) || (flag == static_cast<uint8_t>(FLAGS::ACK) && start >= 0 && end > 0)) {
-            std::shared_ptr trackerSeg = std::make_shared<SegmentInfo>(seqNum, flag,  start, end-start, false);
-            if(!client.getTrackerSeg()) {
-                trackerSeg->setTracking(true);
+            // Stamped on hand off to the transport, the way TCP stamps a segment when it passes it to IP.
+            // The RTT tracker also asks the transport for the time it really left (kernel TX stamp).
+            SegmentInfo trackerSeg{start, Clock::now(), seqNum, static_cast<uint32_t>(end - start), streamId, flag, 0};
+            if(!client.hasTrackerSeg()) {
                 client.setTrackerSeg(trackerSeg);
+                timed = true;
             }
             if(client.getFrontSeqNum() != seqNum) {
                 client.pushMessage(trackerSeg);
             }
-            func = trackerSeg->LastTimeMessageSent(trackerSeg);
         }
 
-        std::unique_ptr<Segment> seg = std::make_unique<Segment>(srcPort, dstPrt, seqNum, ackNum, flag, window, urgentPtr, dstIP, start, end);
-        senderQueue.push(std::pair<std::unique_ptr<Segment>, std::function<void()>>(std::move(seg), func));
+        stats.segments_sent++;
+        if (end > start) {
+            stats.data_segments_sent++;
+            stats.data_bytes_sent += end - start;
+        }
+
+        bool syn = flag == static_cast<uint8_t>(FLAGS::SYN) || flag == createFlag(FLAGS::SYN, FLAGS::ACK);
+        std::unique_ptr<Segment> seg = std::make_unique<Segment>(srcPort, dstPrt, seqNum, ackNum, flag, advertisedWindow(client, syn), urgentPtr, dstIP, start, end);
+        seg->setStream(streamId, static_cast<uint32_t>(start));             // the wire carries the low 32 bits
+        seg->setSendTimestamp(timed);
+        std::shared_ptr<const SharedPayload> payload;
+        uint32_t begin = 0;
+        if (end > start && client.getStreamSlice(streamId, start, end, payload, begin)) {
+            seg->setSharedPayload(std::move(payload), begin, end - start);
+            if (client.getCompression() && seg->compressPayload()) {
+                stats.compressed_segments++;
+                stats.compression_bytes_saved += (end - start) - seg->payloadSize();
+            }
+        }
+        // SYN offers compression; the SYN_ACK accepts only what the SYN offered.
+        if (compression && (flag == static_cast<uint8_t>(FLAGS::SYN) || (flag == createFlag(FLAGS::SYN, FLAGS::ACK) && client.getCompression()))) {
+            seg->setCompressionOffer(Lz4::CODEC_ID);
+        }
+        // Window scaling is the same, and once agreed on is only used after the handshake (RFC 7323 2.2).
+        if (window_scaling && (flag == static_cast<uint8_t>(FLAGS::SYN) || (flag == createFlag(FLAGS::SYN, FLAGS::ACK) && client.getWindowScaling()))) {
+            seg->setWindowScale(ReceiveWindow::scaleFor(receive_buffer_max));
+        }
+        // FEC the same way; a receiver that agreed keeps data segments for parity from the first one on.
+        if (fec_group_size && (flag == static_cast<uint8_t>(FLAGS::SYN) || (flag == createFlag(FLAGS::SYN, FLAGS::ACK) && client.getFec().isEnabled()))) {
+            seg->setFecOffer(fec_group_size);
+        }
+        // A SYN asks for a cookie or presents the cached one; the SYN_ACK hands one to a client that asked.
+        if (fast_open && flag == static_cast<uint8_t>(FLAGS::SYN)) {
+            seg->setFastOpen(fast_open_cookies.cachedCookie(client.getIP(), client.getPort()));
+        }
+        else if (fast_open && flag == createFlag(FLAGS::SYN, FLAGS::ACK) && client.getFastOpen()) {
+            seg->setFastOpen(fast_open_cookies.cookieFor(client.getIP()));
+        }
+        queueSegment(std::move(seg));
         if (client.getState() != state) client.setState(state);
         if (client.getExpectedAck() != ackNum) client.setExpectedAck(ackNum);
     } else {
@@ -100,27 +172,33 @@ void Connection::createMessage(uint16_t srcPort, uint16_t dstPrt, uint32_t seqNu
 void Connection::sendMessages(uint16_t port, size_t dataWritten) {
     if(auto clientIt = clients.find(port); clientIt != clients.end()) {
         Client& client = clientIt->second;
-        if(client.getLastByteSent() == sendBuffer.size()) {
-            if(dataWritten) createMessage(source_port, client.getPort(), client.getExpectedSequence(), client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), window_size, urgent_pointer, client.getIP(), client.getState(), 0, 0);
+        if(!client.hasUnsentStreamData()) {
+            if(dataWritten) createMessage(source_port, client.getPort(), client.getExpectedSequence(), client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), urgent_pointer, client.getIP(), client.getState(), 0, 0);
             return;
         }
         INFO_SRC("Connection[sendMessages] - Checking the buffer size and created new packets if possible");
         
-        uint16_t sizeMessagesSent = client.sizeMessageSent();
+        uint32_t sizeMessagesSent = client.sizeMessageSent();
         if (sizeMessagesSent >= client.getWindowSize()) {
             WARNING_SRC("Connection[sendMessages] - Client[IP:PORT %u:%u] messageSentSize=%u > windowSize=%u", client.getIP(), port, sizeMessagesSent, client.getWindowSize());
-            if(dataWritten) createMessage(source_port, client.getPort(), client.getExpectedSequence(), client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), window_size, urgent_pointer, client.getIP(), client.getState(), 0, 0);
+            if(!client.hasMessages()) client.armPersistTimer();
+            if(dataWritten) createMessage(source_port, client.getPort(), client.getExpectedSequence(), client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), urgent_pointer, client.getIP(), client.getState(), 0, 0);
             return;
         }
 
-        uint16_t bufferAvailable = client.getWindowSize() - sizeMessagesSent;
+        uint32_t bufferAvailable = client.getWindowSize() - sizeMessagesSent;
         bool sentData = false;
 
-        while(bufferAvailable > Segment::HEADER_SIZE && client.getLastByteSent() < sendBuffer.size()) {
+        uint16_t streamId = 0;
+        while(bufferAvailable > Segment::HEADER_SIZE + Segment::STREAM_OPTION_SIZE && client.nextSendStream(streamId)) {
 
-            uint32_t start = client.getLastByteSent();
-            uint16_t maxData = std::min<uint16_t>(MAX_DATA_SIZE, bufferAvailable-Segment::HEADER_SIZE);
-            uint32_t end = std::min<uint32_t>(start + maxData, sendBuffer.size());
+            // One segment per stream per turn so a bulk stream cannot starve the others.
+            uint16_t optionSize = streamId ? Segment::STREAM_OPTION_SIZE : 0;
+            uint64_t start = client.getStreamNextOffset(streamId);
+            // With FEC on, the group's parity segment (option + prefix + longest payload) has to fit the path as well.
+            uint16_t pathOverhead = client.getFec().isEnabled() ? Fec::PARITY_OVERHEAD : optionSize;
+            uint16_t maxData = static_cast<uint16_t>(std::min<uint32_t>(client.getPathMtu().getPlpmtu() - Segment::HEADER_SIZE - pathOverhead, bufferAvailable - Segment::HEADER_SIZE - optionSize));
+            uint64_t end = start + std::min<uint64_t>(maxData, client.getStreamUnsent(streamId));
 
             createMessage(
                 source_port, 
@@ -128,37 +206,69 @@ void Connection::sendMessages(uint16_t port, size_t dataWritten) {
                 client.getExpectedSequence(), 
                 client.getExpectedAck(), 
                 static_cast<uint8_t>(FLAGS::ACK), 
-                window_size, urgent_pointer, 
+                urgent_pointer, 
                 client.getIP(), 
                 client.getState(), 
                 start, 
-                end
+                end,
+                streamId
             );
 
-            
-            client.setLastByteSent(end);
+            client.setStreamNextOffset(streamId, end);
+            if(client.getFec().isEnabled() && end > start) protectSegment(client, client.getExpectedSequence(), streamId, start, end);
 
             uint16_t payload = static_cast<uint16_t>(end-start);
             client.setExpectedSequence(client.getExpectedSequence()+payload);
-            bufferAvailable -= static_cast<uint16_t>(payload + Segment::HEADER_SIZE);
+            bufferAvailable -= payload + Segment::HEADER_SIZE;
 
             sentData = true;
             
-            TRACE_SRC("Connection[messageHandler] - bytesSent=%u bufferSizeAvailable=%u", end, bufferAvailable); 
+            TRACE_SRC("Connection[messageHandler] - stream=%u bytesSent=%llu bufferSizeAvailable=%u", streamId, static_cast<unsigned long long>(end), bufferAvailable); 
 
         }
 
-        if(client.getLastByteSent() == sendBuffer.size()) {
-            DEBUG_SRC("Connection[sendMessages] - Packets containing all the sendBuffer generated lastByteSent=%u sendBuffer.size=%u", client.getLastByteSent(), sendBuffer.size());
+        if(!client.hasUnsentStreamData()) {
+            DEBUG_SRC("Connection[sendMessages] - Packets containing all queued data generated for Client[IP:%u PORT:%u]", client.getIP(), port);
+            // Nothing more to fill the group with: protect the tail now, where a loss costs the most.
+            if(client.getFec().getGroupCount()) sendParity(client);
         }
 
+        // A window too small for any segment with nothing in flight: only a probe will bring the next update.
+        if(sentData) client.stopPersistTimer();
+        else if(!client.hasMessages()) client.armPersistTimer();
+
         if(!sentData && dataWritten) {
-            createMessage(source_port, client.getPort(), client.getExpectedSequence(), client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), window_size, urgent_pointer, client.getIP(), client.getState(), 0, 0);
+            createMessage(source_port, client.getPort(), client.getExpectedSequence(), client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), urgent_pointer, client.getIP(), client.getState(), 0, 0);
         }
         
     } 
 }
 
+size_t Connection::deliverPayload(Client& client, const Segment& seg) {
+    if (seg.getStreamId()) {
+        deliverStream(client, seg);
+        return seg.getData().size();
+    }
+    client.receivedData.push(seg.getData());
+    client.onDataDelivered(seg.getData().size());
+    return client.writeFile(seg.getData());
+}
+
+void Connection::deliverStream(Client& client, const Segment& seg) {
+    client.deliverStream(seg.getStreamId(), seg.getStreamOffset(), seg.getData());
+    if (seg.getStreamId() != Client::MESSAGE_STREAM) return;
+
+    std::vector<uint8_t> message;
+    while (client.popReceivedMessage(message)) {
+        {
+            // Counted before it is queued, so receiveMessage() never takes off bytes not added yet.
+            std::lock_guard<std::mutex> lock(unreadMessageMtx);
+            unreadMessageBytes[client.getPort()] += message.size();
+        }
+        messageQueue.push(std::make_pair(client.getPort(), std::move(message)));
+    }
+}
+
 void Connection::messageHandler(std::unique_ptr<Segment> seg, size_t dataWritten) {
     if (auto clientIt = clients.find(seg->getSrcPrt()); clientIt != clients.end()) {
         Client& client = clientIt->second;
@@ -167,16 +277,17 @@ void Connection::messageHandler(std::unique_ptr<Segment> seg, size_t dataWritten
         if(client.hasMessages()) while(client.checkFront(seg->getAckNum()));
 
         client.setLastAck(seg->getAckNum());
-        client.setWindowSize(seg->getWindowSize());
+        client.setPeerWindow(seg->getWindowSize());
 
-        if (seg->getSeqNum() > client.getExpectedAck()) {
-            client.setItemMessageBuffer(seg->getSeqNum(), std::move(seg));
+        if (seqGreater(seg->getSeqNum(), client.getExpectedAck())) {
+            uint32_t seqNum = seg->getSeqNum();
+            client.setItemMessageBuffer(seqNum, std::move(seg));
         }
         else {
 
             sendMessages(client.getPort(), dataWritten);
             if (seg->getFlags() == static_cast<uint8_t>(FLAGS::FIN)) receiverQueue.push(std::move(seg)); // out of order FIN and we push it back to receive queue so then we can run logic as if it just arrived
-            if (!client.getIsFinSent() && client.getLastByteSent() == sendBuffer.size()) {
+            if (!client.getIsFinSent() && !client.hasUnsentStreamData()) {
                 if(timeToClose || client.getState() == static_cast<uint8_t>(STATE::CLOSING)) {
                     DEBUG_SRC("Connection[messageHandler] - Sent all data to client[IP:%u PORT:%u], creating FIN", client.getIP(), client.getPort());
                     createMessage(source_port, 
@@ -184,7 +295,7 @@ void Connection::messageHandler(std::unique_ptr<Segment> seg, size_t dataWritten
                                 client.getExpectedSequence(), 
                                 client.getExpectedAck(), 
                                 static_cast<uint8_t>(FLAGS::FIN), 
-                                window_size, urgent_pointer, 
+                                urgent_pointer, 
                                 client.getIP(), 
                                 (client.getState() == static_cast<uint8_t>(STATE::CLOSING) ? static_cast<uint8_t>(STATE::LAST_ACK) : static_cast<uint8_t>(STATE::FIN_WAIT_1)),
                                 0, 0
@@ -206,22 +317,24 @@ void Connection::resendMessages(uint16_t port) {
     if(auto clientIt = clients.find(port); clientIt != clients.end()) {
         Client& client = clientIt->second;
         if(client.hasMessages()) {
-            std::shared_ptr<SegmentInfo> segToResend;
-            client.copyFront(segToResend);
-            if(segToResend) {
+            SegmentInfo segToResend;
+            client.splitFront(client.getPathMtu().getPlpmtu());
+            if(client.copyFront(segToResend)) {
+                stats.retransmissions++;
                 createMessage(
                     source_port,
                     client.getPort(),
-                    segToResend->getSeqNum(),
+                    segToResend.seq,
                     client.getExpectedAck(),
-                    segToResend->getFlag(),
-                    client.getWindowSize(),
+                    segToResend.flag,
                     urgent_pointer,
                     client.getIP(),
                     client.getState(),
-                    segToResend->getStart(),
-                    (segToResend->getStart()+segToResend->getDataSize())
+                    segToResend.start,
+                    (segToResend.start + segToResend.data_size),
+                    segToResend.stream_id
                 );
+                client.invalidateTracker(segToResend.seq);
             }
         }
     } else {
@@ -235,24 +348,26 @@ void Connection::messageResendCheck() {
     for(auto& [port, client] : clients) {
         if(client.getState() == static_cast<uint8_t>(STATE::CLOSED)) clientsToRemove.push_back(port);
         else {
-            if(client.hasMessages() && client.getMessageTimeSent() != std::chrono::steady_clock::time_point{}) {
-                auto now = std::chrono::steady_clock::now();
-                double timeDiff = std::chrono::duration_cast<std::chrono::milliseconds>(now - client.getMessageTimeSent()).count();
-                if (timeDiff > client.getTransmissionInfo().timeout_interval) { 
-                    // std::cout << "TimeDiff: " << timeDiff << std::endl;
-                    // std::cout << "Transmission Timeout inverval 1000x: " << client.getTransmissionInfo().timeout_interval << std::endl;
-                    resendMessages(client.getPort());
-                    client.doubleTimeoutInterval();
-                    //TODO: IMPLEMENT A FEATURE THAT WILL STOP RESEND ATTEMPTS AFTER n amount of attempts
-                    TRACE_SRC("Connection[messageResendCheck] - Timeout Reach -> resending small SEQ=%u and 2x TIMEOUT=%d", client.getLastAck(), client.getTransmissionInfo().timeout_interval);
-                    //TODO: Implement a breakdown feature if the timeout has been doubled n amount of time that this connection should be destroyed.
-                    if(client.getTransmissionInfo().number_of_timeouts > 10) {
-                        clientsToRemove.push_back(port);
-                        INFO_SRC("Connection[messageResendCheck] - Number of Timeouts > 5 -> deleting CLIENT");
-                    }
+            if(client.hasMessages() && Clock::now() >= client.getRetransmitDeadline()) {
+                if(client.getTransmissionInfo().number_of_timeouts + 1 >= PathMtu::MAX_PROBES && client.getPathMtu().getPlpmtu() > PathMtu::BASE_PLPMTU) {
+                    client.getPathMtu().onBlackHole(Clock::now());
                 }
+                resendMessages(client.getPort());
+                client.doubleTimeoutInterval();
+                //TODO: IMPLEMENT A FEATURE THAT WILL STOP RESEND ATTEMPTS AFTER n amount of attempts
+                TRACE_SRC("Connection[messageResendCheck] - Timeout Reach -> resending small SEQ=%u and 2x TIMEOUT=%.2f", client.getLastAck(), client.getTransmissionInfo().timeout_interval);
+                //TODO: Implement a breakdown feature if the timeout has been doubled n amount of time that this connection should be destroyed.
+                if(client.getTransmissionInfo().number_of_timeouts > 10) {
+                    clientsToRemove.push_back(port);
+                    INFO_SRC("Connection[messageResendCheck] - Number of Timeouts > 10 -> deleting CLIENT");
+                }
+            }
+            if(Clock::now() >= client.getPersistDeadline()) sendWindowProbe(client);
+            if(client.getState() == static_cast<uint8_t>(STATE::ESTABLISHED) && client.getReceiveWindow().updateDue(unreadBytes(client), client.reassemblyBytes(), client.getPathMtu().getPlpmtu())) {
+                sendWindowUpdate(client);
             }
             //TODO: check if we should go into an IDLE STATE
+            probePathMtu(client);
         }
     }
 
@@ -261,346 +376,658 @@ void Connection::messageResendCheck() {
             clients.erase(port);
         }
     }
-    
-    sleep(3); //FIXME: REMOVE THIS BAD BOY
+}
+
+void Connection::initClient(Client& client) {
+    client.getReceiveWindow().configure(window_size, receive_buffer_max, window_autotune);
+}
+
+// What the application has not read from this client, its messages waiting in messageQueue included.
+size_t Connection::unreadBytes(const Client& client) const {
+    size_t messages = 0;
+    {
+        std::lock_guard<std::mutex> lock(unreadMessageMtx);
+        auto it = unreadMessageBytes.find(client.getPort());
+        if (it != unreadMessageBytes.end()) messages = it->second;
+    }
+    return client.unreadBytes() + messages;
+}
+
+uint16_t Connection::advertisedWindow(Client& client, bool syn) {
+    const auto& info = client.getTransmissionInfo();
+    auto rtt = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(info.hasSample ? info.estimatedRTT : info.timeout_interval));
+    return client.getReceiveWindow().advertise(unreadBytes(client), client.reassemblyBytes(), Clock::now(), rtt, syn);
+}
+
+// Zero window probe: one byte of new data sent past the peer's closed window. It is retransmitted like any
+// other segment, and its ACK carries the window that decides whether to send more or probe again later.
+void Connection::sendWindowProbe(Client& client) {
+    uint16_t streamId = 0;
+    if(!client.hasUnsentStreamData() || client.hasMessages() || !client.nextSendStream(streamId)) {
+        client.stopPersistTimer();
+        return;
+    }
+    uint64_t start = client.getStreamNextOffset(streamId);
+    createMessage(source_port, client.getPort(), client.getExpectedSequence(), client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), urgent_pointer, client.getIP(), client.getState(), start, start + 1, streamId);
+    client.setStreamNextOffset(streamId, start + 1);
+    client.setExpectedSequence(client.getExpectedSequence() + 1);
+    client.onWindowProbe();
+    stats.window_probes++;
+    DEBUG_SRC("Connection[sendWindowProbe] - Client[IP=%u PORT=%u] window=%u, probing with stream=%u offset=%llu", client.getIP(), client.getPort(), client.getWindowSize(), streamId, static_cast<unsigned long long>(start));
+}
+
+void Connection::sendWindowUpdate(Client& client) {
+    createMessage(source_port, client.getPort(), client.getExpectedSequence(), client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), urgent_pointer, client.getIP(), client.getState(), 0, 0);
+    stats.window_updates++;
+    TRACE_SRC("Connection[sendWindowUpdate] - Client[IP=%u PORT=%u] window reopened to %u", client.getIP(), client.getPort(), client.getReceiveWindow().getAdvertised());
+}
+
+// DPLPMTUD (RFC 8899): padding only probes, never larger than the peer's window could use. They carry an
+// already ACK'd sequence number, so a peer that does not know the PROBE option drops them as duplicates.
+void Connection::probePathMtu(Client& client) {
+    if(client.getState() != static_cast<uint8_t>(STATE::ESTABLISHED)) return;
+    Clock::time_point now = Clock::now();
+    uint16_t size = client.getPathMtu().probeToSend(now, static_cast<uint16_t>(std::min<uint32_t>(client.getWindowSize(), Segment::MAX_SEGMENT_SIZE)));
+    if(!size) return;
+
+    std::vector<uint8_t> padding(size - Segment::HEADER_SIZE - Segment::PROBE_OPTION_SIZE);
+    std::unique_ptr<Segment> probe = std::make_unique<Segment>(source_port, client.getPort(), client.getLastAck() - 1, client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), advertisedWindow(client), urgent_pointer, client.getIP(), std::move(padding));
+    probe->setProbe(Segment::OPTION_PROBE, size);
+    queueSegment(std::move(probe));
+
+    auto timeout = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(client.getTransmissionInfo().timeout_interval));
+    client.getPathMtu().onProbeSent(now, timeout);
+    stats.mtu_probes_sent++;
+    TRACE_SRC("Connection[probePathMtu] - Client[IP=%u PORT=%u] probing SIZE=%u (PLPMTU=%u)", client.getIP(), client.getPort(), size, client.getPathMtu().getPlpmtu());
+}
+
+// Probes and their answers live outside the sequence space and never reach the state machine.
+void Connection::handleProbe(std::unique_ptr<Segment> seg) {
+    auto clientIt = clients.find(seg->getSrcPrt());
+    if(clientIt == clients.end()) {
+        WARNING_SRC("Connection[handleProbe] - Probe from unknown client [IP:%u PORT:%u]", seg->getDestinationIP(), seg->getSrcPrt());
+        return;
+    }
+    Client& client = clientIt->second;
+
+    if(seg->getProbeOption() == Segment::OPTION_PROBE_ACK) {
+        client.getPathMtu().onProbeAck(seg->getProbeSize(), Clock::now());
+        return;
+    }
+
+    TRACE_SRC("Connection[handleProbe] - Client[IP=%u PORT=%u] probe SIZE=%u arrived, answering", client.getIP(), client.getPort(), seg->getProbeSize());
+    std::unique_ptr<Segment> reply = std::make_unique<Segment>(source_port, client.getPort(), client.getLastAck() - 1, client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), advertisedWindow(client), urgent_pointer, client.getIP(), 0, 0);
+    reply->setProbe(Segment::OPTION_PROBE_ACK, seg->getProbeSize());
+    queueSegment(std::move(reply));
+}
+
+// Feeds a new data segment (never a retransmission) into the client's current parity group.
+void Connection::protectSegment(Client& client, uint32_t seqNum, uint16_t streamId, uint64_t start, uint64_t end) {
+    std::shared_ptr<const SharedPayload> payload;
+    uint32_t begin = 0;
+    if(!client.getStreamSlice(streamId, start, end, payload, begin)) return;
+    if(client.getFec().add(seqNum, streamId, static_cast<uint32_t>(start), payload->data() + begin, static_cast<uint16_t>(end - start)) >= fec_group_size) {
+        sendParity(client);
+    }
+}
+
+// Like probes, parity carries an already ACK'd sequence number and is not tracked for retransmission.
+void Connection::sendParity(Client& client) {
+    Fec::Parity parity = client.getFec().takeParity();
+    std::unique_ptr<Segment> seg = std::make_unique<Segment>(source_port, client.getPort(), client.getLastAck() - 1, client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), advertisedWindow(client), urgent_pointer, client.getIP(), std::move(parity.bytes));
+    seg->setParity(parity.first, parity.end, parity.count);
+    queueSegment(std::move(seg));
+    stats.fec_parity_sent++;
+    TRACE_SRC("Connection[sendParity] - Client[IP=%u PORT=%u] parity for %u segments [SEQ %u-%u)", client.getIP(), client.getPort(), parity.count, parity.first, parity.end);
+}
+
+// A rebuilt segment goes through handleSegment() exactly as if it had arrived, ACK'ing what we already saw
+// from the peer so it cannot move our own send window.
+void Connection::handleParity(std::unique_ptr<Segment> seg) {
+    auto clientIt = clients.find(seg->getSrcPrt());
+    if(clientIt == clients.end()) {
+        WARNING_SRC("Connection[handleParity] - Parity from unknown client [IP:%u PORT:%u]", seg->getDestinationIP(), seg->getSrcPrt());
+        return;
+    }
+    Client& client = clientIt->second;
+
+    Fec::Recovered recovered;
+    if(!client.getFec().onParity(*seg, recovered) || seqLess(recovered.seq, client.getExpectedAck())) return;
+
+    stats.fec_recovered++;
+    DEBUG_SRC("Connection[handleParity] - Client[IP=%u PORT=%u] rebuilt SEQ=%u SIZE=%zu from parity", client.getIP(), client.getPort(), recovered.seq, recovered.data.size());
+    uint16_t window = static_cast<uint16_t>(std::min(client.getWindowSize() >> client.getPeerWindowScale(), ReceiveWindow::MAX_WINDOW));
+    std::unique_ptr<Segment> rebuilt = std::make_unique<Segment>(client.getPort(), source_port, recovered.seq, client.getLastAck(), static_cast<uint8_t>(FLAGS::ACK), window, 0, client.getIP(), std::move(recovered.data));
+    rebuilt->setStream(recovered.stream_id, recovered.stream_offset);
+    handleSegment(std::move(rebuilt));
 }
 
 void Connection::addClient(uint16_t port, uint32_t ip) {
-    INFO_SRC("Connection[addClient] - Adding Client by sending SYN [IP=%u PORT=%u]", ip, port);
-    clients.try_emplace(port, port, ip, 0, 0, 0, static_cast<uint8_t>(STATE::NONE));
-    createMessage(source_port, port, default_sequence_number, default_ack_number, static_cast<uint8_t>(FLAGS::SYN), window_size, urgent_pointer, destinationIP, static_cast<uint8_t>(STATE::SYN_SENT), 0, 0);
-    clients[port].setExpectedSequence(default_sequence_number+1);
+    INFO_SRC("Connection[addClient] - Adding Client, SYN queued [IP=%u PORT=%u]", ip, port);
+    connectQueue.push(std::make_pair(port, ip));
 }
 
 
-//TODO: REFRACTOR CODE TO MAKE THIS FUNCTION SMALLER AND IMPLEMENT FUNCTIONAL PROGRAMMING 
-// FUNCTION FOR EACH STATE SO WE CAN SPLIT IT UP AND CAN FIND ERRORS EASIER
+void Connection::openTarget() {
+    if (!clients.empty()) {
+        INFO_SRC("Connection[openTarget] - Targets provided, SYN queued");
+        pendingSyns.push_back(destination_port);
+    }
+}
+
+// With a cookie cached for the server, the SYN carries the first segment of queued data (RFC 7413 3).
+void Connection::sendSyn(Client& client) {
+    uint16_t streamId = 0;
+    uint64_t start = 0, end = 0;
+    if (fast_open && fast_open_cookies.cachedCookie(client.getIP(), client.getPort()) && client.nextSendStream(streamId)) {
+        uint16_t optionSize = streamId ? Segment::STREAM_OPTION_SIZE : 0;
+        start = client.getStreamNextOffset(streamId);
+        end = start + std::min<uint64_t>(MAX_SYN_DATA - optionSize, client.getStreamUnsent(streamId));
+        client.setStreamNextOffset(streamId, end);
+        stats.fast_open_data_sent += end - start;
+        DEBUG_SRC("Connection[sendSyn] - %llu bytes of stream %u on the SYN to Client[IP=%u PORT=%u]", static_cast<unsigned long long>(end - start), streamId, client.getIP(), client.getPort());
+    }
+    createMessage(source_port, client.getPort(), default_sequence_number, default_ack_number, static_cast<uint8_t>(FLAGS::SYN), urgent_pointer, client.getIP(), static_cast<uint8_t>(STATE::SYN_SENT), start, end, streamId);
+    client.setExpectedSequence(default_sequence_number + 1 + static_cast<uint32_t>(end - start));
+}
+
 void Connection::communicate() {
 
+    ThreadPlacement::apply("tcp-connection");
     INFO_SRC("Connection[communicate] - Function started");
 
-    if (!clients.empty()) {
-        INFO_SRC("Connection[communicate] - Targets provided creating and sending SYN");
-        Client& client = clients.at(destination_port);
-        createMessage(source_port, client.getPort(), default_sequence_number, default_ack_number, static_cast<uint8_t>(FLAGS::SYN), window_size,  urgent_pointer, destinationIP, static_cast<uint8_t>(STATE::SYN_SENT), 0, 0);
-        client.setExpectedSequence(default_sequence_number+1);
-    }
-    
-    std::unique_ptr<Segment> seg;
-    std::vector<uint8_t> input;
+    openTarget();
+
+    Clock::time_point lastWork = Clock::now();
     while (running) {
-        if (receiverQueue.tryPop(seg)) {
-            if(seg->getDestPrt() != source_port) {
-                WARNING_SRC("Connection[communicate] - Received Valid SEG - INVALID PORT -> DSTPRT=%u | SRCPRT=%u", seg->getDestPrt(), source_port);
-            }
-            else {
-                switch(decodeFlags(seg->getFlags())) {
-                    case FlagType::SYN:{
-                        clients.try_emplace(seg->getSrcPrt(), seg->getSrcPrt(), seg->getDestinationIP(), 0, seg->getSeqNum()+1, 0, static_cast<uint8_t>(STATE::SYN_RECEIVED));
-                        DEBUG_SRC("Connection[communicate] - SYN RECEIVED Client[IP:%u SRC:%u SEQ:%u]", seg->getSrcPrt(), seg->getDestinationIP(), seg->getSeqNum());
-                        createMessage(source_port, seg->getSrcPrt(), default_sequence_number, seg->getSeqNum()+1, createFlag(FLAGS::SYN, FLAGS::ACK), window_size, urgent_pointer, seg->getDestinationIP(), static_cast<uint8_t>(STATE::SYN_SENT), 0, 0);
-                        clients[seg->getSrcPrt()].setExpectedSequence(default_sequence_number+1);
-                        break;
+        if (step()) {
+            if (busy_poll.count()) lastWork = Clock::now();
+        }
+        else if (busy_poll.count() && Clock::now() - lastWork < busy_poll) {
+            std::this_thread::yield();                              // spin, but let the transport threads run on a shared core
+        }
+        else {
+            // Idle: wake for the earliest retransmission deadline, polling the queues at MAX_IDLE_WAIT.
+            // A transport driven from this thread sleeps in its own wait() so arriving datagrams end it early.
+            auto wait = std::min<Clock::duration>(nextDeadline() - Clock::now(), MAX_IDLE_WAIT);
+            if (wait > Clock::duration::zero() && !transport->wait(wait)) std::this_thread::sleep_for(wait);
+        }
+    }
+}
+
+Clock::time_point Connection::nextDeadline() {
+    Clock::time_point deadline = Clock::time_point::max();
+    for(auto& [port, client] : clients) {
+        deadline = std::min({deadline, client.getRetransmitDeadline(), client.getPersistDeadline()});
+        if(client.getState() == static_cast<uint8_t>(STATE::ESTABLISHED)) deadline = std::min(deadline, client.getPathMtu().getDeadline());
+    }
+    return deadline;
+}
+
+//TODO: REFRACTOR CODE TO MAKE THIS FUNCTION SMALLER AND IMPLEMENT FUNCTIONAL PROGRAMMING 
+// FUNCTION FOR EACH STATE SO WE CAN SPLIT IT UP AND CAN FIND ERRORS EASIER
+void Connection::handleSegment(std::unique_ptr<Segment> seg) {
+    if(seg->getDestPrt() != source_port) {
+        WARNING_SRC("Connection[communicate] - Received Valid SEG - INVALID PORT -> DSTPRT=%u | SRCPRT=%u", seg->getDestPrt(), source_port);
+    }
+    else if (seg->getProbeOption()) {
+        handleProbe(std::move(seg));
+    }
+    else if (seg->getParityCount()) {
+        handleParity(std::move(seg));
+    }
+    else {
+        switch(decodeFlags(seg->getFlags())) {
+            case FlagType::SYN:{
+                auto [it, inserted] = clients.try_emplace(seg->getSrcPrt(), seg->getSrcPrt(), seg->getDestinationIP(), 0, seg->getSeqNum()+1, default_sequence_number, static_cast<uint8_t>(STATE::SYN_RECEIVED));
+                Client& client = it->second;
+                if (inserted) initClient(client);
+                client.setCompression(compression && seg->getCompressionOffer() == Lz4::CODEC_ID);
+                client.getFec().setEnabled(fec_group_size && seg->getFecOffer());
+                if (window_scaling && seg->hasWindowScale()) client.enableWindowScaling(std::min(seg->getWindowScale(), ReceiveWindow::MAX_SCALE), ReceiveWindow::scaleFor(receive_buffer_max));
+                client.setFastOpen(fast_open && seg->hasFastOpen());
+                DEBUG_SRC("Connection[communicate] - SYN RECEIVED Client[IP:%u SRC:%u SEQ:%u]", seg->getSrcPrt(), seg->getDestinationIP(), seg->getSeqNum());
+
+                uint32_t ackNum = seg->getSeqNum()+1;
+                if (!inserted && client.getState() == static_cast<uint8_t>(STATE::SYN_SENT)) {
+                    ackNum = client.getExpectedAck();                   // retransmitted SYN, its data (if taken) was delivered already
+                }
+                else if (client.getFastOpen() && !seg->getData().empty()) {
+                    if (fast_open_cookies.validCookie(client.getIP(), seg->getFastOpenCookie())) {
+                        DEBUG_SRC("Connection[communicate] - Fast open cookie valid, delivering %zu bytes sent on the SYN", seg->getData().size());
+                        deliverPayload(client, *seg);
+                        ackNum += static_cast<uint32_t>(seg->getData().size());
+                        stats.fast_open_accepted++;
+                    } else {
+                        DEBUG_SRC("Connection[communicate] - Fast open cookie invalid, ACK'ing the SYN only");
                     }
-                    case FlagType::SYN_ACK:
+                }
+                createMessage(source_port, seg->getSrcPrt(), default_sequence_number, ackNum, createFlag(FLAGS::SYN, FLAGS::ACK), urgent_pointer, seg->getDestinationIP(), static_cast<uint8_t>(STATE::SYN_SENT), 0, 0);
+                client.setExpectedSequence(default_sequence_number+1);
+                break;
+            }
+            case FlagType::SYN_ACK:
+                
+                if (auto clientIt = clients.find(seg->getSrcPrt()); clientIt != clients.end()) {
+                    Client& client = clientIt->second;
+                    if (seg->getAckNum() != client.getExpectedSequence()) client.rewindSynData(seg->getAckNum());
+                    if (seg->getAckNum() == client.getExpectedSequence()) {
+                        client.checkTrackerSegment(seg->getAckNum(), seg->getReceiveTime());
+                        if (fast_open && seg->hasFastOpen()) fast_open_cookies.storeCookie(client.getIP(), client.getPort(), seg->getFastOpenCookie());
+                        client.setCompression(compression && seg->getCompressionOffer() == Lz4::CODEC_ID);
+                        client.getFec().setEnabled(fec_group_size && seg->getFecOffer());
+                        if (window_scaling && seg->hasWindowScale()) client.enableWindowScaling(std::min(seg->getWindowScale(), ReceiveWindow::MAX_SCALE), ReceiveWindow::scaleFor(receive_buffer_max));
+
+                        DEBUG_SRC("Connection[communicate] - SYN_ACK RECEIVED Client[IP:%u SEQ:%u]", seg->getDestinationIP(), seg->getSrcPrt());
                         
-                        if (auto clientIt = clients.find(seg->getSrcPrt()); clientIt != clients.end()) {
-                            Client& client = clientIt->second;
-                            if (seg->getAckNum() == client.getExpectedSequence()) {
-                                client.checkTrackerSegment(seg->getAckNum());
-
-                                DEBUG_SRC("Connection[communicate] - SYN_ACK RECEIVED Client[IP:%u SEQ:%u]", seg->getDestinationIP(), seg->getSrcPrt());
-                                
-                                createMessage(source_port, client.getPort(), client.getExpectedSequence(), seg->getSeqNum()+1, static_cast<uint8_t>(FLAGS::ACK), window_size, urgent_pointer, client.getIP(), static_cast<uint8_t>(STATE::ESTABLISHED), 0, 0);
-                                if(client.hasMessages()) while(client.checkFront(seg->getAckNum()));
-                                client.setLastAck(seg->getAckNum());
-                                client.setWindowSize(seg->getWindowSize());
-                            } 
-                            else {
-                                WARNING_SRC("Connection[communicate] - Client[IP:%u PORT:%u] Sent SYN_ACK with Incorrect ACK [EXPACK=%u ACK=%u]", seg->getDestinationIP(), seg->getSrcPrt(), client.getExpectedAck(), seg->getAckNum());
-                            }
-                        } 
-                        else {
-                            WARNING_SRC("Connection[communicate] - Received SYN_ACK from unknown client [IP:%u PORT:%u]", seg->getDestinationIP(), seg->getSrcPrt());
+                        bool opened = client.getState() != static_cast<uint8_t>(STATE::ESTABLISHED);       // not a duplicate SYN_ACK
+                        createMessage(source_port, client.getPort(), client.getExpectedSequence(), seg->getSeqNum()+1, static_cast<uint8_t>(FLAGS::ACK), urgent_pointer, client.getIP(), static_cast<uint8_t>(STATE::ESTABLISHED), 0, 0);
+                        if (opened) stats.connections_established++;
+                        if(client.hasMessages()) while(client.checkFront(seg->getAckNum()));
+                        client.setLastAck(seg->getAckNum());
+                        client.setWindowSize(seg->getWindowSize());     // a SYN_ACK's window is never scaled
+                        sendMessages(client.getPort()); // anything queued while the handshake was in progress
+                    } 
+                    else {
+                        WARNING_SRC("Connection[communicate] - Client[IP:%u PORT:%u] Sent SYN_ACK with Incorrect ACK [EXPACK=%u ACK=%u]", seg->getDestinationIP(), seg->getSrcPrt(), client.getExpectedAck(), seg->getAckNum());
+                    }
+                } 
+                else {
+                    WARNING_SRC("Connection[communicate] - Received SYN_ACK from unknown client [IP:%u PORT:%u]", seg->getDestinationIP(), seg->getSrcPrt());
+                }
+                break;
+            case FlagType::FIN:
+                if (auto clientIt = clients.find(seg->getSrcPrt()); clientIt != clients.end()) {
+                    Client& client = clientIt->second;
+                    client.checkTrackerSegment(seg->getAckNum(), seg->getReceiveTime());
+
+                    if (seqGreater(seg->getSeqNum(), client.getExpectedAck())) {
+                        uint32_t copySeqNum = seg->getSeqNum();
+                        if ((seqGreaterEqual(seg->getAckNum(), client.getLastAck()) && seqLessEqual(seg->getAckNum(), client.getExpectedSequence()))) {
+                            messageHandler(std::move(seg));
+                        } else {
+                            client.setPeerWindow(seg->getWindowSize());
+                            client.setItemMessageBuffer(copySeqNum, std::move(seg));
                         }
-                        break;
-                    case FlagType::FIN:
-                        if (auto clientIt = clients.find(seg->getSrcPrt()); clientIt != clients.end()) {
-                            Client& client = clientIt->second;
-                            client.checkTrackerSegment(seg->getAckNum());
-
-                            if (seg->getSeqNum() > client.getExpectedAck()) {
-                                uint32_t copySeqNum = seg->getSeqNum();
-                                if ((seg->getAckNum() >= client.getLastAck() && seg->getAckNum() <= client.getExpectedSequence())) {
-                                    messageHandler(std::move(seg));
-                                } else {
-                                    client.setWindowSize(seg->getWindowSize());
-                                    client.setItemMessageBuffer(seg->getSeqNum(), std::move(seg));
-                                }
-                                DEBUG_SRC("Connection[communicate] - Received out of order packet [TYPE=FIN SEQ=%u EXPSEQ=%u]", copySeqNum, client.getExpectedAck());
-                            }
-                            else if ((seg->getAckNum() >= client.getLastAck() && seg->getAckNum() <= client.getExpectedSequence()) && seg->getSeqNum() == client.getExpectedAck()) {
-                                DEBUG_SRC("Connection[communicate] - Received in order packet[FIN] with valid ACK");
+                        DEBUG_SRC("Connection[communicate] - Received out of order packet [TYPE=FIN SEQ=%u EXPSEQ=%u]", copySeqNum, client.getExpectedAck());
+                    }
+                    else if ((seqGreaterEqual(seg->getAckNum(), client.getLastAck()) && seqLessEqual(seg->getAckNum(), client.getExpectedSequence())) && seg->getSeqNum() == client.getExpectedAck()) {
+                        DEBUG_SRC("Connection[communicate] - Received in order packet[FIN] with valid ACK");
 
-                                uint8_t newState = static_cast<uint8_t>(STATE::NONE);
-                                if (client.getState() == static_cast<uint8_t>(STATE::ESTABLISHED)) {
-                                    newState = static_cast<uint8_t>(STATE::CLOSING);
-                                    DEBUG_SRC("Connection[communicate] - Received FIN transitioning from ESTABLISHED to CLOSING");
-                                }
-                                else if (client.getState() == static_cast<uint8_t>(STATE::FIN_WAIT_2)) {
-                                    newState = static_cast<uint8_t>(STATE::TIME_WAIT);
-                                    DEBUG_SRC("Connection[communicate] - Received FIN transitioning from FIN_WAIT_2 to TIME_WAIT");
-                                }
+                        uint8_t newState = static_cast<uint8_t>(STATE::NONE);
+                        if (client.getState() == static_cast<uint8_t>(STATE::ESTABLISHED)) {
+                            newState = static_cast<uint8_t>(STATE::CLOSING);
+                            DEBUG_SRC("Connection[communicate] - Received FIN transitioning from ESTABLISHED to CLOSING");
+                        }
+                        else if (client.getState() == static_cast<uint8_t>(STATE::FIN_WAIT_2)) {
+                            newState = static_cast<uint8_t>(STATE::TIME_WAIT);
+                            DEBUG_SRC("Connection[communicate] - Received FIN transitioning from FIN_WAIT_2 to TIME_WAIT");
+                        }
+                        else if (client.getState() == static_cast<uint8_t>(STATE::FIN_WAIT_1)) {
+                            // Simultaneous close: both FINs crossed, only the ACK of our own FIN is outstanding.
+                            newState = static_cast<uint8_t>(STATE::LAST_ACK);
+                            DEBUG_SRC("Connection[communicate] - Received FIN transitioning from FIN_WAIT_1 to LAST_ACK");
+                        }
 
-                                if (newState != static_cast<uint8_t>(STATE::NONE)) {
-                                    DEBUG_SRC("Connection[communicate] - Received FIN and transitioning state, calling createMessage with flag=FIN_ACK");
-                                    createMessage(source_port, client.getPort(), client.getExpectedSequence(), seg->getSeqNum()+1, createFlag(FLAGS::FIN, FLAGS::ACK), window_size, urgent_pointer, client.getIP(), newState, 0,0);
-                                    client.setWindowSize(seg->getWindowSize());
-                                    client.setLastAck(seg->getAckNum());
-                                    client.setExpectedAck(seg->getSeqNum()+1);
-                                    client.setExpectedSequence(client.getExpectedSequence()+1);
-                                    if (newState == static_cast<uint8_t>(STATE::CLOSING)) messageHandler(std::move(seg));
-                                } else {
-                                    WARNING_SRC("Connection[communicate] - Received FIN but transition state failed currentState=%s", stateToStr(client.getState()).c_str());
-                                }
-                                
-                            } 
-                            else {
-                                WARNING_SRC("Connection[communicate] - Client[IP:%u PORT:%u] Sent FIN with Incorrect SEQ & ACK [EXP_SEQ=%u EXP_ACK=%u SEQ=%u ACK=%u]", seg->getDestinationIP(), seg->getSrcPrt(), client.getExpectedAck(), client.getExpectedSequence(), seg->getSeqNum(),  seg->getAckNum());
-                            }
-                        } 
-                        else {
-                            WARNING_SRC("Connection[communicate] - Received FIN from unknown client [IP:%u PORT:%u]", seg->getDestinationIP(), seg->getSrcPrt());
+                        if (newState != static_cast<uint8_t>(STATE::NONE)) {
+                            DEBUG_SRC("Connection[communicate] - Received FIN and transitioning state, calling createMessage with flag=FIN_ACK");
+                            createMessage(source_port, client.getPort(), client.getExpectedSequence(), seg->getSeqNum()+1, createFlag(FLAGS::FIN, FLAGS::ACK), urgent_pointer, client.getIP(), newState, 0,0);
+                            client.setPeerWindow(seg->getWindowSize());
+                            client.setLastAck(seg->getAckNum());
+                            client.setExpectedAck(seg->getSeqNum()+1);
+                            // The peer's crossing FIN_ACK only covers our FIN, so it must still match expectedSequence.
+                            if (newState != static_cast<uint8_t>(STATE::LAST_ACK)) client.setExpectedSequence(client.getExpectedSequence()+1);
+                            if (newState == static_cast<uint8_t>(STATE::CLOSING)) messageHandler(std::move(seg));
+                        } else {
+                            WARNING_SRC("Connection[communicate] - Received FIN but transition state failed currentState=%s", stateToStr(client.getState()).c_str());
                         }
+                        
+                    } 
+                    else {
+                        WARNING_SRC("Connection[communicate] - Client[IP:%u PORT:%u] Sent FIN with Incorrect SEQ & ACK [EXP_SEQ=%u EXP_ACK=%u SEQ=%u ACK=%u]", seg->getDestinationIP(), seg->getSrcPrt(), client.getExpectedAck(), client.getExpectedSequence(), seg->getSeqNum(),  seg->getAckNum());
+                    }
+                } 
+                else {
+                    WARNING_SRC("Connection[communicate] - Received FIN from unknown client [IP:%u PORT:%u]", seg->getDestinationIP(), seg->getSrcPrt());
+                }
+
+                break;
+            case FlagType::FIN_ACK:
 
+                if (auto clientIt = clients.find(seg->getSrcPrt()); clientIt != clients.end()) {
+                    Client& client = clientIt->second;
+                    if (client.getState() == static_cast<uint8_t>(STATE::TIME_WAIT)) {
+                        // The peer has not seen our FIN_ACK yet: stay until our retransmission gets through (RFC 9293 3.10.7.4).
+                        DEBUG_SRC("Connection[communicate] - Client[IP:%u PORT:%u] retransmitted its FIN_ACK, already in TIME_WAIT", client.getIP(), client.getPort());
+                        client.restartTimeWait();
                         break;
-                    case FlagType::FIN_ACK:
-
-                        if (auto clientIt = clients.find(seg->getSrcPrt()); clientIt != clients.end()) {
-                            Client& client = clientIt->second;
-                            client.checkTrackerSegment(seg->getAckNum());
-
-                            if(seg->getSeqNum() > client.getExpectedAck()) {
-                                uint32_t copySeqNum = seg->getSeqNum();
-                                if ((seg->getAckNum() > client.getLastAck() && seg->getAckNum() <= client.getExpectedSequence())) {
-                                    messageHandler(std::move(seg));
-                                } 
-                                DEBUG_SRC("Connection[communicate] - Received out of order packet [TYPE=FIN_ACK SEQ=%u EXPSEQ=%u]", copySeqNum, client.getExpectedAck());
-                            }
-                            else if (seg->getAckNum() == client.getExpectedSequence() && seg->getSeqNum() == client.getExpectedAck()) {
-                                DEBUG_SRC("Connection[communicate] - Received in order packet[FIN_ACK] with valid ACK");
-                                
-                                while(client.checkFront(seg->getAckNum()));
-                                client.setExpectedSequence(seg->getAckNum());
-                                client.setExpectedAck(seg->getSeqNum()+1);
-                                client.setLastAck(seg->getAckNum());
-                                client.setWindowSize(seg->getWindowSize());
-
-                                STATE newState = STATE::NONE;
-                                if (client.getState() == static_cast<uint8_t>(STATE::FIN_WAIT_1)) {
-                                    newState = STATE::FIN_WAIT_2;
-                                    DEBUG_SRC("Connection[communicate] - Received FIN transitioning from FIN_WAIT_1 to FIN_WAIT_2");
-                                }
-                                else if (client.getState() == static_cast<uint8_t>(STATE::LAST_ACK)) {
-                                    newState = STATE::CLOSED;
-                                    DEBUG_SRC("Connection[communicate] - Received FIN transitioning from LAST_ACK to CLOSED");
-                                }
+                    }
+                    client.checkTrackerSegment(seg->getAckNum(), seg->getReceiveTime());
 
-                                client.setState(static_cast<uint8_t>(newState));
-                                client.info();
-                            } 
-                            else {
-                                WARNING_SRC("Connection[communicate] - Client[IP:%u PORT:%u] Sent FIN_ACK with Incorrect SEQ & ACK [EXP_SEQ=%u EXP_ACK=%u SEQ=%u ACK=%u]", seg->getDestinationIP(), seg->getSrcPrt(), client.getExpectedAck(), client.getExpectedSequence(), seg->getSeqNum(),  seg->getAckNum());
-                            }
+                    if(seqGreater(seg->getSeqNum(), client.getExpectedAck())) {
+                        uint32_t copySeqNum = seg->getSeqNum();
+                        if ((seqGreater(seg->getAckNum(), client.getLastAck()) && seqLessEqual(seg->getAckNum(), client.getExpectedSequence()))) {
+                            messageHandler(std::move(seg));
                         } 
+                        DEBUG_SRC("Connection[communicate] - Received out of order packet [TYPE=FIN_ACK SEQ=%u EXPSEQ=%u]", copySeqNum, client.getExpectedAck());
+                    }
+                    else if (seg->getAckNum() == client.getExpectedSequence() && seg->getSeqNum() == client.getExpectedAck()) {
+                        DEBUG_SRC("Connection[communicate] - Received in order packet[FIN_ACK] with valid ACK");
+                        
+                        while(client.checkFront(seg->getAckNum()));
+                        client.setExpectedSequence(seg->getAckNum());
+                        client.setExpectedAck(seg->getSeqNum()+1);
+                        client.setLastAck(seg->getAckNum());
+                        client.setPeerWindow(seg->getWindowSize());
+
+                        STATE newState = STATE::NONE;
+                        if (client.getState() == static_cast<uint8_t>(STATE::FIN_WAIT_1)) {
+                            newState = STATE::FIN_WAIT_2;
+                            DEBUG_SRC("Connection[communicate] - Received FIN transitioning from FIN_WAIT_1 to FIN_WAIT_2");
+                        }
+                        else if (client.getState() == static_cast<uint8_t>(STATE::LAST_ACK) && client.hasMessages()) {
+                            // Simultaneous close: our FIN_ACK for the peer's FIN is still unanswered and may be lost,
+                            // so linger and retransmit it instead of vanishing while the peer waits for it. The peer's
+                            // FIN_ACK only acknowledges ours, so its FIN is not counted twice in the retransmission.
+                            newState = STATE::TIME_WAIT;
+                            client.setExpectedAck(seg->getSeqNum());
+                            DEBUG_SRC("Connection[communicate] - Received FIN transitioning from LAST_ACK to TIME_WAIT");
+                        }
+                        else if (client.getState() == static_cast<uint8_t>(STATE::LAST_ACK)) {
+                            newState = STATE::CLOSED;
+                            DEBUG_SRC("Connection[communicate] - Received FIN transitioning from LAST_ACK to CLOSED");
+                        }
+
+                        client.setState(static_cast<uint8_t>(newState));
+                        client.info();
+                    } 
+                    else {
+                        WARNING_SRC("Connection[communicate] - Client[IP:%u PORT:%u] Sent FIN_ACK with Incorrect SEQ & ACK [EXP_SEQ=%u EXP_ACK=%u SEQ=%u ACK=%u]", seg->getDestinationIP(), seg->getSrcPrt(), client.getExpectedAck(), client.getExpectedSequence(), seg->getSeqNum(),  seg->getAckNum());
+                    }
+                } 
+                else {
+                    WARNING_SRC("Connection[communicate] - Received FIN_ACK from unknown client [IP:%u PORT:%u]", seg->getDestinationIP(), seg->getSrcPrt());
+                }
+                
+                break;
+
+            case FlagType::ACK:
+                if (auto clientIt = clients.find(seg->getSrcPrt()); clientIt != clients.end()) {
+                    Client& client = clientIt->second;
+                    client.checkTrackerSegment(seg->getAckNum(), seg->getReceiveTime());
+                    client.getFec().onData(*seg);
+                    if (seqGreater(seg->getSeqNum(), client.getExpectedAck())) {
+                        uint32_t copySeqNum = seg->getSeqNum();
+                        // Streams do not wait for the gap in the connection sequence; the in order pass skips what was delivered here.
+                        if(seg->getStreamId() && !seg->getData().empty()) deliverStream(client, *seg);
+                        if(seqGreater(seg->getAckNum(), client.getLastAck()) && seqLessEqual(seg->getAckNum(), client.getExpectedSequence())) {
+                            messageHandler(std::move(seg));
+                        }
                         else {
-                            WARNING_SRC("Connection[communicate] - Received FIN_ACK from unknown client [IP:%u PORT:%u]", seg->getDestinationIP(), seg->getSrcPrt());
+                            client.setPeerWindow(seg->getWindowSize());
+                            client.setItemMessageBuffer(copySeqNum, std::move(seg));
                         }
+                        DEBUG_SRC("Connection[communicate] - Received out of order packet [TYPE=ACK SEQ=%u EXPSEQ=%u]", copySeqNum, client.getExpectedAck());
+                    }
+                    else if(seqGreaterEqual(seg->getAckNum(), client.getLastAck()) && seqLessEqual(seg->getAckNum(), client.getExpectedSequence()) && seg->getSeqNum() == client.getExpectedAck()) {
+                        DEBUG_SRC("Connection[communicate] - Received in order packet[ACK] with valid ACK");
                         
-                        break;
+                        size_t data_written = 0;
+                        
+                        if (!seg->getData().empty()) {
+                            INFO_SRC("Connection[communicate] - Received packet[IP=%u PORT=%u SEQ=%u ACK=%u SIZE=%zu] with data -> attempting to write to file", client.getIP(), client.getPort(), seg->getSeqNum(), seg->getAckNum(), seg->getData().size());
+                            
+                            // for(uint8_t byte : seg->getData()) {
+                            //     std::cout << byte;
+                            // }
+                            // std::cout << std::endl;
+                            
+                            data_written = deliverPayload(client, *seg);
+                            
+                            uint32_t new_seq_num = seg->getSeqNum() + data_written;
+                            //FIXME: Out of order packet could be a FIN/FIN_ACK what do we do then
+                            if (client.checkItemMessageBuffer(new_seq_num)){
+                                std::unique_ptr<Segment> outOfOrderSegment;
+                                while (client.popItemMessageBuffer(new_seq_num, outOfOrderSegment)) {
+                                    if(outOfOrderSegment->getFlags() == static_cast<uint8_t>(FLAGS::ACK) && outOfOrderSegment->getData().size() > 0){
+                                        TRACE_SRC("Connection[communicate] - Attempting to write out of order packet[IP=%u PORT=%u SEQ=%u ACK=%u SIZE=%zu] to file", client.getIP(), client.getPort(), outOfOrderSegment->getSeqNum(), outOfOrderSegment->getAckNum(), outOfOrderSegment->getData().size());
+                                        
+                                        // for(uint8_t byte : outOfOrderSegment->getData()) {
+                                        //     std::cout << byte;
+                                        // }
+                                        // std::cout << std::endl;
 
-                    case FlagType::ACK:
-                        if (auto clientIt = clients.find(seg->getSrcPrt()); clientIt != clients.end()) {
-                            Client& client = clientIt->second;
-                            client.checkTrackerSegment(seg->getAckNum());
-                            if (seg->getSeqNum() > client.getExpectedAck()) {
-                                uint32_t copySeqNum = seg->getSeqNum();
-                                if(seg->getAckNum() > client.getLastAck() && seg->getAckNum() <= client.getExpectedSequence()) {
-                                    messageHandler(std::move(seg));
-                                }
-                                else {
-                                    client.setWindowSize(seg->getWindowSize());
-                                    client.setItemMessageBuffer(seg->getSeqNum(), std::move(seg));
-                                }
-                                DEBUG_SRC("Connection[communicate] - Received out of order packet [TYPE=ACK SEQ=%u EXPSEQ=%u]", copySeqNum, client.getExpectedAck());
-                            }
-                            else if(seg->getAckNum() >= client.getLastAck() && seg->getAckNum() <= client.getExpectedSequence() && seg->getSeqNum() == client.getExpectedAck()) {
-                                DEBUG_SRC("Connection[communicate] - Received in order packet[ACK] with valid ACK");
-                                
-                                size_t data_written = 0;
-                                
-                                if (!seg->getData().empty()) {
-                                    INFO_SRC("Connection[communicate] - Received packet[IP=%u PORT=%u SEQ=%u ACK=%u SIZE=%zu] with data -> attempting to write to file", client.getIP(), client.getPort(), seg->getSeqNum(), seg->getAckNum(), seg->getData().size());
-                                    
-                                    // for(uint8_t byte : seg->getData()) {
-                                    //     std::cout << byte;
-                                    // }
-                                    // std::cout << std::endl;
-                                    
-                                    std::vector<uint8_t> packetData = seg->getData();
-                                    client.receivedData.push(std::move(packetData));
-                                    data_written = client.writeFile(seg->getData());
-                                    
-                                    uint32_t new_seq_num = seg->getSeqNum() + data_written;
-                                    //FIXME: Out of order packet could be a FIN/FIN_ACK what do we do then
-                                    if (client.checkItemMessageBuffer(new_seq_num)){
-                                        std::unique_ptr<Segment> outOfOrderSegment;
-                                        while (client.popItemMessageBuffer(new_seq_num, outOfOrderSegment)) {
-                                            if(outOfOrderSegment->getFlags() == static_cast<uint8_t>(FLAGS::ACK) && outOfOrderSegment->getData().size() > 0){
-                                                TRACE_SRC("Connection[communicate] - Attempting to write out of order packet[IP=%u PORT=%u SEQ=%u ACK=%u SIZE=%zu] to file", client.getIP(), client.getPort(), outOfOrderSegment->getSeqNum(), outOfOrderSegment->getAckNum(), outOfOrderSegment->getData().size());
-                                                
-                                                // for(uint8_t byte : outOfOrderSegment->getData()) {
-                                                //     std::cout << byte;
-                                                // }
-                                                // std::cout << std::endl;
-
-                                                std::vector<uint8_t> packetData = outOfOrderSegment->getData();
-                                                client.receivedData.push(std::move(packetData));
-                                                data_written = client.writeFile(outOfOrderSegment->getData());
-                                                new_seq_num += data_written;
-                                            }
-                                            else break;
-                                        }
-                                        seg = std::move(outOfOrderSegment);
+                                        data_written = deliverPayload(client, *outOfOrderSegment);
+                                        new_seq_num += data_written;
                                     }
-                                    
-                                    client.closeFile();
-                                    
-                                    seg->setSeqNum(new_seq_num); 
-                                    client.setExpectedAck(new_seq_num);
-                                
-                                } 
-
-                                if(client.getState() == static_cast<uint8_t>(STATE::SYN_SENT)) {
-                                    client.setState(static_cast<uint8_t>(STATE::ESTABLISHED));
-                                    
-                                } 
-                                DEBUG_SRC("Connection[communicate] - Calling messageHandler to determine additional responses for packet received");
-                                messageHandler(std::move(seg), data_written);
-                                
-                                
-                            } else {
-                                WARNING_SRC("Connection[communicate] - Client[IP:%u PORT:%u] Sent ACK with Incorrect ACK [SEGSEQ=%u SEGACK=%u CLISEQ=%u CLIACK=%u]", seg->getDestinationIP(), seg->getSrcPrt(), seg->getSeqNum(), seg->getAckNum(), client.getExpectedSequence(), client.getExpectedAck());
+                                    else break;
+                                }
+                                seg = std::move(outOfOrderSegment);
                             }
-                        } else {
-                            WARNING_SRC("Connection[communicate] - Received ACK from unknown client [IP:%u PORT:%u]", seg->getDestinationIP(), seg->getSrcPrt());
-                        }
+                            
+                            client.closeFile();
+                            
+                            seg->setSeqNum(new_seq_num); 
+                            client.setExpectedAck(new_seq_num);
                         
-                        continue;
-                    case FlagType::PSH_ACK:
-                        //TODO: Implement PSH_ACK logic 
-                        continue;
-                    case FlagType::RST:
-                        //TODO: Implement RST logic 
-                        continue;
-                    case FlagType::DATA:
-                        //TODO: Implement DATA logic 
-                        continue;
-                    default: continue;
+                        } 
+
+                        if(client.getState() == static_cast<uint8_t>(STATE::SYN_SENT)) {
+                            client.setState(static_cast<uint8_t>(STATE::ESTABLISHED));
+                            stats.connections_established++;
+                        } 
+                        DEBUG_SRC("Connection[communicate] - Calling messageHandler to determine additional responses for packet received");
+                        messageHandler(std::move(seg), data_written);
+                        
+                        
+                    } else if (seqLess(seg->getSeqNum(), client.getExpectedAck()) && !seg->getData().empty()) {
+                        // Retransmission of data we already have: our ACK was lost, so repeat it or the sender stalls on a full window.
+                        DEBUG_SRC("Connection[communicate] - Duplicate packet[SEQ=%u EXPSEQ=%u] -> re-sending ACK", seg->getSeqNum(), client.getExpectedAck());
+                        createMessage(source_port, client.getPort(), client.getExpectedSequence(), client.getExpectedAck(), static_cast<uint8_t>(FLAGS::ACK), urgent_pointer, client.getIP(), client.getState(), 0, 0);
+                    } else {
+                        WARNING_SRC("Connection[communicate] - Client[IP:%u PORT:%u] Sent ACK with Incorrect ACK [SEGSEQ=%u SEGACK=%u CLISEQ=%u CLIACK=%u]", seg->getDestinationIP(), seg->getSrcPrt(), seg->getSeqNum(), seg->getAckNum(), client.getExpectedSequence(), client.getExpectedAck());
+                    }
+                } else {
+                    WARNING_SRC("Connection[communicate] - Received ACK from unknown client [IP:%u PORT:%u]", seg->getDestinationIP(), seg->getSrcPrt());
                 }
+                
+                break;
+            case FlagType::PSH_ACK:
+                //TODO: Implement PSH_ACK logic 
+                break;
+            case FlagType::RST:
+                //TODO: Implement RST logic 
+                break;
+            case FlagType::DATA:
+                //TODO: Implement DATA logic 
+                break;
+            default: break;
+        }
+    }
+}
+
+// Returns true when a segment, input or close step was handled, false when idle.
+bool Connection::step() {
+    if (!running) return false;
+
+    std::unique_ptr<Segment> seg;
+    std::vector<uint8_t> input;
+    StreamInput streamInput;
+    std::pair<uint16_t, uint32_t> target;
+    if (transport) transport->poll();
+    // Send times first, so an ACK that overtook its segment's TX stamp still gets the wire level sample.
+    SendTimestamp sent;
+    while (transport && transport->popSendTimestamp(sent)) {
+        auto clientIt = clients.find(sent.port);
+        if (clientIt != clients.end() && clientIt->second.setTrackerSendTime(sent.seq, sent.time)) stats.send_timestamps++;
+    }
+
+    if ((transport && transport->popReceived(seg)) || receiverQueue.tryPop(seg)) {
+        stats.segments_received++;
+        handleSegment(std::move(seg));
+        return true;
+    }
+    else if (connectQueue.tryPop(target)) {
+        auto [it, inserted] = clients.try_emplace(target.first, target.first, target.second, 0, 0, 0, static_cast<uint8_t>(STATE::NONE));
+        if (inserted) {
+            initClient(it->second);
+            pendingSyns.push_back(target.first);
+        }
+        return true;
+    }
+    else if (inputQueue.tryPop(input)) {
+        StreamInput broadcast{0, 0, std::move(input)};
+        queueStreamInput(broadcast);
+        return true;
+    } 
+    else if (streamQueue.tryPop(streamInput)) {
+        queueStreamInput(streamInput);
+        return true;
+    }
+    else if (!pendingSyns.empty()) {
+        for (uint16_t port : pendingSyns) {
+            if (auto clientIt = clients.find(port); clientIt != clients.end()) sendSyn(clientIt->second);
+        }
+        pendingSyns.clear();
+        return true;
+    }
+    else if (timeToClose) {
+        if(clients.empty()) {
+            // std::cout << "Clients empty shutting down loop and calling safeToClose" << std::endl;
+            running = false;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                canCloseDown = true;
+                safeToClose.notify_one();
             }
+            return true;
         }
         
-        else if (inputQueue.tryPop(input)) {
-            sendBuffer.insert(sendBuffer.end(), input.begin(), input.end());
-            
-            INFO_SRC("Connection[communicate] - received input data and sucessfully inserted into sendBuffer");
-            
-            for(auto& [port, client] : clients) {
-                if(client.getState() == static_cast<uint8_t>(STATE::ESTABLISHED) || client.getState() == static_cast<uint8_t>(STATE::CLOSING)) {
-                    sendMessages(client.getPort());
+        std::vector<uint16_t> portsToRemove;
+        bool finCreated = false;
+        
+        for(auto& [port, client] : clients) {
+            if(!client.getIsFinSent()) {
+                TRACE_SRC("Connection[communicate] - Client[IP=%u PORT=%u] Has not Sent/Received FIN -> checking if sent all data", client.getIP(), port);
+                
+                // A FIN only follows a finished handshake; with fast open data can be delivered before that.
+                if(!client.hasUnsentStreamData() && client.getState() != static_cast<uint8_t>(STATE::SYN_SENT)) {
+                    DEBUG_SRC("Connection[communicate] - Sending FIN to Client[IP=%u PORT=%u]", client.getIP(), port);
+
+                    createMessage(source_port,
+                                  port,
+                                  client.getExpectedSequence(),
+                                  client.getExpectedAck(),
+                                  static_cast<uint8_t>(FLAGS::FIN),
+                                  urgent_pointer, 
+                                  client.getIP(),
+                                  (client.getState() == static_cast<uint8_t>(STATE::ESTABLISHED) || client.getState() == static_cast<uint8_t>(STATE::CLOSING) ? static_cast<uint8_t>(STATE::FIN_WAIT_1) : static_cast<uint8_t>(STATE::LAST_ACK)),
+                                  0, 0
+                    );
+                    client.setExpectedSequence(client.getExpectedSequence()+1);
+                    client.setIsFinSent(true);
+                    finCreated = true;
                 }
             }
-        } 
-        else if (timeToClose) {
-            if(clients.empty()) {
-                // std::cout << "Clients empty shutting down loop and calling safeToClose" << std::endl;
-                running = false;
-                {
-                    std::lock_guard<std::mutex> lock(mtx);
-                    canCloseDown = true;
-                    safeToClose.notify_one();
+            else if (client.getState() == static_cast<uint8_t>(STATE::TIME_WAIT)) {
+                if(client.hasMessages() && client.getMessageTimeSent() != Clock::time_point{}) {
+                    auto now = Clock::now();
+                    double timeDiff = std::chrono::duration_cast<std::chrono::milliseconds>(now - client.getTimeWaitStart()).count();
+                    // Without backoff: retransmitting the final FIN_ACK doubles timeout_interval faster than time passes.
+                    if (timeDiff > 2*client.baseTimeout()) {
+                        portsToRemove.push_back(port);
+                        INFO_SRC("Connection[communicate] - Client[%u:%u] has officied finished the 2x timeout_interval - deleted port", client.getIP(), client.getPort());
+                    } 
                 }
-                break;
             }
-            
-            std::vector<uint16_t> portsToRemove;
-            
-            for(auto& [port, client] : clients) {
-                if(!client.getIsFinSent()) {
-                    TRACE_SRC("Connection[communicate] - Client[IP=%u PORT=%u] Has not Sent/Received FIN -> checking if sent all data", client.getIP(), port);
-                    
-                    if(client.getLastByteSent() == sendBuffer.size()) {
-                        DEBUG_SRC("Connection[communicate] - Sending FIN to Client[IP=%u PORT=%u]", client.getIP(), port);
-
-                        createMessage(source_port,
-                                      port,
-                                      client.getExpectedSequence(),
-                                      client.getExpectedAck(),
-                                      static_cast<uint8_t>(FLAGS::FIN),
-                                      window_size,
-                                      urgent_pointer, 
-                                      client.getIP(),
-                                      (client.getState() == static_cast<uint8_t>(STATE::ESTABLISHED) || client.getState() == static_cast<uint8_t>(STATE::CLOSING) ? static_cast<uint8_t>(STATE::FIN_WAIT_1) : static_cast<uint8_t>(STATE::LAST_ACK)),
-                                      0, 0
-                        );
-                        client.setExpectedSequence(client.getExpectedSequence()+1);
-                        client.setIsFinSent(true);
-                    }
-                }
-                else if (client.getState() == static_cast<uint8_t>(STATE::TIME_WAIT)) {
-                    if(client.hasMessages() && client.getMessageTimeSent() != std::chrono::steady_clock::time_point{}) {
-                        auto now = std::chrono::steady_clock::now();
-                        double timeDiff = std::chrono::duration_cast<std::chrono::milliseconds>(now - client.getMessageTimeSent()).count();
-                        if (timeDiff > 2*client.getTransmissionInfo().timeout_interval) { 
-                            portsToRemove.push_back(port);
-                            INFO_SRC("Connection[communicate] - Client[%u:%u] has officied finished the 2x timeout_interval - deleted port", client.getIP(), client.getPort());
-                        } 
-                    }
-                }
-                else if (client.getState() == static_cast<uint8_t>(STATE::CLOSED)) {
-                    portsToRemove.push_back(port);
-                }
+            else if (client.getState() == static_cast<uint8_t>(STATE::CLOSED)) {
+                portsToRemove.push_back(port);
             }
+        }
 
-            if (!portsToRemove.empty()) {
-                for (uint16_t port : portsToRemove) {
-                    clients.erase(port);
-                }
+        if (!portsToRemove.empty()) {
+            for (uint16_t port : portsToRemove) {
+                clients.erase(port);
             }
-
-        }
-        
-        else if(!clients.empty()) {
-            //FIXME: ERROR WITH RESEND RESULTING IN OUT OF PACKETS AS WELL 
-            messageResendCheck();
-        }
-        else {
-            //TODO: Implement proper logic regarding sleeping when nothing is avaibable. 
-            sleep(3);
         }
+        if (finCreated || !portsToRemove.empty()) return true;
+        // Nothing changed this pass: fall through so a lost FIN still gets retransmitted.
+    }
     
+    if(!clients.empty()) {
+        //FIXME: ERROR WITH RESEND RESULTING IN OUT OF PACKETS AS WELL 
+        messageResendCheck();
+    }
+    return false;
+}
+
+// Clients still opening are included so data queued right after addClient() goes out once ESTABLISHED.
+void Connection::queueStreamInput(StreamInput& input) {
+    INFO_SRC("Connection[communicate] - received %zu bytes of input for stream %u peer %u", input.bytes.size(), input.stream, input.peer);
+    size_t inputSize = input.bytes.size();
+
+    // One buffer (and one set of checksum blocks) for every recipient of a broadcast.
+    std::shared_ptr<const SharedPayload> payload = SharedPayload::create(std::move(input.bytes));
+
+    for(auto& [port, client] : clients) {
+        if(input.peer != 0 && input.peer != port) continue;
+        uint8_t state = client.getState();
+        if(client.getIsFinSent() || state == static_cast<uint8_t>(STATE::CLOSED) || state == static_cast<uint8_t>(STATE::TIME_WAIT)) continue;
+
+        client.queueStreamData(input.stream, payload);
+        if(state == static_cast<uint8_t>(STATE::ESTABLISHED) || state == static_cast<uint8_t>(STATE::CLOSING)) {
+            sendMessages(client.getPort());
+        }
+    }
+    if(input.peer != 0 && clients.find(input.peer) == clients.end()) {
+        WARNING_SRC("Connection[queueStreamInput] - Dropped %zu bytes for unknown client PORT=%u", inputSize, input.peer);
+    }
+}
+
+void Connection::sendOnStream(uint16_t streamId, std::vector<uint8_t> bytes) {
+    streamQueue.push(StreamInput{0, streamId, std::move(bytes)});
+}
+
+void Connection::sendTo(uint16_t peer, std::vector<uint8_t> bytes, uint16_t streamId) {
+    streamQueue.push(StreamInput{peer, streamId, std::move(bytes)});
+}
+
+bool Connection::sendMessage(uint16_t peer, const std::vector<uint8_t>& message) {
+    if (message.size() > Client::MAX_MESSAGE_SIZE) {
+        WARNING_SRC("Connection[sendMessage] - Message SIZE=%zu exceeds MAX_MESSAGE_SIZE", message.size());
+        return false;
     }
+    streamQueue.push(StreamInput{peer, Client::MESSAGE_STREAM, Client::frameMessage(message)});
+    return true;
+}
+
+bool Connection::broadcastMessage(const std::vector<uint8_t>& message) {
+    return sendMessage(0, message);
+}
+
+bool Connection::receiveMessage(std::pair<uint16_t, std::vector<uint8_t>>& message) {
+    if (!messageQueue.tryPop(message)) return false;
+    std::lock_guard<std::mutex> lock(unreadMessageMtx);
+    auto it = unreadMessageBytes.find(message.first);
+    if (it != unreadMessageBytes.end() && (it->second -= message.second.size()) == 0) unreadMessageBytes.erase(it);
+    return true;
 }
 
 void Connection::disconnect() {
     timeToClose = true;
+    if (!communicationThread.joinable()) {
+        // Manual mode: the caller keeps calling step() until isRunning() turns false; the destructor stops the transport.
+        INFO_SRC("Connection[disconnect] - Close requested in manual mode");
+        return;
+    }
     {
         std::unique_lock<std::mutex> lock(mtx);
         safeToClose.wait(lock, [this] {return canCloseDown;});
     }
     // std::cout << "Safe to Close trigger" << std::endl;
-    socketHandler->stop();
+    // Join first: a transport driven by the communication thread must not be stopped under it.
     if(communicationThread.joinable()) communicationThread.join();
+    transport->stop();
+    transport.reset();
     INFO_SRC("Connection[disconnect] - Closed all threads and connection");
 }
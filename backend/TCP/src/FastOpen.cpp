@@ -0,0 +1,56 @@
+#include <random>
+#include "FastOpen.hpp"
+#include "Logger.hpp"
+
+static uint64_t rotl(uint64_t x, int b) {
+    return (x << b) | (x >> (64 - b));
+}
+
+static void sipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+    v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+    v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+}
+
+// SipHash-2-4 of a 4 byte message: the single (final) block holds the IP and the length.
+static uint64_t sipHash(const uint64_t key[2], uint32_t message) {
+    uint64_t v0 = key[0] ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = key[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = key[0] ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = key[1] ^ 0x7465646279746573ULL;
+    uint64_t block = (static_cast<uint64_t>(4) << 56) | message;
+
+    v3 ^= block;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    v0 ^= block;
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++) sipRound(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+FastOpen::FastOpen() {
+    std::random_device random;
+    for (uint64_t& word : key) word = (static_cast<uint64_t>(random()) << 32) | random();
+}
+
+uint64_t FastOpen::cookieFor(uint32_t clientIP) const {
+    uint64_t cookie = sipHash(key, clientIP);
+    return cookie ? cookie : 1;
+}
+
+bool FastOpen::validCookie(uint32_t clientIP, uint64_t cookie) const {
+    return cookie != 0 && cookie == cookieFor(clientIP);
+}
+
+uint64_t FastOpen::cachedCookie(uint32_t serverIP, uint16_t serverPort) const {
+    auto it = cookies.find(peerKey(serverIP, serverPort));
+    return it == cookies.end() ? 0 : it->second;
+}
+
+void FastOpen::storeCookie(uint32_t serverIP, uint16_t serverPort, uint64_t cookie) {
+    if (!cookie) return;
+    cookies[peerKey(serverIP, serverPort)] = cookie;
+    DEBUG_SRC("FastOpen - Cookie cached for server [IP=%u PORT=%u]", serverIP, serverPort);
+}
@@ -0,0 +1,95 @@
+#include "Fec.hpp"
+#include "Logger.hpp"
+
+static void xorPrefix(uint8_t* out, uint16_t streamId, uint16_t size, uint32_t streamOffset) {
+    out[0] ^= streamId >> 8;
+    out[1] ^= streamId & 0xFF;
+    out[2] ^= size >> 8;
+    out[3] ^= size & 0xFF;
+    out[4] ^= streamOffset >> 24;
+    out[5] ^= (streamOffset >> 16) & 0xFF;
+    out[6] ^= (streamOffset >> 8) & 0xFF;
+    out[7] ^= streamOffset & 0xFF;
+}
+
+static void xorInto(std::vector<uint8_t>& out, const uint8_t* data, size_t size) {
+    if (out.size() < Fec::PREFIX_SIZE + size) out.resize(Fec::PREFIX_SIZE + size, 0);
+    uint8_t* dst = out.data() + Fec::PREFIX_SIZE;
+    for (size_t i = 0; i < size; i++) dst[i] ^= data[i];
+}
+
+uint8_t Fec::add(uint32_t seq, uint16_t streamId, uint32_t streamOffset, const uint8_t* data, uint16_t size) {
+    if (!group_count) {
+        group_first = seq;
+        parity.assign(PREFIX_SIZE, 0);
+    }
+    xorPrefix(parity.data(), streamId, size, streamOffset);
+    xorInto(parity, data, size);
+    group_end = seq + size;
+    return ++group_count;
+}
+
+Fec::Parity Fec::takeParity() {
+    Parity out{group_first, group_end, group_count, std::move(parity)};
+    group_count = 0;
+    parity.clear();
+    return out;
+}
+
+void Fec::onData(const Segment& seg) {
+    if (!enabled || seg.getData().empty()) return;
+    received.try_emplace(seg.getSeqNum(), Received{seg.getStreamId(), seg.getStreamOffset(), seg.getData()});
+    if (received.size() > MAX_CACHED_SEGMENTS) received.erase(received.begin());
+}
+
+bool Fec::onParity(const Segment& seg, Recovered& recovered) {
+    if (!enabled) return false;
+    uint32_t first = seg.getParityFirst();
+    uint32_t end = seg.getParityEnd();
+    const std::vector<uint8_t>& bytes = seg.getData();
+    if (bytes.size() < PREFIX_SIZE || seqLessEqual(end, first)) return false;
+
+    // The group's segments tile [first, end); exactly one gap with every other segment present is repairable.
+    std::vector<uint8_t> acc = bytes;
+    uint32_t next = first;
+    uint32_t gapStart = 0, gapEnd = 0;
+    uint8_t have = 0, gaps = 0;
+    bool tiled = true;
+    auto it = received.lower_bound(first);
+    for (; it != received.end() && seqLess(it->first, end); ++it) {
+        if (seqLess(it->first, next)) {tiled = false; break;}
+        if (seqGreater(it->first, next)) {
+            gaps++;
+            gapStart = next;
+            gapEnd = it->first;
+        }
+        const Received& r = it->second;
+        xorPrefix(acc.data(), r.stream_id, static_cast<uint16_t>(r.data.size()), r.stream_offset);
+        xorInto(acc, r.data.data(), r.data.size());
+        next = it->first + r.data.size();
+        have++;
+    }
+    if (seqLess(next, end)) {
+        gaps++;
+        gapStart = next;
+        gapEnd = end;
+    }
+    else if (seqGreater(next, end)) tiled = false;
+
+    // Groups are sent in order, so nothing below this one is needed any more.
+    received.erase(received.begin(), received.lower_bound(first));
+
+    if (!tiled || gaps != 1 || have + 1 != seg.getParityCount()) return false;
+
+    uint16_t size = (acc[2] << 8) | acc[3];
+    if (size != gapEnd - gapStart || size_t(PREFIX_SIZE) + size > acc.size()) {
+        DEBUG_SRC("Fec - Parity[FIRST=%u END=%u] does not match the gap [%u, %u)", first, end, gapStart, gapEnd);
+        return false;
+    }
+
+    recovered.seq = gapStart;
+    recovered.stream_id = (acc[0] << 8) | acc[1];
+    recovered.stream_offset = (uint32_t(acc[4]) << 24) | (uint32_t(acc[5]) << 16) | (uint32_t(acc[6]) << 8) | acc[7];
+    recovered.data.assign(acc.begin() + PREFIX_SIZE, acc.begin() + PREFIX_SIZE + size);
+    return true;
+}
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstring>
+#include "Lz4.hpp"
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t LAST_LITERALS = 5;          // a block always ends with at least 5 literals
+static constexpr size_t MF_LIMIT = 12;              // no match starts in the last 12 bytes
+static constexpr size_t MAX_OFFSET = 65535;
+static constexpr unsigned MIN_HASH_LOG = 8;
+static constexpr unsigned MAX_HASH_LOG = 12;
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash(uint32_t value, unsigned hashLog) {
+    return (value * 2654435761u) >> (32 - hashLog);
+}
+
+static void writeLength(std::vector<uint8_t>& out, size_t length) {
+    for (; length >= 255; length -= 255) out.push_back(255);
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+// matchLength == 0 writes the final, literals only sequence.
+static void writeSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+    out.push_back(static_cast<uint8_t>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15)));
+    if (literalLength >= 15) writeLength(out, literalLength - 15);
+    out.insert(out.end(), literals, literals + literalLength);
+    if (!matchLength) return;
+
+    out.push_back(offset & 0xFF);
+    out.push_back(offset >> 8);
+    if (matchCode >= 15) writeLength(out, matchCode - 15);
+}
+
+static bool readLength(const uint8_t* src, size_t size, size_t& ip, size_t& length) {
+    if (length != 15) return true;
+    uint8_t byte;
+    do {
+        if (ip >= size) return false;
+        byte = src[ip++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool Lz4::compress(const uint8_t* src, size_t size, std::vector<uint8_t>& out) {
+    out.clear();
+    if (size > MAX_INPUT_SIZE) return false;
+    out.reserve(size);
+    size_t anchor = 0;
+
+    if (size > MF_LIMIT) {
+        // Positions fit 16 bits; the table shrinks with the input so clearing it does not dominate small payloads.
+        unsigned hashLog = MIN_HASH_LOG;
+        while (hashLog < MAX_HASH_LOG && (size_t(1) << (hashLog + 1)) <= size) hashLog++;
+        uint16_t table[1 << MAX_HASH_LOG];
+        std::memset(table, 0, sizeof(uint16_t) << hashLog);
+        size_t limit = size - MF_LIMIT;
+        size_t matchLimit = size - LAST_LITERALS;
+        size_t ip = 0;
+        unsigned misses = 0;
+
+        while (ip < limit) {
+            uint32_t h = hash(read32(src + ip), hashLog);
+            size_t candidate = table[h];
+            table[h] = static_cast<uint16_t>(ip);
+            if (candidate >= ip || ip - candidate > MAX_OFFSET || read32(src + candidate) != read32(src + ip)) {
+                ip += 1 + (misses++ >> 6);                          // step up through incompressible data
+                continue;
+            }
+            misses = 0;
+
+            while (ip > anchor && candidate > 0 && src[ip-1] == src[candidate-1]) {
+                ip--;
+                candidate--;
+            }
+            size_t length = MIN_MATCH;
+            while (ip + length < matchLimit && src[ip+length] == src[candidate+length]) length++;
+
+            writeSequence(out, src + anchor, ip - anchor, ip - candidate, length);
+            if (out.size() >= size) return false;
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    writeSequence(out, src + anchor, size - anchor, 0, 0);
+    return out.size() < size;
+}
+
+bool Lz4::decompress(const uint8_t* src, size_t size, size_t originalSize, std::vector<uint8_t>& out) {
+    out.resize(originalSize);
+    uint8_t* dst = out.data();
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < size) {
+        uint8_t token = src[ip++];
+
+        size_t literalLength = token >> 4;
+        if (!readLength(src, size, ip, literalLength)) return false;
+        if (literalLength > size - ip || literalLength > originalSize - op) return false;
+        if (literalLength) std::memcpy(dst + op, src + ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+        if (ip == size) break;                                      // the last sequence has no match
+
+        if (size - ip < 2) return false;
+        size_t offset = src[ip] | (src[ip+1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        size_t matchLength = token & 0x0F;
+        if (!readLength(src, size, ip, matchLength)) return false;
+        matchLength += MIN_MATCH;
+        if (matchLength > originalSize - op) return false;
+
+        // An overlapping match repeats the last offset bytes; copying one period at a time never overlaps.
+        for (size_t end = op + matchLength; op < end;) {
+            size_t chunk = std::min(offset, end - op);
+            std::memcpy(dst + op, dst + op - offset, chunk);
+            op += chunk;
+        }
+    }
+    return op == originalSize;
+}
@@ -0,0 +1,202 @@
+#include "NetworkSimulator.hpp"
+#include "Connection.hpp"
+#include "Logger.hpp"
+
+SimulatedTransport::SimulatedTransport(
+    NetworkSimulator& simulator,
+    uint16_t port,
+    uint32_t selfIP,
+    ReceiverQueue& receiverQueue,
+    SenderQueue& senderQueue
+)
+:
+    Transport(port, selfIP, receiverQueue, senderQueue),
+    simulator(simulator)
+{
+    INFO_SRC("SimulatedTransport Initialized - [PORT=%u IP=%u]", port, selfIP);
+}
+
+void SimulatedTransport::start() {
+    simulator.registerEndpoint(this);
+}
+
+void SimulatedTransport::stop() {
+    simulator.unregisterEndpoint(this);
+    senderQueue.close();
+    receiverQueue.close();
+}
+
+bool SimulatedTransport::flush() {
+    bool sent = false;
+    std::unique_ptr<Segment> segment;
+    while (senderQueue.tryPop(segment)) {
+        std::vector<uint8_t> msg = prepareOutgoing(*segment);
+        simulator.transmit(selfIP, port, segment->getDestinationIP(), segment->getDestPrt(), std::move(msg));
+        sent = true;
+    }
+    return sent;
+}
+
+void SimulatedTransport::deliver(const std::vector<uint8_t>& bytes, uint32_t sourceIP) {
+    std::unique_ptr<Segment> segment = acceptIncoming(bytes, sourceIP);
+    if (!segment) {
+        WARNING_SRC("SimulatedTransport - Dropped Invalid Segment[IP=%u SIZE=%zu]", sourceIP, bytes.size());
+        return;
+    }
+    if (!receiverQueue.isClosed()) receiverQueue.push(std::move(segment));
+}
+
+NetworkSimulator::NetworkSimulator(uint64_t seed, Clock::duration tick)
+: rng(seed), tick(tick)
+{
+    Clock::enableSimulation();
+    INFO_SRC("NetworkSimulator - Created [seed=%llu]", static_cast<unsigned long long>(seed));
+}
+
+NetworkSimulator::~NetworkSimulator() {
+    Clock::disableSimulation();
+}
+
+void NetworkSimulator::setLink(uint32_t fromIP, uint16_t fromPort, uint32_t toIP, uint16_t toPort, const LinkConfig& config) {
+    links[{key(fromIP, fromPort), key(toIP, toPort)}] = Link{config, {}, false};
+}
+
+NetworkSimulator::Link& NetworkSimulator::linkFor(uint64_t from, uint64_t to) {
+    auto it = links.find({from, to});
+    if (it == links.end()) {
+        it = links.emplace(std::make_pair(from, to), Link{default_link, {}, false}).first;
+    }
+    return it->second;
+}
+
+TransportFactory NetworkSimulator::transportFactory() {
+    return [this](uint16_t port, uint32_t ip, ReceiverQueue& rq, SenderQueue& sq) -> std::unique_ptr<Transport> {
+        return std::make_unique<SimulatedTransport>(*this, port, ip, rq, sq);
+    };
+}
+
+void NetworkSimulator::attach(Connection& connection) {
+    connections.push_back(&connection);
+}
+
+void NetworkSimulator::registerEndpoint(SimulatedTransport* transport) {
+    endpoints[key(transport->getSelfIP(), transport->getPort())].transport = transport;
+}
+
+void NetworkSimulator::unregisterEndpoint(SimulatedTransport* transport) {
+    endpoints.erase(key(transport->getSelfIP(), transport->getPort()));
+}
+
+bool NetworkSimulator::chance(double probability) {
+    if (probability <= 0.0) return false;
+    if (probability >= 1.0) return true;
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng) < probability;
+}
+
+void NetworkSimulator::transmit(uint32_t fromIP, uint16_t fromPort, uint32_t toIP, uint16_t toPort, std::vector<uint8_t> bytes) {
+    uint64_t to = key(toIP, toPort);
+    Link& link = linkFor(key(fromIP, fromPort), to);
+    const LinkConfig& config = link.config;
+    Clock::time_point now = Clock::now();
+    stats.packets_sent++;
+
+    static constexpr size_t IP_UDP_HEADER_SIZE = 28;
+    if (config.mtu && bytes.size() + IP_UDP_HEADER_SIZE > config.mtu) {
+        stats.packets_too_big++;
+        TRACE_SRC("NetworkSimulator - Datagram exceeds MTU [FROM=%u TO=%u SIZE=%zu MTU=%zu]", fromPort, toPort, bytes.size(), config.mtu);
+        return;
+    }
+
+    if (drop_filter && drop_filter(fromIP, fromPort, toIP, toPort, bytes)) {
+        stats.packets_lost++;
+        TRACE_SRC("NetworkSimulator - Filter dropped packet [FROM=%u TO=%u SIZE=%zu]", fromPort, toPort, bytes.size());
+        return;
+    }
+
+    if (link.bad_state) {
+        if (chance(config.burst_end)) link.bad_state = false;
+    } else if (chance(config.burst_start)) {
+        link.bad_state = true;
+    }
+    if (chance(link.bad_state ? config.burst_loss : config.loss)) {
+        stats.packets_lost++;
+        TRACE_SRC("NetworkSimulator - Lost packet [FROM=%u TO=%u SIZE=%zu]", fromPort, toPort, bytes.size());
+        return;
+    }
+
+    Clock::time_point departure = now;
+    if (config.bandwidth_bps > 0.0) {
+        Clock::time_point start = std::max(now, link.busy_until);
+        if (config.queue_limit) {
+            double backlog = std::chrono::duration<double>(start - now).count() * config.bandwidth_bps / 8.0;
+            if (backlog + bytes.size() > config.queue_limit) {
+                stats.packets_queue_dropped++;
+                return;
+            }
+        }
+        auto serialization = std::chrono::duration<double>(bytes.size() * 8.0 / config.bandwidth_bps);
+        departure = start + std::chrono::duration_cast<Clock::duration>(serialization);
+        link.busy_until = departure;
+    }
+
+    Clock::time_point arrival = departure + config.delay;
+    if (config.jitter.count() > 0) {
+        arrival += std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, config.jitter.count())(rng));
+    }
+    if (chance(config.reorder)) {
+        arrival += config.reorder_delay;
+        stats.packets_reordered++;
+    }
+
+    events.push(Event{arrival, next_order++, to, fromIP, std::move(bytes)});
+}
+
+bool NetworkSimulator::pump() {
+    static constexpr int MAX_STEPS = 1024;
+    bool progressed = false;
+    for (Connection* connection : connections) {
+        for (int i = 0; i < MAX_STEPS && connection->step(); i++) progressed = true;
+    }
+    for (auto& [id, endpoint] : endpoints) {
+        if (endpoint.transport->flush()) progressed = true;
+    }
+    return progressed;
+}
+
+bool NetworkSimulator::deliverDue() {
+    bool delivered = false;
+    while (!events.empty() && events.top().time <= Clock::now()) {
+        Event event = std::move(const_cast<Event&>(events.top()));
+        events.pop();
+        auto it = endpoints.find(event.to);
+        if (it == endpoints.end()) continue;
+        stats.packets_delivered++;
+        stats.bytes_delivered += event.bytes.size();
+        it->second.transport->deliver(event.bytes, event.sourceIP);
+        delivered = true;
+    }
+    return delivered;
+}
+
+bool NetworkSimulator::runUntil(const std::function<bool()>& done, Clock::duration limit) {
+    static constexpr int MAX_ROUNDS = 10000;
+    Clock::time_point deadline = Clock::now() + limit;
+
+    while (true) {
+        for (int round = 0; round < MAX_ROUNDS; round++) {
+            bool busy = pump();
+            if (deliverDue()) busy = true;
+            if (!busy) break;
+        }
+        if (done && done()) return true;
+        if (Clock::now() >= deadline) return false;
+
+        Clock::time_point next = Clock::now() + tick;
+        if (!events.empty() && events.top().time < next) next = events.top().time;
+        Clock::setTime(std::min(next, deadline));
+    }
+}
+
+void NetworkSimulator::runFor(Clock::duration duration) {
+    runUntil(nullptr, duration);
+}
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include "PathMtu.hpp"
+#include "Logger.hpp"
+
+// Common path limits are tried first (IPv6 minimum, Ethernet, jumbo frames); after the first size that
+// does not fit, the search halves the gap between the confirmed and the failed size.
+uint16_t PathMtu::nextCandidate(uint16_t ceiling) const {
+    static constexpr uint16_t COMMON_SIZES[] = {1232, 1472, MAX_PLPMTU};
+
+    uint32_t upper = std::min<uint32_t>(failed_size, static_cast<uint32_t>(ceiling) + 1);
+    if (upper <= plpmtu || upper - plpmtu <= SEARCH_GRANULARITY) return 0;
+
+    if (failed_size > MAX_PLPMTU) {
+        for (uint16_t size : COMMON_SIZES) {
+            if (size > plpmtu && size < upper) return size;
+        }
+    }
+    return static_cast<uint16_t>(((plpmtu + upper) / 2) & ~3u);
+}
+
+void PathMtu::completeSearch(Clock::time_point now) {
+    state = State::SEARCH_COMPLETE;
+    probed_size = 0;
+    probe_count = 0;
+    probe_deadline = now + RAISE_TIMER;
+    DEBUG_SRC("PathMtu - Search complete [PLPMTU=%u FAILED=%u]", plpmtu, failed_size);
+}
+
+uint16_t PathMtu::probeToSend(Clock::time_point now, uint16_t ceiling) {
+    if (now < probe_deadline) return 0;
+
+    if (state == State::SEARCH_COMPLETE) {
+        // PMTU_RAISE_TIMER: look for a larger size again in case the path changed.
+        state = State::SEARCHING;
+        failed_size = MAX_PLPMTU + 1;
+    }
+
+    if (probed_size) {
+        if (probe_count < MAX_PROBES) return probed_size;
+        DEBUG_SRC("PathMtu - Probe SIZE=%u unanswered %u times", probed_size, probe_count);
+        failed_size = probed_size;
+        probed_size = 0;
+    }
+
+    uint16_t candidate = nextCandidate(ceiling);
+    if (!candidate) {
+        completeSearch(now);
+        return 0;
+    }
+    probed_size = candidate;
+    probe_count = 0;
+    return probed_size;
+}
+
+void PathMtu::onProbeSent(Clock::time_point now, Clock::duration timeout) {
+    probe_count++;
+    probe_deadline = now + timeout;
+}
+
+void PathMtu::onProbeAck(uint16_t size, Clock::time_point now) {
+    if (size > plpmtu && size < failed_size) {
+        plpmtu = size;
+        DEBUG_SRC("PathMtu - Confirmed PLPMTU=%u", plpmtu);
+    }
+    if (size == probed_size) {
+        probed_size = 0;
+        probe_count = 0;
+        probe_deadline = now;
+    }
+}
+
+void PathMtu::onBlackHole(Clock::time_point now) {
+    WARNING_SRC("PathMtu - Data at PLPMTU=%u keeps timing out, falling back to %u", plpmtu, BASE_PLPMTU);
+    failed_size = plpmtu;
+    plpmtu = BASE_PLPMTU;
+    state = State::SEARCHING;
+    probed_size = 0;
+    probe_count = 0;
+    probe_deadline = now;
+}
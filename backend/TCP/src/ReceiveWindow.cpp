@@ -0,0 +1,51 @@
+#include <algorithm>
+#include "ReceiveWindow.hpp"
+#include "Logger.hpp"
+
+static uint32_t freeSpace(uint32_t buffer, size_t used) {
+    return used >= buffer ? 0 : buffer - static_cast<uint32_t>(used);
+}
+
+uint8_t ReceiveWindow::scaleFor(uint32_t maxBuffer) {
+    uint8_t shift = 0;
+    while (shift < MAX_SCALE && (maxBuffer >> shift) > MAX_WINDOW) shift++;
+    return shift;
+}
+
+void ReceiveWindow::configure(uint32_t initial, uint32_t maximum, bool autotuning) {
+    max_buffer = std::max(maximum, initial);
+    buffer = initial;
+    autotune = autotuning;
+}
+
+// What the application consumed in the last RTT is what arrived minus what is still waiting to be read.
+void ReceiveWindow::adjust(size_t unread, Clock::time_point now, Clock::duration rtt) {
+    if (period_start != Clock::time_point{} && now - period_start < rtt) return;
+
+    if (period_start != Clock::time_point{}) {
+        int64_t consumed = static_cast<int64_t>(delivered - delivered_at_start) + static_cast<int64_t>(unread_at_start) - static_cast<int64_t>(unread);
+        uint64_t target = std::min<uint64_t>(2 * static_cast<uint64_t>(std::max<int64_t>(consumed, 0)), max_buffer);
+        if (target > buffer) {
+            DEBUG_SRC("ReceiveWindow - Reader consumed %lld bytes in %.3f ms, buffer %u -> %llu", static_cast<long long>(consumed),
+                      std::chrono::duration<double, std::milli>(now - period_start).count(), buffer, static_cast<unsigned long long>(target));
+            buffer = static_cast<uint32_t>(target);
+        }
+    }
+    period_start = now;
+    delivered_at_start = delivered;
+    unread_at_start = unread;
+}
+
+uint16_t ReceiveWindow::advertise(size_t unread, size_t reassembly, Clock::time_point now, Clock::duration rtt, bool syn) {
+    if (autotune && buffer < max_buffer) adjust(unread, now, rtt);
+    uint8_t shift = syn ? 0 : scale;
+    uint16_t window = static_cast<uint16_t>(std::min(freeSpace(buffer, unread + reassembly) >> shift, MAX_WINDOW));
+    advertised = static_cast<uint32_t>(window) << shift;
+    return window;
+}
+
+bool ReceiveWindow::updateDue(size_t unread, size_t reassembly, uint32_t segmentSize) const {
+    if (advertised >= segmentSize) return false;
+    uint32_t threshold = std::max(std::min(buffer / 2, segmentSize), 1u << scale);
+    return std::min(freeSpace(buffer, unread + reassembly), MAX_WINDOW << scale) >= advertised + threshold;
+}
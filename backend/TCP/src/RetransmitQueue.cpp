@@ -0,0 +1,27 @@
+#include "RetransmitQueue.hpp"
+
+void RetransmitQueue::grow() {
+    std::vector<SegmentInfo> larger(slots.empty() ? INITIAL_CAPACITY : slots.size() * 2);
+    for (size_t i = 0; i < count; i++) larger[i] = slots[(head + i) & mask()];
+    slots.swap(larger);
+    head = 0;
+}
+
+void RetransmitQueue::push_back(const SegmentInfo& seg) {
+    if (count == slots.size()) grow();
+    slots[(head + count) & mask()] = seg;
+    count++;
+}
+
+void RetransmitQueue::push_front(const SegmentInfo& seg) {
+    if (count == slots.size()) grow();
+    head = (head + mask()) & mask();
+    slots[head] = seg;
+    count++;
+}
+
+void RetransmitQueue::pop_front() {
+    if (!count) return;
+    head = (head + 1) & mask();
+    count--;
+}
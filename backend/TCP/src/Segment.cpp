@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include "Segment.hpp"
+#include "SharedPayload.hpp"
+#include "Lz4.hpp"
 #include "Flags.hpp"
 #include "Logger.hpp"
 
@@ -14,8 +17,8 @@ Segment::Segment(
     uint16_t window,
     uint16_t urgentPtr,
     uint32_t destinationIP,
-    uint32_t start, 
-    uint32_t end
+    uint64_t start, 
+    uint64_t end
 ) 
 :   source_port_address(srcPort), 
     destination_port_address(destPort),
@@ -99,14 +102,78 @@ uint32_t Segment::getDestinationIP() const {
     return destinationIP;
 }
 
-uint32_t Segment::getStart() const {
+uint64_t Segment::getStart() const {
     return start;
 }
 
-uint32_t Segment::getEnd() const {
+uint64_t Segment::getEnd() const {
     return end;
 }
 
+uint16_t Segment::getStreamId() const {
+    return stream_id;
+}
+
+uint32_t Segment::getStreamOffset() const {
+    return stream_offset;
+}
+
+uint8_t Segment::getHeaderSize() const {
+    return header_length * 4;
+}
+
+uint8_t Segment::getProbeOption() const {
+    return probe_option;
+}
+
+uint16_t Segment::getProbeSize() const {
+    return probe_size;
+}
+
+uint8_t Segment::getParityCount() const {
+    return parity_count;
+}
+
+uint32_t Segment::getParityFirst() const {
+    return parity_first;
+}
+
+uint32_t Segment::getParityEnd() const {
+    return parity_end;
+}
+
+uint8_t Segment::getCompressionOffer() const {
+    return compression_offer;
+}
+
+bool Segment::hasWindowScale() const {
+    return window_scale_option;
+}
+
+uint8_t Segment::getWindowScale() const {
+    return window_scale;
+}
+
+bool Segment::hasFastOpen() const {
+    return fast_open_option;
+}
+
+uint64_t Segment::getFastOpenCookie() const {
+    return fast_open_cookie;
+}
+
+uint8_t Segment::getFecOffer() const {
+    return fec_offer;
+}
+
+Clock::time_point Segment::getReceiveTime() const {
+    return receive_time;
+}
+
+bool Segment::getSendTimestamp() const {
+    return send_timestamp;
+}
+
 
 // Setters
 
@@ -134,18 +201,103 @@ void Segment::setData(const std::vector<uint8_t>& payload) {
     data = payload;
 }
 
+void Segment::setSharedPayload(std::shared_ptr<const SharedPayload> payload, uint32_t begin, uint32_t size) {
+    shared_payload = std::move(payload);
+    shared_begin = begin;
+    shared_size = size;
+}
+
+const uint8_t* Segment::payloadData() const {
+    return shared_payload ? shared_payload->data() + shared_begin : data.data();
+}
+
+size_t Segment::payloadSize() const {
+    return shared_payload ? shared_size : data.size();
+}
+
 void Segment::setDestinationIP(uint32_t ip) {
     destinationIP = ip;
 }
 
-void Segment::setStart(uint32_t newStart) {
+void Segment::setStart(uint64_t newStart) {
     start = newStart;
 }
 
-void Segment::setEnd(uint32_t newEnd) {
+void Segment::setEnd(uint64_t newEnd) {
     end = newEnd;
 }
 
+void Segment::setStream(uint16_t id, uint32_t offset) {
+    stream_id = id;
+    stream_offset = offset;
+    updateHeaderLength();
+}
+
+void Segment::setProbe(uint8_t option, uint16_t size) {
+    probe_option = option;
+    probe_size = size;
+    updateHeaderLength();
+}
+
+void Segment::setParity(uint32_t first, uint32_t end, uint8_t count) {
+    parity_first = first;
+    parity_end = end;
+    parity_count = count;
+    updateHeaderLength();
+}
+
+void Segment::setCompressionOffer(uint8_t codec) {
+    compression_offer = codec;
+    updateHeaderLength();
+}
+
+void Segment::setWindowScale(uint8_t shift) {
+    window_scale_option = true;
+    window_scale = shift;
+    updateHeaderLength();
+}
+
+void Segment::setFastOpen(uint64_t cookie) {
+    fast_open_option = true;
+    fast_open_cookie = cookie;
+    updateHeaderLength();
+}
+
+void Segment::setFecOffer(uint8_t groupSize) {
+    fec_offer = groupSize;
+    updateHeaderLength();
+}
+
+void Segment::setReceiveTime(Clock::time_point time) {
+    receive_time = time;
+}
+
+void Segment::setSendTimestamp(bool enabled) {
+    send_timestamp = enabled;
+}
+
+bool Segment::compressPayload() {
+    std::vector<uint8_t> compressed;
+    size_t size = payloadSize();
+    if (original_size || !Lz4::compress(payloadData(), size, compressed)) return false;
+    if (compressed.size() + COMPRESSED_OPTION_SIZE >= size) return false;      // has to pay for its option
+
+    // The stream offset and sequence space still count the original bytes; only the wire carries fewer.
+    data = std::move(compressed);
+    shared_payload.reset();
+    original_size = static_cast<uint16_t>(size);
+    updateHeaderLength();
+    return true;
+}
+
+void Segment::updateHeaderLength() {
+    header_length = (HEADER_SIZE + (stream_id ? STREAM_OPTION_SIZE : 0) + (probe_option ? PROBE_OPTION_SIZE : 0) + (parity_count ? PARITY_OPTION_SIZE : 0)
+        + (compression_offer ? COMPRESSION_OPTION_SIZE : 0) + (original_size ? COMPRESSED_OPTION_SIZE : 0)
+        + (window_scale_option ? WINDOW_SCALE_OPTION_SIZE : 0)
+        + (fast_open_option ? (fast_open_cookie ? FAST_OPEN_OPTION_SIZE : FAST_OPEN_REQUEST_SIZE) : 0)
+        + (fec_offer ? FEC_OPTION_SIZE : 0)) / 4;
+}
+
 
 template<typename T>
 static void appendBits (std::vector<uint8_t>& packet, const T& value) {
@@ -156,10 +308,26 @@ static void appendBits (std::vector<uint8_t>& packet, const T& value) {
     }
 }
 
-std::vector<uint8_t> Segment::encode(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol) {
+static uint32_t pseudoHeaderSum(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, size_t segmentSize) {
+    uint32_t sum = 0;
+    sum += ((sourceIP >> 16) & 0xFFFF) + (sourceIP & 0xFFFF);
+    sum += ((destinationIP >> 16) & 0xFFFF) + (destinationIP & 0xFFFF);
+    sum += static_cast<uint16_t>(protocol);
+    sum += static_cast<uint16_t>(segmentSize);
+    return sum;
+}
+
+static uint16_t foldSum(uint64_t sum) {
+    while (sum > 0xFFFF) {
+        sum = (sum >> 16) + (sum & 0xFFFF);
+    }
+    return static_cast<uint16_t>(sum);
+}
+
+std::vector<uint8_t> Segment::encodeHeader(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, size_t capacity) {
    
     std::vector<uint8_t> packet;
-
+    packet.reserve(std::max<size_t>(capacity, getHeaderSize()));
     
     appendBits(packet, source_port_address); // Source port 
     appendBits(packet, destination_port_address); // Destination port
@@ -171,15 +339,69 @@ std::vector<uint8_t> Segment::encode(uint32_t sourceIP, uint32_t destinationIP,
     packet.push_back(0x00); // check_sum
     packet.push_back(0x00); // check_sum
     appendBits(packet, urgent_pointer); //urgent_point
-    packet.insert(packet.end(), data.begin(), data.end()); // data
+    if (stream_id) {
+        packet.push_back(OPTION_STREAM);
+        packet.push_back(STREAM_OPTION_SIZE);
+        appendBits(packet, stream_id);
+        appendBits(packet, stream_offset);
+    }
+    if (probe_option) {
+        packet.push_back(probe_option);
+        packet.push_back(PROBE_OPTION_SIZE);
+        appendBits(packet, probe_size);
+    }
+    if (parity_count) {
+        packet.push_back(OPTION_PARITY);
+        packet.push_back(PARITY_OPTION_SIZE);
+        appendBits(packet, parity_first);
+        appendBits(packet, parity_end);
+        packet.push_back(parity_count);
+        packet.push_back(0x00);
+    }
+    if (compression_offer) {
+        packet.push_back(OPTION_COMPRESSION);
+        packet.push_back(COMPRESSION_OPTION_SIZE);
+        packet.push_back(compression_offer);
+        packet.push_back(0x00);
+    }
+    if (original_size) {
+        packet.push_back(OPTION_COMPRESSED);
+        packet.push_back(COMPRESSED_OPTION_SIZE);
+        appendBits(packet, original_size);
+    }
+    if (window_scale_option) {
+        packet.push_back(OPTION_WINDOW_SCALE);
+        packet.push_back(WINDOW_SCALE_OPTION_SIZE);
+        packet.push_back(window_scale);
+        packet.push_back(0x00);
+    }
+    if (fast_open_option) {
+        packet.push_back(OPTION_FAST_OPEN);
+        packet.push_back(fast_open_cookie ? FAST_OPEN_OPTION_SIZE : FAST_OPEN_REQUEST_SIZE);
+        packet.push_back(0x00);
+        packet.push_back(0x00);
+        if (fast_open_cookie) appendBits(packet, fast_open_cookie);
+    }
+    if (fec_offer) {
+        packet.push_back(OPTION_FEC);
+        packet.push_back(FEC_OPTION_SIZE);
+        packet.push_back(fec_offer);
+        packet.push_back(0x00);
+    }
 
-    checksum = create_checksum(sourceIP, destinationIP, protocol, packet);
+    // The header is a multiple of 4 bytes, so the payload sum lines up with the packet's 16 bit words.
+    size_t payloadLength = payloadSize();
+    uint16_t payloadSum = shared_payload ? shared_payload->sum(shared_begin, shared_size) : partial_sum(data.data(), data.size());
+    uint64_t sum = pseudoHeaderSum(sourceIP, destinationIP, protocol, packet.size() + payloadLength);
+    sum += partial_sum(packet.data(), packet.size());
+    sum += payloadSum;
+    checksum = ~foldSum(sum);
     
     packet[16] = (checksum >> 8) & 0xFF; // checksum MSB
     packet[17] = checksum & 0xFF; // checksum LSB
     
-    if (packet.size() > 1024) {
-        WARNING_SRC("Segment - Packet Size[%zu] is larger than MAX_SIZE", packet.size());
+    if (packet.size() + payloadLength > MAX_SEGMENT_SIZE) {
+        WARNING_SRC("Segment - Packet Size[%zu] is larger than MAX_SIZE", packet.size() + payloadLength);
     }
 
     TRACE_SRC("Segment[SRCPRT=%u DSTPRT=%u SEQ=%u ACK=%u FLAG=%s] - Encoded", source_port_address, destination_port_address, sequence_number, acknowledgement_number, flagsToStr(flags).c_str());
@@ -187,6 +409,12 @@ std::vector<uint8_t> Segment::encode(uint32_t sourceIP, uint32_t destinationIP,
     return packet;
 }
 
+std::vector<uint8_t> Segment::encode(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol) {
+    std::vector<uint8_t> packet = encodeHeader(sourceIP, destinationIP, protocol, getHeaderSize() + payloadSize());
+    packet.insert(packet.end(), payloadData(), payloadData() + payloadSize()); // data
+    return packet;
+}
+
 template<typename T>
 T combineBytes(const std::vector<uint8_t>& bytes, size_t start) {
     const size_t size = sizeof(T); 
@@ -212,19 +440,92 @@ std::unique_ptr<Segment> Segment::decode(uint32_t sourceIP, uint32_t destination
     uint16_t destPrt = combineBytes<uint16_t>(bytes, 2);
     uint32_t seqNum = combineBytes<uint32_t>(bytes, 4);
     uint32_t ackNum = combineBytes<uint32_t>(bytes, 8);
-    // uint8_t headerLength = bytes[12];
+    size_t headerSize = (bytes[12] >> 4) * 4;
     uint8_t flags = bytes[13];
     uint16_t window = combineBytes<uint16_t>(bytes, 14);
     uint16_t checksum = combineBytes<uint16_t>(bytes, 16);
     uint16_t urgentPtr = combineBytes<uint16_t>(bytes, 18);
 
+    if (headerSize < HEADER_SIZE || headerSize > bytes.size()) {
+        DEBUG_SRC("Segment - Invalid Header Length[%zu]", headerSize);
+        return nullptr;
+    }
+
+    uint16_t streamId = 0;
+    uint32_t streamOffset = 0;
+    uint8_t probeOption = 0;
+    uint16_t probeSize = 0;
+    uint8_t parityCount = 0;
+    uint32_t parityFirst = 0;
+    uint32_t parityEnd = 0;
+    uint8_t compressionOffer = 0;
+    uint16_t originalSize = 0;
+    bool windowScaleOption = false;
+    uint8_t windowScale = 0;
+    bool fastOpenOption = false;
+    uint64_t fastOpenCookie = 0;
+    uint8_t fecOffer = 0;
+    for (size_t i = HEADER_SIZE; i < headerSize;) {
+        uint8_t kind = bytes[i];
+        if (kind == OPTION_END) break;
+        if (kind == OPTION_NOP) {i++; continue;}
+        if (i + 1 >= headerSize || bytes[i+1] < 2 || i + bytes[i+1] > headerSize) {
+            DEBUG_SRC("Segment - Malformed Option[KIND=%u]", kind);
+            return nullptr;
+        }
+        if (kind == OPTION_STREAM && bytes[i+1] == STREAM_OPTION_SIZE) {
+            streamId = combineBytes<uint16_t>(bytes, i+2);
+            streamOffset = combineBytes<uint32_t>(bytes, i+4);
+        }
+        else if ((kind == OPTION_PROBE || kind == OPTION_PROBE_ACK) && bytes[i+1] == PROBE_OPTION_SIZE) {
+            probeOption = kind;
+            probeSize = combineBytes<uint16_t>(bytes, i+2);
+        }
+        else if (kind == OPTION_PARITY && bytes[i+1] == PARITY_OPTION_SIZE) {
+            parityFirst = combineBytes<uint32_t>(bytes, i+2);
+            parityEnd = combineBytes<uint32_t>(bytes, i+6);
+            parityCount = bytes[i+10];
+        }
+        else if (kind == OPTION_COMPRESSION && bytes[i+1] == COMPRESSION_OPTION_SIZE) {
+            compressionOffer = bytes[i+2];
+        }
+        else if (kind == OPTION_COMPRESSED && bytes[i+1] == COMPRESSED_OPTION_SIZE) {
+            originalSize = combineBytes<uint16_t>(bytes, i+2);
+        }
+        else if (kind == OPTION_WINDOW_SCALE && bytes[i+1] == WINDOW_SCALE_OPTION_SIZE) {
+            windowScaleOption = true;
+            windowScale = bytes[i+2];
+        }
+        else if (kind == OPTION_FAST_OPEN && (bytes[i+1] == FAST_OPEN_OPTION_SIZE || bytes[i+1] == FAST_OPEN_REQUEST_SIZE)) {
+            fastOpenOption = true;
+            if (bytes[i+1] == FAST_OPEN_OPTION_SIZE) fastOpenCookie = combineBytes<uint64_t>(bytes, i+4);
+        }
+        else if (kind == OPTION_FEC && bytes[i+1] == FEC_OPTION_SIZE) {
+            fecOffer = bytes[i+2];
+        }
+        i += bytes[i+1];
+    }
+
     std::vector<uint8_t> payload;
-    if (bytes.size() > 20) {
-        copy(bytes.begin() + 20, bytes.end(), back_inserter(payload));
+    if (originalSize) {
+        if (!Lz4::decompress(bytes.data() + headerSize, bytes.size() - headerSize, originalSize, payload)) {
+            DEBUG_SRC("Segment - Invalid Compressed Payload[SIZE=%zu ORIGINAL=%u]", bytes.size() - headerSize, originalSize);
+            return nullptr;
+        }
+    }
+    else if (bytes.size() > headerSize) {
+        copy(bytes.begin() + headerSize, bytes.end(), back_inserter(payload));
     }
     
     std::unique_ptr<Segment> segment = std::make_unique<Segment>(srcPrt, destPrt, seqNum, ackNum, flags, window, urgentPtr, sourceIP, std::move(payload));
     segment->checksum = checksum;
+    segment->setStream(streamId, streamOffset);
+    if (probeOption) segment->setProbe(probeOption, probeSize);
+    if (parityCount) segment->setParity(parityFirst, parityEnd, parityCount);
+    if (compressionOffer) segment->setCompressionOffer(compressionOffer);
+    if (windowScaleOption) segment->setWindowScale(windowScale);
+    if (fastOpenOption) segment->setFastOpen(fastOpenCookie);
+    if (fecOffer) segment->setFecOffer(fecOffer);
 
     TRACE_SRC("Segment Decoded - [SRCPRT=%u DSTPRT=%u SEQ=%u ACK=%u FLAG=%s WINDOW=%u CHKSUM=%u URGPTR=%u SRCIP=%u DATASIZE=%zu]", 
         srcPrt, destPrt, seqNum, ackNum, flagsToStr(flags).c_str(), window, checksum, urgentPtr, sourceIP, segment->getData().size());
@@ -232,28 +533,21 @@ std::unique_ptr<Segment> Segment::decode(uint32_t sourceIP, uint32_t destination
     return segment;
 }
 
-static uint32_t calculateCheckSum (uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, const std::vector<uint8_t>& bytes) {
-    size_t segmentSize = bytes.size();
-    uint32_t sum = 0;
-
-    sum += ((sourceIP >> 16) & 0xFFFF) + (sourceIP & 0xFFFF);
-    sum += ((destinationIP >> 16) & 0xFFFF) + (destinationIP & 0xFFFF);
-    sum += static_cast<uint16_t>(protocol);
-    sum += static_cast<uint16_t>(segmentSize);
-
-    for (size_t i = 0; i < segmentSize; i+=2) {
-        if (i+1 == segmentSize) {
-            sum += uint16_t((bytes[i] << 8) & 0xFFFF);
-        } else {
-            sum += uint16_t(((bytes[i] << 8) & 0xFFFF) | bytes[i+1]);
-        }
+uint16_t Segment::partial_sum(const uint8_t* bytes, size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i + 1 < size; i+=2) {
+        sum += uint16_t((bytes[i] << 8) | bytes[i+1]);
     }
-
-    while (sum > 0xFFFF) {
-        sum = (sum >> 16) + (sum & 0xFFFF);
+    if (size & 1) {
+        sum += uint16_t(bytes[size-1] << 8);
     }
-    
-    return sum;
+    return foldSum(sum);
+}
+
+static uint32_t calculateCheckSum (uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, const std::vector<uint8_t>& bytes) {
+    uint64_t sum = pseudoHeaderSum(sourceIP, destinationIP, protocol, bytes.size());
+    sum += Segment::partial_sum(bytes.data(), bytes.size());
+    return foldSum(sum);
 }
 
 uint16_t Segment::create_checksum(uint32_t sourceIP, uint32_t destinationIP, uint8_t protocol, const std::vector<uint8_t>& bytes) {
@@ -0,0 +1,51 @@
+#include "SharedPayload.hpp"
+
+// Unfolded sum of [from, to) in the payload's own word alignment (even offsets are high bytes).
+static uint64_t alignedSum(const uint8_t* bytes, uint32_t from, uint32_t to) {
+    uint64_t sum = 0;
+    if (from < to && (from & 1)) sum += bytes[from++];
+    for (; from + 1 < to; from += 2) {
+        sum += uint16_t((bytes[from] << 8) | bytes[from+1]);
+    }
+    if (from < to) sum += uint16_t(bytes[from] << 8);
+    return sum;
+}
+
+SharedPayload::SharedPayload(std::vector<uint8_t> payload)
+:   bytes(std::move(payload))
+{
+    block_sums.reserve(bytes.size() / SUM_BLOCK + 1);
+    block_sums.push_back(0);
+    for (uint32_t offset = SUM_BLOCK; offset <= bytes.size(); offset += SUM_BLOCK) {
+        block_sums.push_back(block_sums.back() + alignedSum(bytes.data(), offset - SUM_BLOCK, offset));
+    }
+}
+
+std::shared_ptr<const SharedPayload> SharedPayload::create(std::vector<uint8_t> payload) {
+    return std::make_shared<const SharedPayload>(std::move(payload));
+}
+
+uint16_t SharedPayload::sum(uint32_t begin, uint32_t length) const {
+    uint32_t end = begin + length;
+    uint32_t firstBlock = (begin + SUM_BLOCK - 1) / SUM_BLOCK;
+    uint32_t lastBlock = end / SUM_BLOCK;
+
+    uint64_t total;
+    if (firstBlock >= lastBlock) {
+        total = alignedSum(bytes.data(), begin, end);
+    } else {
+        total = alignedSum(bytes.data(), begin, firstBlock * SUM_BLOCK)
+              + (block_sums[lastBlock] - block_sums[firstBlock])
+              + alignedSum(bytes.data(), lastBlock * SUM_BLOCK, end);
+    }
+
+    while (total > 0xFFFF) {
+        total = (total >> 16) + (total & 0xFFFF);
+    }
+    uint16_t folded = static_cast<uint16_t>(total);
+
+    // Starting on an odd offset swaps the role of every byte in the packet; ones' complement sums are
+    // byte order independent (RFC 1071), so swapping the folded sum is enough.
+    if (begin & 1) folded = static_cast<uint16_t>((folded << 8) | (folded >> 8));
+    return folded;
+}
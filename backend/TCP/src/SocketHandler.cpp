@@ -2,111 +2,357 @@
 #include "Flags.hpp"
 #include "Logger.hpp"
 #include "ErrorTest.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <ctime>
+#include <netinet/udp.h>
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#endif
+
+static constexpr size_t MAX_PENDING_STAMPS = 64;                // TX stamps the kernel never delivered are dropped past this
+static constexpr size_t BUSY_QUEUE_CAPACITY = 4096;             // segments each way between the busy polling threads and the connection
+static constexpr int BUSY_POLL_USEC = 50;                       // SO_BUSY_POLL: device queue spin per receive call
+
+// Kernel timestamps are CLOCK_REALTIME; carry their age over to the transport Clock.
+Clock::time_point SocketHandler::fromKernelTime(const struct timespec& stamp) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t age = (int64_t(now.tv_sec) - stamp.tv_sec) * 1000000000LL + (now.tv_nsec - stamp.tv_nsec);
+    return Clock::now() - std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(std::max<int64_t>(age, 0)));
+}
+
+// gso_size of a datagram the kernel coalesced (UDP_GRO), 0 for a single segment.
+size_t SocketHandler::findGroSize(struct msghdr& message) {
+#ifdef UDP_GRO
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int size;
+            memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+            return size > 0 ? static_cast<size_t>(size) : 0;
+        }
+    }
+#endif
+    return 0;
+}
+
+const struct timespec* SocketHandler::findTimestamp(struct msghdr& message) {
+#ifdef SO_TIMESTAMPING
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPING) {
+            const struct timespec* stamps = reinterpret_cast<const struct timespec*>(CMSG_DATA(cmsg));
+            if (stamps[0].tv_sec || stamps[0].tv_nsec) return &stamps[0];     // [0] = software stamp
+        }
+    }
+#else
+    (void)message;
+#endif
+    return nullptr;
+}
 
 SocketHandler::SocketHandler (
     uint16_t port,
     uint32_t selfIP,
-    ThreadSafeQueue<std::unique_ptr<Segment>>& receiverQueue,
-    ThreadSafeQueue<std::pair<std::unique_ptr<Segment>, std::function<void()>>>& senderQueue,
-    std::vector<uint8_t>& sendBuffer
+    ReceiverQueue& receiverQueue,
+    SenderQueue& senderQueue
 )
 :
-    receiverQueue(receiverQueue),
-    senderQueue(senderQueue),
-    sendBuffer(sendBuffer),
-    socketfd(-1),
-    port(port),
-    selfIP(selfIP)
+    Transport(port, selfIP, receiverQueue, senderQueue),
+    socketfd(-1)
 {
     INFO_SRC("SocketHandler Initialized - [PORT=%u IP=%u]", port, selfIP);
 }
 
 void SocketHandler::receive() {
-    static constexpr size_t BUFFER_SIZE = 1024;
+    static constexpr size_t BUFFER_SIZE = Segment::MAX_SEGMENT_SIZE;  // probed paths can carry more than the base segment
     std::vector<uint8_t> packet(BUFFER_SIZE);
-    socklen_t len;
+    alignas(struct cmsghdr) char control[CONTROL_BUFFER_SIZE];
     struct sockaddr_in senaddr{};
     int n;
     memset(&senaddr, 0, sizeof(senaddr));
+    ThreadPlacement::apply("tcp-receiver");
     INFO_SRC("SockerHandler[Receiver] - Thread Started");
+    Clock::time_point lastPacket = Clock::now();
     
     while (running){
-        len = sizeof(senaddr);
+        struct iovec iov{packet.data(), BUFFER_SIZE};
+        struct msghdr message{};
+        message.msg_name = &senaddr;
+        message.msg_namelen = sizeof(senaddr);
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
 
-        n = recvfrom(socketfd, reinterpret_cast<char *>(packet.data()), BUFFER_SIZE, 0, (struct sockaddr *) &senaddr, &len);
+        // Busy poll: non-blocking receives until the socket has been quiet for busy_poll, then block again.
+        bool spin = spinning && Clock::now() - lastPacket < busy_poll;
+        n = recvmsg(socketfd, &message, spin ? MSG_DONTWAIT : 0);
 
         if (n > 0) {
+            if (spinning) lastPacket = Clock::now();
             TRACE_SRC("SocketHandler[Receiver] - New Packet Arrived SIZE=%i", n);
-            std::vector<uint8_t> payload(packet.begin(), packet.begin()+n);
-            uint32_t sourceIP = ntohl(senaddr.sin_addr.s_addr);
-            uint8_t protocol = 6;
-            std::unique_ptr<Segment> segment = Segment::decode(sourceIP, selfIP, protocol, payload);
-            if (segment && decodeFlags(segment->getFlags()) != FlagType::INVALID) {
-                segment->setDestinationIP(sourceIP);
-                TRACE_SRC("SocketHandler[Receiver] - New Packet Valid [IP=%u PORT=%u SEQ=%u ACK=%u FLAG=%s]", sourceIP, segment->getSrcPrt(), segment->getSeqNum(), segment->getAckNum(), flagsToStr(segment->getFlags()).c_str());
-                receiverQueue.push(std::move(segment));
-            } else {
-                WARNING_SRC("SocketHandler[Receiver] - Dropped Invalid Segment[IP=%u PORT=%u SIZE=%d]", sourceIP, ntohs(senaddr.sin_port), n);
-            }
+            deliverDatagram(packet.data(), static_cast<size_t>(n), message, ntohl(senaddr.sin_addr.s_addr), ntohs(senaddr.sin_port));
         }
         else if (n < 0) {
             if(!running) break;
             if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (spin) std::this_thread::yield();
                 continue;
             } else {
-                ERROR_SRC("SocketHandler[Receiver] - recvfrom() failure");
+                ERROR_SRC("SocketHandler[Receiver] - recvmsg() failure");
+            }
+        }
+    }
+}
+
+// Splits a datagram into segments (several when the kernel coalesced them) and queues the valid ones for Connection.
+void SocketHandler::deliverDatagram(const uint8_t* packet, size_t size, struct msghdr& message, uint32_t sourceIP, uint16_t sourcePort) {
+    Clock::time_point received{};
+    if (const struct timespec* stamp = findTimestamp(message)) received = fromKernelTime(*stamp);
+
+    // A GRO datagram holds back to back segments of gso_size bytes, the last one possibly shorter.
+    size_t groSize = findGroSize(message);
+    size_t step = groSize ? groSize : size;
+    for (size_t offset = 0; offset < size; offset += step) {
+        size_t length = std::min(step, size - offset);
+        std::vector<uint8_t> payload(packet + offset, packet + offset + length);
+        std::unique_ptr<Segment> segment = acceptIncoming(payload, sourceIP);
+        if (segment) {
+            segment->setReceiveTime(received);
+            TRACE_SRC("SocketHandler[Receiver] - New Packet Valid [IP=%u PORT=%u SEQ=%u ACK=%u FLAG=%s]", sourceIP, segment->getSrcPrt(), segment->getSeqNum(), segment->getAckNum(), flagsToStr(segment->getFlags()).c_str());
+            if (spinning) {
+                while (!busyReceiveQueue->tryPush(std::move(segment)) && running) std::this_thread::yield();
+            } else {
+                receiverQueue.push(std::move(segment));
             }
+        } else {
+            WARNING_SRC("SocketHandler[Receiver] - Dropped Invalid Segment[IP=%u PORT=%u SIZE=%zu]", sourceIP, sourcePort, length);
         }
     }
 }
 
 void SocketHandler::send() {
+    ThreadPlacement::apply("tcp-sender");
     INFO_SRC("SocketHandler[Sender] - Thread Started");
+    std::unique_ptr<Segment> carry;                                 // popped while building a train but could not join it
+    std::vector<std::unique_ptr<Segment>> train;
+    Clock::time_point lastSend = Clock::now();
 
     while (running) {
-        
-        auto opt_item = senderQueue.pop();
-        
-        if (!opt_item) {
-            WARNING_SRC("SocketHandler[Sender] - Sender queue return nullptr, ignoring response");
-        }
-        else {
-            std::pair<std::unique_ptr<Segment>, std::function<void()>> item = std::move(*opt_item);
-            std::unique_ptr<Segment> segment = std::move(item.first);
-            struct sockaddr_in senaddr{};
-            memset(&senaddr, 0, sizeof(senaddr));
-
-            senaddr.sin_family = AF_INET;
-            senaddr.sin_port = htons(segment->getDestPrt()); // target port
-            senaddr.sin_addr.s_addr = htonl(segment->getDestinationIP()); // target IP
-            
-            uint8_t protocol = 6;
-
-            if(segment->getEnd() && segment->getStart() >= 0){
-                segment->setData(std::vector<uint8_t>(sendBuffer.begin() + segment->getStart(), sendBuffer.begin() + segment->getEnd()));
+        std::unique_ptr<Segment> segment = std::move(carry);
+        if (!segment && !nextSend(segment, lastSend)) continue;
+        if (spinning) lastSend = Clock::now();
+
+        if (segment_offload) {
+            train.clear();
+            train.push_back(std::move(segment));
+            collectTrain(train, carry);
+            if (train.size() > 1) {
+                sendTrain(train);
+                continue;
             }
+            segment = std::move(train.front());
+        }
+        sendSegment(*segment);
+        // Software TX stamps are taken as the datagram reaches the driver, normally before sendmsg() returns.
+        if (!pending_stamps.empty()) readSendTimestamps();
+    }
+}
 
-            std::vector<uint8_t> msg = segment->encode(selfIP, segment->getDestinationIP(), protocol);
-            
-            DEBUG_SRC("SocketHandler[Sender] - Preparing packet to send[IP=%u DSTPRT=%u SEQ=%u ACK=%u FLAGS=%s]", segment->getDestinationIP(), segment->getDestPrt(), segment->getSeqNum(), segment->getAckNum(), flagsToStr(segment->getFlags()).c_str()); 
+// Busy poll: spin on busySendQueue while the last send is recent and park once it is not. Otherwise block on senderQueue.
+bool SocketHandler::nextSend(std::unique_ptr<Segment>& segment, Clock::time_point lastSend) {
+    if (spinning) {
+        if (busySendQueue->tryPop(segment)) return true;
+        if (Clock::now() - lastSend < busy_poll) std::this_thread::yield();
+        else parkSender();
+        return false;
+    }
+    auto opt_item = senderQueue.pop();
+    if (!opt_item) {
+        WARNING_SRC("SocketHandler[Sender] - Sender queue return nullptr, ignoring response");
+        return false;
+    }
+    segment = std::move(*opt_item);
+    return true;
+}
 
-            int n;
-            if ((n = sendto(socketfd, reinterpret_cast<const char *>(msg.data()), msg.size(), 0, (sockaddr*)&senaddr, sizeof(senaddr))) < 0) {
-                ERROR_SRC("SocketHandler[Sender] - sendto() failure");
-            } else {
-                TRACE_SRC("SocketHandler[Sender] - Successfully sent %i bytes", n);
-                if(item.second) {
-                    item.second();
-                    TRACE_SRC("SocketHandler[Sender] - set time seent");
-                }
-            }
-            
+// Marks the sender parked before looking at the ring one last time, so pushSend() either leaves a segment this
+// check sees or finds the flag set and wakes it.
+void SocketHandler::parkSender() {
+    senderParked = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+        std::unique_lock<std::mutex> lock(sendWakeMtx);
+        sendWake.wait(lock, [this] {return !busySendQueue->empty() || !running;});
+    }
+    senderParked = false;
+}
+
+void SocketHandler::prepareMessage(Segment& segment, Outgoing& out) {
+    out.address.sin_family = AF_INET;
+    out.address.sin_port = htons(segment.getDestPrt()); // target port
+    out.address.sin_addr.s_addr = htonl(segment.getDestinationIP()); // target IP
+
+    // Header and payload go out as two iovecs so a shared broadcast payload is never copied per peer.
+    out.header = prepareHeader(segment);
+    out.iov[0].iov_base = out.header.data();
+    out.iov[0].iov_len = out.header.size();
+    out.iov[1].iov_base = const_cast<uint8_t*>(segment.payloadData());
+    out.iov[1].iov_len = segment.payloadSize();
+
+    out.message = {};
+    out.message.msg_name = &out.address;
+    out.message.msg_namelen = sizeof(out.address);
+    out.message.msg_iov = out.iov;
+    out.message.msg_iovlen = out.iov[1].iov_len ? 2 : 1;
+
+    // Per message request: only the RTT tracker pays for a TX stamp.
+    out.stamp = timestamping && segment.getSendTimestamp();
+#ifdef SO_TIMESTAMPING
+    if (out.stamp) {
+        out.message.msg_control = out.control;
+        out.message.msg_controllen = sizeof(out.control);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&out.message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SO_TIMESTAMPING;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+        uint32_t flags = SOF_TIMESTAMPING_TX_SOFTWARE;
+        memcpy(CMSG_DATA(cmsg), &flags, sizeof(flags));
+    }
+#endif
+}
+
+void SocketHandler::finishSend(const Segment& segment, const Outgoing& out, int result) {
+    if (result < 0) {
+        if (result == -EMSGSIZE) {
+            // Larger than the local interface MTU; a path MTU probe that does not fit, handled like a lost one.
+            DEBUG_SRC("SocketHandler[Sender] - sendmsg() SIZE=%zu exceeds the interface MTU", out.header.size() + segment.payloadSize());
+        } else {
+            ERROR_SRC("SocketHandler[Sender] - sendmsg() failure (errno=%d)", -result);
         }
+        return;
+    }
+    TRACE_SRC("SocketHandler[Sender] - Successfully sent %i bytes", result);
+    if (out.stamp) {
+        pending_stamps.emplace_back(stamped_sends++, SendTimestamp{segment.getDestinationIP(), segment.getDestPrt(), segment.getSeqNum(), {}});
+        if (pending_stamps.size() > MAX_PENDING_STAMPS) pending_stamps.pop_front();
     }
 }
 
+void SocketHandler::sendSegment(Segment& segment) {
+    Outgoing out;
+    prepareMessage(segment, out);
 
-void SocketHandler::start() {
+    DEBUG_SRC("SocketHandler[Sender] - Preparing packet to send[IP=%u DSTPRT=%u SEQ=%u ACK=%u FLAGS=%s]", segment.getDestinationIP(), segment.getDestPrt(), segment.getSeqNum(), segment.getAckNum(), flagsToStr(segment.getFlags()).c_str()); 
+
+    int n = sendmsg(socketfd, &out.message, 0);
+    finishSend(segment, out, n < 0 ? -errno : n);
+}
+
+// Segments that can ride with train.front(): same peer, every one but the last exactly the size of the first.
+// Probes (sized on purpose) and segments that want a TX stamp always go out alone.
+void SocketHandler::collectTrain(std::vector<std::unique_ptr<Segment>>& train, std::unique_ptr<Segment>& carry) {
+    auto alone = [](const Segment& seg) {return seg.getProbeOption() == Segment::OPTION_PROBE || seg.getSendTimestamp();};
+    const Segment& first = *train.front();
+    if (alone(first)) return;
+
+    size_t size = first.getHeaderSize() + first.payloadSize();
+    size_t total = size;
+    std::unique_ptr<Segment> next;
+    while (train.size() < MAX_TRAIN_SEGMENTS && (spinning ? busySendQueue->tryPop(next) : senderQueue.tryPop(next))) {
+        size_t nextSize = next->getHeaderSize() + next->payloadSize();
+        if (alone(*next) || next->getDestinationIP() != first.getDestinationIP() || next->getDestPrt() != first.getDestPrt()
+            || nextSize > size || total + nextSize > MAX_TRAIN_BYTES) {
+            carry = std::move(next);
+            return;
+        }
+        total += nextSize;
+        train.push_back(std::move(next));
+        if (nextSize < size) return;                                // a shorter segment can only be the last
+    }
+}
+
+void SocketHandler::sendTrain(std::vector<std::unique_ptr<Segment>>& train) {
+#ifdef UDP_SEGMENT
+    const Segment& first = *train.front();
+    struct sockaddr_in senaddr{};
+    senaddr.sin_family = AF_INET;
+    senaddr.sin_port = htons(first.getDestPrt());
+    senaddr.sin_addr.s_addr = htonl(first.getDestinationIP());
+
+    std::vector<std::vector<uint8_t>> headers;
+    std::vector<struct iovec> iov;
+    headers.reserve(train.size());
+    iov.reserve(2 * train.size());
+    for (auto& seg : train) {
+        headers.push_back(prepareHeader(*seg));
+        iov.push_back({headers.back().data(), headers.back().size()});
+        if (seg->payloadSize()) iov.push_back({const_cast<uint8_t*>(seg->payloadData()), seg->payloadSize()});
+    }
+
+    struct msghdr message{};
+    message.msg_name = &senaddr;
+    message.msg_namelen = sizeof(senaddr);
+    message.msg_iov = iov.data();
+    message.msg_iovlen = iov.size();
+
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(uint16_t))]{};
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    uint16_t segmentSize = first.getHeaderSize() + first.payloadSize();
+    memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+
+    int n = sendmsg(socketfd, &message, 0);
+    if (n >= 0) {
+        TRACE_SRC("SocketHandler[Sender] - Sent %zu segments of %u bytes in one datagram train [IP=%u PORT=%u]", train.size(), segmentSize, first.getDestinationIP(), first.getDestPrt());
+        return;
+    }
+    // EIO: the device cannot checksum the segments; anything else (EINVAL, EMSGSIZE) is a size the kernel refuses.
+    WARNING_SRC("SocketHandler[Sender] - UDP_SEGMENT send failed (errno=%d), sending segments one by one from now on", errno);
+    segment_offload = false;
+#endif
+    for (auto& seg : train) sendSegment(*seg);
+}
+
+// Matches the stamps on the socket error queue to the segments that asked for them by their OPT_ID.
+void SocketHandler::readSendTimestamps() {
+#ifdef SO_TIMESTAMPING
+    alignas(struct cmsghdr) char control[CONTROL_BUFFER_SIZE];
+    while (!pending_stamps.empty()) {
+        struct msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(socketfd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+        const struct timespec* stamp = findTimestamp(message);
+        const struct sock_extended_err* error = nullptr;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                error = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cmsg));
+            }
+        }
+        if (!stamp || !error || error->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) continue;
+
+        while (!pending_stamps.empty() && static_cast<int32_t>(pending_stamps.front().first - error->ee_data) < 0) pending_stamps.pop_front();
+        if (pending_stamps.empty() || pending_stamps.front().first != error->ee_data) continue;
+
+        SendTimestamp sent = pending_stamps.front().second;
+        pending_stamps.pop_front();
+        sent.time = fromKernelTime(*stamp);
+        TRACE_SRC("SocketHandler[Sender] - TX timestamp [IP=%u PORT=%u SEQ=%u ID=%u]", sent.ip, sent.port, sent.seq, error->ee_data);
+        sendTimestamps.push(sent);
+    }
+#endif
+}
+
+void SocketHandler::openSocket() {
     INFO_SRC("SocketHandler[Start] - Attempting Initialization");
     if ((socketfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ) {  
         ERROR_SRC("SocketHandler[Start] - Socket Creation Failure");
@@ -126,6 +372,68 @@ void SocketHandler::start() {
         exit(EXIT_FAILURE);
     }
 
+    // Path MTU discovery is done by Connection (PathMtu): set DF but ignore the kernel's PMTU cache so probes go out as sized.
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
+    int pmtuDiscover = IP_PMTUDISC_PROBE;
+    if (setsockopt(socketfd, IPPROTO_IP, IP_MTU_DISCOVER, &pmtuDiscover, sizeof(pmtuDiscover)) < 0) {
+        WARNING_SRC("SocketHandler[Start] - IP_MTU_DISCOVER not supported, datagrams may be fragmented");
+    }
+#elif defined(IP_DONTFRAG)
+    int dontFragment = 1;
+    if (setsockopt(socketfd, IPPROTO_IP, IP_DONTFRAG, &dontFragment, sizeof(dontFragment)) < 0) {
+        WARNING_SRC("SocketHandler[Start] - IP_DONTFRAG not supported, datagrams may be fragmented");
+    }
+#endif
+
+#ifdef SO_TIMESTAMPING
+    uint32_t timestampFlags = SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    if (setsockopt(socketfd, SOL_SOCKET, SO_TIMESTAMPING, &timestampFlags, sizeof(timestampFlags)) < 0) {
+        WARNING_SRC("SocketHandler[Start] - SO_TIMESTAMPING not supported, RTT samples use user space times");
+    } else {
+        timestamping = true;
+    }
+#endif
+
+    if (segment_offload) {
+#if defined(UDP_SEGMENT) && defined(UDP_GRO)
+        int zero = 0, one = 1;
+        if (setsockopt(socketfd, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) < 0) {
+            WARNING_SRC("SocketHandler[Start] - UDP_SEGMENT not supported, segment offload off");
+            segment_offload = false;
+        }
+        else if (setsockopt(socketfd, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0) {
+            WARNING_SRC("SocketHandler[Start] - UDP_GRO not supported, receiving segments one datagram at a time");
+        }
+#else
+        segment_offload = false;
+#endif
+        INFO_SRC("SocketHandler[Start] - Segment offload %s", segment_offload ? "on" : "off");
+    }
+
+    if (busy_poll > Clock::duration::zero()) {
+#ifdef SO_BUSY_POLL
+        int busyPollUsec = BUSY_POLL_USEC;
+        if (setsockopt(socketfd, SOL_SOCKET, SO_BUSY_POLL, &busyPollUsec, sizeof(busyPollUsec)) < 0) {
+            WARNING_SRC("SocketHandler[Start] - SO_BUSY_POLL not permitted, spinning in user space only");
+        }
+#endif
+        INFO_SRC("SocketHandler[Start] - Busy poll for %lld us after the last packet", static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(busy_poll).count()));
+    }
+
+    // Datagrams queue here until the receiver thread reads them, so the socket has to hold a whole receive window.
+    if (receive_buffer) {
+        int wanted = static_cast<int>(std::min<size_t>(receive_buffer, INT_MAX));
+        int granted = 0;
+        socklen_t length = sizeof(granted);
+        if (setsockopt(socketfd, SOL_SOCKET, SO_RCVBUF, &wanted, sizeof(wanted)) < 0 || getsockopt(socketfd, SOL_SOCKET, SO_RCVBUF, &granted, &length) < 0) {
+            WARNING_SRC("SocketHandler[Start] - SO_RCVBUF not supported, keeping the default receive buffer");
+            receive_buffer = 0;
+        } else {
+            receive_buffer = static_cast<size_t>(granted) / 2;             // the kernel doubles it for its own bookkeeping
+            INFO_SRC("SocketHandler[Start] - Receive buffer %zu bytes (wanted %d)", receive_buffer, wanted);
+        }
+    }
+
     struct timeval tv = { .tv_sec = 5, .tv_usec=0};
     
     INFO_SRC("SocketHandler[Start] - Setting timeout for socket [SEC=%ld USEC=%ld]", (long)tv.tv_sec, (long)tv.tv_usec);
@@ -133,18 +441,52 @@ void SocketHandler::start() {
         ERROR_SRC("SocketHandler[Start] - Set Timeout Failure");
         exit(EXIT_FAILURE);
     }
-    
+}
+
+void SocketHandler::start() {
+    openSocket();
+    startThreads();
+}
+
+void SocketHandler::startThreads() {
     running = true;
+    if (busy_poll > Clock::duration::zero()) {
+        busyReceiveQueue = std::make_unique<SpscQueue<std::unique_ptr<Segment>>>(BUSY_QUEUE_CAPACITY);
+        busySendQueue = std::make_unique<SpscQueue<std::unique_ptr<Segment>>>(BUSY_QUEUE_CAPACITY);
+        spinning = true;
+    }
     receiverThread = std::thread(&SocketHandler::receive, this);
     senderThread = std::thread(&SocketHandler::send, this);
     INFO_SRC("SocketHandler[Start] - Initialized\tReceiver & Sender Thread Called");
 }
 
+bool SocketHandler::pushSend(std::unique_ptr<Segment>& segment) {
+    if (!spinning) return false;
+    while (!busySendQueue->tryPush(std::move(segment))) {
+        if (!running) return true;                                  // stopped: nothing will send it anyway
+        std::this_thread::yield();
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);           // pairs with parkSender()
+    if (senderParked) {
+        std::lock_guard<std::mutex> lock(sendWakeMtx);
+        sendWake.notify_one();
+    }
+    return true;
+}
+
+bool SocketHandler::popReceived(std::unique_ptr<Segment>& segment) {
+    return spinning && busyReceiveQueue->tryPop(segment);
+}
+
 void SocketHandler::stop() {
     INFO_SRC("SocketHandler[Stop] - Called to now safely close sockets.");
     running = false;
     senderQueue.close();
     receiverQueue.close();
+    {
+        std::lock_guard<std::mutex> lock(sendWakeMtx);
+        sendWake.notify_all();
+    }
     shutdown(socketfd, SHUT_RDWR);
     if(receiverThread.joinable()) receiverThread.join();
     if(senderThread.joinable()) senderThread.join();
@@ -0,0 +1,31 @@
+#include "Transport.hpp"
+#include "Flags.hpp"
+#include "Logger.hpp"
+
+Transport::Transport(
+    uint16_t port,
+    uint32_t selfIP,
+    ReceiverQueue& receiverQueue,
+    SenderQueue& senderQueue
+)
+:
+    receiverQueue(receiverQueue),
+    senderQueue(senderQueue),
+    port(port),
+    selfIP(selfIP)
+{}
+
+std::vector<uint8_t> Transport::prepareOutgoing(Segment& segment) {
+    return segment.encode(selfIP, segment.getDestinationIP(), PROTOCOL);
+}
+
+std::vector<uint8_t> Transport::prepareHeader(Segment& segment) {
+    return segment.encodeHeader(selfIP, segment.getDestinationIP(), PROTOCOL);
+}
+
+std::unique_ptr<Segment> Transport::acceptIncoming(const std::vector<uint8_t>& bytes, uint32_t sourceIP) {
+    std::unique_ptr<Segment> segment = Segment::decode(sourceIP, selfIP, PROTOCOL, bytes);
+    if (!segment || decodeFlags(segment->getFlags()) == FlagType::INVALID) return nullptr;
+    segment->setDestinationIP(sourceIP);
+    return segment;
+}
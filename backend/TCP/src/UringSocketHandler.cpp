@@ -0,0 +1,414 @@
+#include "UringSocketHandler.hpp"
+#include "Flags.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define URING_SUPPORTED 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+static constexpr auto STOP_DRAIN_TIME = std::chrono::milliseconds(100);     // how long stop() waits for queued sends
+
+#ifdef URING_SUPPORTED
+
+// No liburing: the three syscalls and the shared rings are used directly.
+static int uringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+static int uringRegister(int fd, unsigned opcode, void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+static constexpr uint64_t RECEIVE_TAG = ~0ULL;                  // user_data of the receive; sends carry their slot index
+
+struct UringSocketHandler::Ring {
+    int fd{-1};
+    void* sq_ring{MAP_FAILED};
+    size_t sq_ring_size{0};
+    void* cq_ring{MAP_FAILED};
+    size_t cq_ring_size{0};
+    struct io_uring_sqe* sqes{nullptr};
+    size_t sqes_size{0};
+
+    unsigned* sq_head{nullptr};
+    unsigned* sq_tail{nullptr};
+    unsigned* sq_mask{nullptr};
+    unsigned* sq_array{nullptr};
+    unsigned* sq_flags{nullptr};
+    unsigned sq_entries{0};
+    unsigned* cq_head{nullptr};
+    unsigned* cq_tail{nullptr};
+    unsigned* cq_mask{nullptr};
+    struct io_uring_cqe* cqes{nullptr};
+
+    unsigned sq_local_tail{0};                                  // SQEs filled in, published by submit()
+    unsigned unsubmitted{0};
+
+    // Provided buffers: the kernel picks one per datagram and hands its id back in the completion.
+    struct io_uring_buf_ring* buffer_ring{nullptr};
+    size_t buffer_ring_size{0};
+    uint16_t buffer_tail{0};
+    uint8_t* buffers{nullptr};
+    size_t buffer_size{0};
+    struct msghdr receive_message{};                            // name and control room reserved in every buffer
+    bool receiving{false};
+    bool rejected{false};
+
+    bool hasSqe() const {return sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) < sq_entries;}
+
+    struct io_uring_sqe* nextSqe() {
+        if (!hasSqe()) return nullptr;
+        unsigned index = sq_local_tail & *sq_mask;
+        sq_array[index] = index;
+        sq_local_tail++;
+        unsubmitted++;
+        memset(&sqes[index], 0, sizeof(sqes[index]));
+        return &sqes[index];
+    }
+
+    void provideBuffer(uint16_t id) {
+        // Entries are indexed from the ring base (in C++ the header's flex array member sits behind a padding
+        // byte) and written field by field: the ring tail overlays the resv field of the first entry.
+        struct io_uring_buf& buffer = reinterpret_cast<struct io_uring_buf*>(buffer_ring)[buffer_tail & (BUFFER_COUNT - 1)];
+        buffer.addr = reinterpret_cast<uintptr_t>(buffers + size_t(id) * buffer_size);
+        buffer.len = static_cast<uint32_t>(buffer_size);
+        buffer.bid = id;
+        buffer_tail++;
+        __atomic_store_n(&buffer_ring->tail, buffer_tail, __ATOMIC_RELEASE);
+    }
+};
+
+bool UringSocketHandler::setupRing() {
+    struct io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = CQ_ENTRIES;
+    int fd = uringSetup(SQ_ENTRIES, &params);
+    if (fd < 0) {
+        WARNING_SRC("UringSocketHandler[Start] - io_uring_setup() failed (errno=%d)", errno);
+        return false;
+    }
+    ring = std::make_unique<Ring>();
+    Ring& q = *ring;
+    q.fd = fd;
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        WARNING_SRC("UringSocketHandler[Start] - io_uring has no timed waits (kernel < 5.11)");
+        closeRing();
+        return false;
+    }
+
+    q.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    q.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap) q.sq_ring_size = q.cq_ring_size = std::max(q.sq_ring_size, q.cq_ring_size);
+
+    q.sq_ring = mmap(nullptr, q.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (q.sq_ring != MAP_FAILED) {
+        q.cq_ring = singleMap ? q.sq_ring : mmap(nullptr, q.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+    q.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, q.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes != MAP_FAILED) q.sqes = static_cast<struct io_uring_sqe*>(sqes);
+    if (q.sq_ring == MAP_FAILED || q.cq_ring == MAP_FAILED || !q.sqes) {
+        WARNING_SRC("UringSocketHandler[Start] - Mapping the io_uring rings failed (errno=%d)", errno);
+        closeRing();
+        return false;
+    }
+
+    uint8_t* sq = static_cast<uint8_t*>(q.sq_ring);
+    q.sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    q.sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    q.sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    q.sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    q.sq_flags = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    q.sq_entries = params.sq_entries;
+    q.sq_local_tail = *q.sq_tail;
+    uint8_t* cq = static_cast<uint8_t*>(q.cq_ring);
+    q.cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    q.cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    q.cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    q.cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Each buffer holds an io_uring_recvmsg_out, the sender address, the control messages and the datagram;
+    // rounded up so the control messages of every buffer stay aligned.
+    q.receive_message.msg_namelen = sizeof(struct sockaddr_in);
+    q.receive_message.msg_controllen = CONTROL_BUFFER_SIZE;
+    q.buffer_size = sizeof(struct io_uring_recvmsg_out) + q.receive_message.msg_namelen + q.receive_message.msg_controllen + Segment::MAX_SEGMENT_SIZE;
+    q.buffer_size = (q.buffer_size + 63) & ~size_t(63);
+    q.buffer_ring_size = BUFFER_COUNT * sizeof(struct io_uring_buf);
+    void* bufferRing = mmap(nullptr, q.buffer_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void* buffers = mmap(nullptr, BUFFER_COUNT * q.buffer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufferRing != MAP_FAILED) q.buffer_ring = static_cast<struct io_uring_buf_ring*>(bufferRing);
+    if (buffers != MAP_FAILED) q.buffers = static_cast<uint8_t*>(buffers);
+    if (!q.buffer_ring || !q.buffers) {
+        WARNING_SRC("UringSocketHandler[Start] - Allocating receive buffers failed");
+        closeRing();
+        return false;
+    }
+
+    struct io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uintptr_t>(q.buffer_ring);
+    reg.ring_entries = BUFFER_COUNT;
+    reg.bgid = BUFFER_GROUP;
+    if (uringRegister(fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        WARNING_SRC("UringSocketHandler[Start] - Provided buffer rings not supported (errno=%d)", errno);
+        closeRing();
+        return false;
+    }
+    for (uint16_t id = 0; id < BUFFER_COUNT; id++) q.provideBuffer(id);
+
+    slots = std::vector<SendSlot>(SEND_SLOTS);
+    free_slots.clear();
+    for (uint32_t i = SEND_SLOTS; i > 0; i--) free_slots.push_back(i - 1);
+    return true;
+}
+
+void UringSocketHandler::closeRing() {
+    if (!ring) return;
+    Ring& q = *ring;
+    // Closing the ring cancels the posted receive before the buffers it may write to go away.
+    if (q.fd >= 0) close(q.fd);
+    if (q.sqes) munmap(q.sqes, q.sqes_size);
+    if (q.cq_ring != MAP_FAILED && q.cq_ring != q.sq_ring) munmap(q.cq_ring, q.cq_ring_size);
+    if (q.sq_ring != MAP_FAILED) munmap(q.sq_ring, q.sq_ring_size);
+    if (q.buffer_ring) munmap(q.buffer_ring, q.buffer_ring_size);
+    if (q.buffers) munmap(q.buffers, BUFFER_COUNT * q.buffer_size);
+    ring.reset();
+    slots.clear();
+    free_slots.clear();
+}
+
+bool UringSocketHandler::armReceive() {
+    struct io_uring_sqe* sqe = ring->nextSqe();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = socketfd;
+    sqe->addr = reinterpret_cast<uintptr_t>(&ring->receive_message);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = RECEIVE_TAG;
+    ring->receiving = true;
+    return true;
+}
+
+// Publishes the filled SQEs and, with waitFor, blocks until that many completions are posted or timeout passes.
+// Without anything to submit, wait for or flush this is not a syscall.
+void UringSocketHandler::submit(unsigned waitFor, Clock::duration timeout) {
+    Ring& q = *ring;
+    __atomic_store_n(q.sq_tail, q.sq_local_tail, __ATOMIC_RELEASE);
+
+    unsigned flags = 0;
+    if (waitFor || (__atomic_load_n(q.sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)) flags |= IORING_ENTER_GETEVENTS;
+    if (!flags && !q.unsubmitted) return;
+
+    struct __kernel_timespec ts{};
+    struct io_uring_getevents_arg arg{};
+    if (waitFor) {
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+        ts.tv_sec = ns / 1000000000LL;
+        ts.tv_nsec = ns % 1000000000LL;
+        arg.ts = reinterpret_cast<uintptr_t>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    int n = uringEnter(q.fd, q.unsubmitted, waitFor, flags, waitFor ? &arg : nullptr, waitFor ? sizeof(arg) : 0);
+    if (n >= 0) {
+        q.unsubmitted -= std::min<unsigned>(n, q.unsubmitted);
+    } else if (errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        ERROR_SRC("UringSocketHandler - io_uring_enter() failure (errno=%d)", errno);
+    }
+}
+
+bool UringSocketHandler::queueSends() {
+    bool queued = false;
+    std::unique_ptr<Segment> segment;
+    while (!free_slots.empty() && ring->hasSqe() && senderQueue.tryPop(segment)) {
+        uint32_t index = free_slots.back();
+        free_slots.pop_back();
+        SendSlot& slot = slots[index];
+        slot.segment = std::move(segment);
+        prepareMessage(*slot.segment, slot.out);
+        DEBUG_SRC("UringSocketHandler[Sender] - Queued packet to send[IP=%u DSTPRT=%u SEQ=%u ACK=%u FLAGS=%s]", slot.segment->getDestinationIP(), slot.segment->getDestPrt(), slot.segment->getSeqNum(), slot.segment->getAckNum(), flagsToStr(slot.segment->getFlags()).c_str());
+
+        struct io_uring_sqe* sqe = ring->nextSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = socketfd;
+        sqe->addr = reinterpret_cast<uintptr_t>(&slot.out.message);
+        sqe->len = 1;
+        sqe->user_data = index;
+        queued = true;
+    }
+    return queued;
+}
+
+bool UringSocketHandler::reap() {
+    Ring& q = *ring;
+    unsigned head = *q.cq_head;                                 // only this thread moves the head
+    unsigned tail = __atomic_load_n(q.cq_tail, __ATOMIC_ACQUIRE);
+    bool handled = head != tail;
+    for (; head != tail; head++) {
+        const struct io_uring_cqe& cqe = q.cqes[head & *q.cq_mask];
+        if (cqe.user_data == RECEIVE_TAG) handleReceive(cqe.res, cqe.flags);
+        else handleSend(static_cast<uint32_t>(cqe.user_data), cqe.res);
+    }
+    __atomic_store_n(q.cq_head, head, __ATOMIC_RELEASE);
+
+    // The multishot receive ends when the buffers run out (or on error); the buffers are back by now.
+    if (!q.receiving && !q.rejected && running) armReceive();
+    return handled;
+}
+
+void UringSocketHandler::handleReceive(int result, uint32_t flags) {
+    Ring& q = *ring;
+    if (!(flags & IORING_CQE_F_MORE)) q.receiving = false;
+    if (result < 0) {
+        if (result == -ENOBUFS) {
+            DEBUG_SRC("UringSocketHandler[Receiver] - Receive buffers exhausted, re-arming");
+        } else if (result == -EINVAL) {
+            // Multishot recvmsg with provided buffers is 6.0+; start() falls back when the first one is refused.
+            q.rejected = true;
+        } else if (running) {
+            ERROR_SRC("UringSocketHandler[Receiver] - recvmsg failure (errno=%d)", -result);
+        }
+        return;
+    }
+    if (!(flags & IORING_CQE_F_BUFFER)) return;
+
+    uint16_t id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+    uint8_t* buffer = q.buffers + size_t(id) * q.buffer_size;
+    const struct io_uring_recvmsg_out* out = reinterpret_cast<const struct io_uring_recvmsg_out*>(buffer);
+    uint8_t* name = buffer + sizeof(*out);
+    uint8_t* control = name + q.receive_message.msg_namelen;
+    uint8_t* packet = control + q.receive_message.msg_controllen;
+    size_t prefix = packet - buffer;
+    size_t size = static_cast<size_t>(result) > prefix ? std::min<size_t>(out->payloadlen, result - prefix) : 0;
+
+    struct sockaddr_in senaddr{};
+    memcpy(&senaddr, name, std::min<size_t>(out->namelen, sizeof(senaddr)));
+    uint32_t sourceIP = ntohl(senaddr.sin_addr.s_addr);
+    if (out->flags & MSG_TRUNC) {
+        WARNING_SRC("UringSocketHandler[Receiver] - Dropped truncated datagram [IP=%u PORT=%u SIZE=%u]", sourceIP, ntohs(senaddr.sin_port), out->payloadlen);
+    } else if (size) {
+        TRACE_SRC("UringSocketHandler[Receiver] - New Packet Arrived SIZE=%zu", size);
+        struct msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = out->controllen;
+        deliverDatagram(packet, size, message, sourceIP, ntohs(senaddr.sin_port));
+    }
+    q.provideBuffer(id);
+}
+
+void UringSocketHandler::handleSend(uint32_t index, int result) {
+    if (index >= slots.size() || !slots[index].segment) return;
+    SendSlot& slot = slots[index];
+    finishSend(*slot.segment, slot.out, result);
+    bool stamped = slot.out.stamp && result >= 0;
+    slot.segment.reset();
+    free_slots.push_back(index);
+    // The software TX stamp is taken before the send completes; one error queue read per RTT tracker.
+    if (stamped) readSendTimestamps();
+}
+
+#else
+
+struct UringSocketHandler::Ring {};
+
+bool UringSocketHandler::setupRing() {
+    INFO_SRC("UringSocketHandler[Start] - io_uring not available on this platform");
+    return false;
+}
+
+void UringSocketHandler::closeRing() {ring.reset();}
+bool UringSocketHandler::armReceive() {return false;}
+void UringSocketHandler::submit(unsigned, Clock::duration) {}
+bool UringSocketHandler::queueSends() {return false;}
+bool UringSocketHandler::reap() {return false;}
+void UringSocketHandler::handleReceive(int, uint32_t) {}
+void UringSocketHandler::handleSend(uint32_t, int) {}
+
+#endif
+
+UringSocketHandler::UringSocketHandler(
+    uint16_t port,
+    uint32_t selfIP,
+    ReceiverQueue& receiverQueue,
+    SenderQueue& senderQueue
+)
+:
+    SocketHandler(port, selfIP, receiverQueue, senderQueue)
+{}
+
+UringSocketHandler::~UringSocketHandler() {
+    closeRing();
+}
+
+void UringSocketHandler::start() {
+    openSocket();
+    if (setupRing()) {
+        running = true;
+        armReceive();
+        submit(0, {});
+        reap();                                                 // a refused receive completes right away
+        if (!ring->rejected) {
+            INFO_SRC("UringSocketHandler[Start] - Initialized, I/O driven by the connection thread through io_uring");
+            return;
+        }
+        WARNING_SRC("UringSocketHandler[Start] - Multishot recvmsg not supported");
+        running = false;
+        closeRing();
+    }
+    INFO_SRC("UringSocketHandler[Start] - Falling back to Receiver & Sender threads");
+    startThreads();
+}
+
+void UringSocketHandler::stop() {
+    if (!ring) {
+        SocketHandler::stop();
+        return;
+    }
+    INFO_SRC("UringSocketHandler[Stop] - Sending what is still queued, then closing the ring and socket");
+    // The segments the connection queued on its last steps (the final ACKs of a close) still go out.
+    auto deadline = Clock::now() + STOP_DRAIN_TIME;
+    while (Clock::now() < deadline) {
+        queueSends();
+        if (free_slots.size() == SEND_SLOTS && senderQueue.empty()) break;
+        submit(1, std::chrono::milliseconds(10));
+        reap();
+    }
+    running = false;
+    senderQueue.close();
+    receiverQueue.close();
+    shutdown(socketfd, SHUT_RDWR);
+    closeRing();
+    close(socketfd);
+    INFO_SRC("UringSocketHandler[Stop] - Successfully closed ring and socket");
+}
+
+bool UringSocketHandler::poll() {
+    if (!ring) return false;                                        // threaded fallback
+    bool handled = reap();
+    if (queueSends()) handled = true;
+    submit(0, {});
+    return handled;
+}
+
+bool UringSocketHandler::wait(Clock::duration timeout) {
+    if (!ring) return false;
+    queueSends();
+    if (reap()) {
+        submit(0, {});
+        return true;
+    }
+    submit(1, timeout);
+    reap();
+    return true;
+}
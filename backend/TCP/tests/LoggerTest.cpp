@@ -1,6 +1,49 @@
 #include "Logger.hpp" 
 
+#include <atomic>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+// Walks the entries of a binary log as BinaryLog.hpp lays them out; false on a bad magic, an unknown entry
+// (e.g. a text line) or a truncated one.
+static bool decodes(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(BinaryLog::MAGIC) || std::memcmp(data.data(), BinaryLog::MAGIC, sizeof(BinaryLog::MAGIC)) != 0) return false;
+    size_t pos = sizeof(BinaryLog::MAGIC);
+    auto skip = [&](size_t bytes) {
+        if (data.size() - pos < bytes) return false;
+        pos += bytes;
+        return true;
+    };
+    auto skipString = [&]() {
+        uint16_t length;
+        if (data.size() - pos < sizeof(length)) return false;
+        std::memcpy(&length, data.data() + pos, sizeof(length));
+        return skip(sizeof(length) + length);
+    };
+    while (pos < data.size()) {
+        char type = data[pos++];
+        bool ok;
+        if (type == BinaryLog::SITE) ok = skip(4 + 1 + 4) && skipString() && skipString() && skipString();
+        else if (type == BinaryLog::RECORD) {
+            uint16_t size = 0;
+            ok = skip(4 + 8) && data.size() - pos >= sizeof(size);
+            if (ok) std::memcpy(&size, data.data() + pos, sizeof(size));
+            ok = ok && skip(sizeof(size) + size);
+        }
+        else if (type == BinaryLog::TEXT) ok = skip(8 + 1 + 4) && skipString() && skipString();
+        else if (type == BinaryLog::DROPPED) ok = skip(8 + 8);
+        else if (type == BinaryLog::CLOCK) ok = skip(1);
+        else ok = false;
+        if (!ok) return false;
+    }
+    return true;
+}
+
 int main() {
+    int failures = 0;
 
     Logger::enableFileOutput();
 
@@ -15,6 +58,67 @@ int main() {
     TRACE_SRC("%s", "TEST THIS IS A TEST");
     TRACE_SRC("TEST");
 
+    // Async: lines from several threads go through their rings and the writer thread.
+    Logger::enableAsync(std::chrono::milliseconds(10), 64);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < 100; i++) TRACE_SRC("ASYNC THREAD %d LINE %d", t, i);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    Logger::disableAsync();
+    std::cout << "async dropped " << Logger::droppedLines() << " of 400 lines" << std::endl;
+
+    // Binary: the same lines plus every argument kind, decoded with make logdecode ARGS="logs/LoggerTest.bin".
+    Logger::enableBinaryOutput("logs/LoggerTest.bin", std::chrono::milliseconds(10), 64);
+    threads.clear();
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < 100; i++) TRACE_SRC("BINARY THREAD %d LINE %d", t, i);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    TRACE_SRC("KINDS %s %c %hhu %ld %llu %zu %x %5.2f %-4d| %p %% %.3s", "str", 'c', static_cast<unsigned char>(255), -7L, 1ULL << 40, sizeof(LogRecord), 0xbeefu, 3.14159, 42, static_cast<void*>(nullptr), "truncated");
+    std::string wide(300, 'w');
+    TRACE_SRC("SPANS CHUNKS %s %u", wide.c_str(), 7u);
+    TRACE("NO SOURCE %s", "FILE");
+    Logger::trace(__LINE__, __FILE__, "NOT A MACRO %d", 1);
+    Logger::setTimestamp(LogTimestamp::TICKS);
+    TRACE_SRC("BINARY TICKS");
+    Logger::disableAsync();
+    if (!decodes("logs/LoggerTest.bin")) {
+        std::cout << "FAIL: logs/LoggerTest.bin does not decode" << std::endl;
+        failures++;
+    }
+
+    // Switching binary mode on and off while another thread logs: its lines go to the rings or are dropped,
+    // never into the binary file as text.
+    std::atomic<bool> logging{true};
+    std::thread background([&logging] {
+        for (int i = 0; logging; i++) TRACE_SRC("BACKGROUND LINE %d", i);
+    });
+    for (int round = 0; round < 20; round++) {
+        std::string path = "logs/LoggerTestSwitch" + std::to_string(round) + ".bin";
+        Logger::enableBinaryOutput(path, std::chrono::milliseconds(10), 64);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        Logger::disableAsync();
+        if (!decodes(path)) {
+            std::cout << "FAIL: " << path << " does not decode" << std::endl;
+            failures++;
+        }
+    }
+    logging = false;
+    background.join();
+    Logger::enableFileOutput();
+
+    // Timestamps: microseconds, then raw ticks.
+    Logger::setTimestamp(LogTimestamp::MICROSECONDS);
+    TRACE_SRC("MICROSECONDS");
+    Logger::setTimestamp(LogTimestamp::TICKS);
+    TRACE_SRC("TICKS");
+    Logger::setTimestamp(LogTimestamp::MILLISECONDS);
+
     // TRACE("IP: %s PORT: %u\tACK: %u\tSEQ: %u", ip.c_str(), port, ack, seq);
     // INFO("IP: %s PORT: %u\tACK: %u\tSEQ: %u", ip.c_str(), port, ack, seq);
     // DEBUG("IP: %s PORT: %u\tACK: %u\tSEQ: %u", ip.c_str(), port, ack, seq);
@@ -29,5 +133,6 @@ int main() {
     // ERROR_SRC("IP: %s PORT: %u\tACK: %u\tSEQ: %u", ip.c_str(), port, ack, seq);
     // CRITICAL_SRC("IP: %s PORT: %u\tACK: %u\tSEQ: %u", ip.c_str(), port, ack, seq);
 
-    return 0;
+    std::cout << (failures ? "FAIL" : "PASS") << std::endl;
+    return failures ? 1 : 0;
 }
\ No newline at end of file
@@ -0,0 +1,847 @@
+#include "Connection.hpp"
+#include "NetworkSimulator.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+static constexpr uint16_t SERVER_PORT = 9000;
+static constexpr uint16_t CLIENT_PORT = 9001;
+
+// A server on 10.0.0.1:9000 and a client on 10.0.0.2:9001 on one simulated network, plus any peers a scenario
+// adds. Scenarios configure the Connections, establish() them, drive their workload with runUntil() and close().
+class SimHarness {
+    private:
+        struct Endpoint {
+            ThreadSafeQueue<std::vector<uint8_t>> input;
+            std::map<uint16_t, Client> clients;
+            Connection connection;
+            bool started = false;
+
+            Endpoint(uint16_t port, const std::string& ip) : connection(port, ip, input, clients) {}
+            Endpoint(uint16_t port, const std::string& ip, const std::string& serverIP) : connection(port, SERVER_PORT, ip, serverIP, input, clients) {}
+        };
+
+        NetworkSimulator simulator;                                     // first in, last out: it owns the virtual clock
+        std::map<uint16_t, std::unique_ptr<Endpoint>> endpoints;        // by port, the server included
+
+        Endpoint& endpoint(uint16_t port) {return *endpoints.at(port);}
+
+        static bool established(const std::map<uint16_t, Client>& clients, uint16_t port) {
+            auto it = clients.find(port);
+            return it != clients.end() && it->second.getState() == static_cast<uint8_t>(STATE::ESTABLISHED);
+        }
+
+    public:
+        SimHarness(uint64_t seed, const LinkConfig& link) : simulator(seed) {
+            simulator.setDefaultLink(link);
+            endpoints.emplace(SERVER_PORT, std::make_unique<Endpoint>(SERVER_PORT, "10.0.0.1"));
+            addPeer(CLIENT_PORT, "10.0.0.2");
+        }
+
+        // Another Connection to the server; it sends its SYN once started.
+        Connection& addPeer(uint16_t port, const std::string& ip) {
+            return endpoints.emplace(port, std::make_unique<Endpoint>(port, ip, "10.0.0.1")).first->second->connection;
+        }
+
+        NetworkSimulator& network() {return simulator;}
+        Connection& server() {return endpoint(SERVER_PORT).connection;}
+        Connection& client(uint16_t port = CLIENT_PORT) {return endpoint(port).connection;}
+        ThreadSafeQueue<std::vector<uint8_t>>& input(uint16_t port = CLIENT_PORT) {return endpoint(port).input;}
+        // The server's Client for a peer, and a peer's Client for the server.
+        Client& serverSide(uint16_t port = CLIENT_PORT) {return endpoint(SERVER_PORT).clients.at(port);}
+        Client& clientSide(uint16_t port = CLIENT_PORT) {return endpoint(port).clients.at(SERVER_PORT);}
+
+        void start(uint16_t port) {
+            Endpoint& e = endpoint(port);
+            e.connection.connect(simulator.transportFactory(), false);
+            simulator.attach(e.connection);
+            e.started = true;
+        }
+
+        // Starts every endpoint not started yet and waits until both sides of every peer are ESTABLISHED.
+        bool establish() {
+            for (auto& [port, e] : endpoints) {
+                if (!e->started) start(port);
+            }
+            return runUntil([&] {
+                for (auto& [port, e] : endpoints) {
+                    if (port != SERVER_PORT && (!established(e->clients, SERVER_PORT) || !established(endpoint(SERVER_PORT).clients, port))) return false;
+                }
+                return true;
+            }, std::chrono::seconds(30));
+        }
+
+        bool runUntil(const std::function<bool()>& done, Clock::duration limit) {return simulator.runUntil(done, limit);}
+        void runFor(Clock::duration duration) {simulator.runFor(duration);}
+        Clock::time_point now() const {return simulator.now();}
+        double msSince(Clock::time_point start) const {return std::chrono::duration<double, std::milli>(now() - start).count();}
+
+        // Disconnects the peers, then the server, and waits until every started Connection has shut down.
+        bool close() {
+            for (auto it = endpoints.rbegin(); it != endpoints.rend(); ++it) {
+                if (it->second->started) it->second->connection.disconnect();
+            }
+            return runUntil([&] {
+                for (auto& [port, e] : endpoints) {
+                    if (e->connection.isRunning()) return false;
+                }
+                return true;
+            }, std::chrono::minutes(2));
+        }
+};
+
+// One scenario's output line: its measurements, then PASS or the checks that failed.
+class Report {
+    private:
+        std::ostringstream line;
+        std::vector<const char*> failed;
+
+    public:
+        explicit Report(const char* name) {line << name;}
+
+        template<typename T>
+        Report& value(const char* key, const T& value) {
+            line << ' ' << key << '=' << value;
+            return *this;
+        }
+
+        Report& check(const char* what, bool ok) {
+            if (!ok) failed.push_back(what);
+            return *this;
+        }
+
+        bool print() {
+            if (failed.empty()) line << " PASS";
+            else line << " FAIL:";
+            for (const char* what : failed) line << " [" << what << ']';
+            std::cout << line.str() << std::endl;
+            return failed.empty();
+        }
+};
+
+// Appends everything the application can read from a peer's byte stream.
+static void drain(Client& peer, std::vector<uint8_t>& out) {
+    std::vector<uint8_t> chunk;
+    while (peer.receivedData.tryPop(chunk)) out.insert(out.end(), chunk.begin(), chunk.end());
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(p * (values.size() - 1));
+    return values[index];
+}
+
+struct Transfer {
+    bool established = false;
+    bool intact = false;
+    bool closed = false;
+    double elapsed_ms = 0.0;
+    double goodput_kbps = 0.0;
+    double p50_ms = 0.0;
+    double p99_ms = 0.0;
+    NetworkSimulator::Stats stats;
+};
+
+// Messages of messageSize bytes written to the client's byte stream 10 ms apart; kept as a result so two
+// runs with the same seed can be compared packet for packet.
+static Transfer runTransfer(uint64_t seed, const LinkConfig& link, size_t messageCount, size_t messageSize) {
+    Transfer result;
+    SimHarness net(seed, link);
+    result.established = net.establish();
+    if (!result.established) return result;
+
+    std::vector<uint8_t> expected;
+    std::vector<uint8_t> received;
+    std::vector<Clock::time_point> sentAt;
+    std::vector<double> latencies;
+
+    auto collect = [&] {
+        drain(net.serverSide(), received);
+        while (latencies.size() < sentAt.size() && received.size() >= (latencies.size() + 1) * messageSize) {
+            latencies.push_back(net.msSince(sentAt[latencies.size()]));
+        }
+    };
+
+    Clock::time_point start = net.now();
+    for (size_t i = 0; i < messageCount; i++) {
+        std::vector<uint8_t> message(messageSize);
+        for (size_t j = 0; j < messageSize; j++) message[j] = static_cast<uint8_t>('a' + (i + j) % 26);
+        expected.insert(expected.end(), message.begin(), message.end());
+        sentAt.push_back(net.now());
+        net.input().push(std::move(message));
+        net.runUntil([&] {collect(); return false;}, std::chrono::milliseconds(10));
+    }
+
+    bool delivered = net.runUntil([&] {collect(); return received.size() >= expected.size();}, std::chrono::minutes(10));
+    result.intact = delivered && received == expected;
+    result.elapsed_ms = net.msSince(start);
+    result.goodput_kbps = received.size() * 8.0 / result.elapsed_ms;
+    result.p50_ms = percentile(latencies, 0.50);
+    result.p99_ms = percentile(latencies, 0.99);
+
+    result.closed = net.close();
+    result.stats = net.network().getStats();
+    return result;
+}
+
+static bool transferScenario(const char* name, const Transfer& t) {
+    return Report(name)
+        .value("elapsed_ms", t.elapsed_ms)
+        .value("goodput_kbps", t.goodput_kbps)
+        .value("p50_ms", t.p50_ms)
+        .value("p99_ms", t.p99_ms)
+        .value("sent", t.stats.packets_sent)
+        .value("lost", t.stats.packets_lost)
+        .value("reordered", t.stats.packets_reordered)
+        .check("established", t.established)
+        .check("intact", t.intact)
+        .check("closed", t.closed)
+        .print();
+}
+
+// Bulk transfer on stream 1 with small messages on stream 2 sent while it is in flight.
+static bool streamScenario(uint64_t seed, const LinkConfig& link, size_t bulkSize, size_t messageCount, size_t messageSize) {
+    Report report("streams");
+    SimHarness net(seed, link);
+    if (!net.establish()) return report.check("established", false).print();
+
+    std::vector<uint8_t> bulk(bulkSize);
+    for (size_t i = 0; i < bulkSize; i++) bulk[i] = static_cast<uint8_t>(i * 7);
+    std::vector<uint8_t> expectedSmall;
+
+    std::map<uint16_t, std::vector<uint8_t>> received;
+    std::vector<Clock::time_point> sentAt;
+    std::vector<double> latencies;
+    Clock::time_point start = net.now();
+    Clock::time_point bulkDone{};
+
+    auto collect = [&] {
+        std::pair<uint16_t, std::vector<uint8_t>> chunk;
+        while (net.serverSide().streamData.tryPop(chunk)) {
+            received[chunk.first].insert(received[chunk.first].end(), chunk.second.begin(), chunk.second.end());
+        }
+        while (latencies.size() < sentAt.size() && received[2].size() >= (latencies.size() + 1) * messageSize) {
+            latencies.push_back(net.msSince(sentAt[latencies.size()]));
+        }
+        if (bulkDone == Clock::time_point{} && received[1].size() >= bulkSize) bulkDone = net.now();
+    };
+
+    net.client().sendOnStream(1, bulk);
+    for (size_t i = 0; i < messageCount; i++) {
+        std::vector<uint8_t> message(messageSize, static_cast<uint8_t>('A' + i % 26));
+        expectedSmall.insert(expectedSmall.end(), message.begin(), message.end());
+        sentAt.push_back(net.now());
+        net.client().sendOnStream(2, std::move(message));
+        net.runUntil([&] {collect(); return false;}, std::chrono::milliseconds(10));
+    }
+
+    bool delivered = net.runUntil([&] {collect(); return received[1].size() >= bulkSize && received[2].size() >= expectedSmall.size();}, std::chrono::minutes(10));
+    double bulkMs = std::chrono::duration<double, std::milli>(bulkDone - start).count();
+    double interactiveP99Ms = percentile(latencies, 0.99);
+
+    return report
+        .value("bulk_ms", bulkMs)
+        .value("interactive_p99_ms", interactiveP99Ms)
+        .check("intact", delivered && received[1] == bulk && received[2] == expectedSmall)
+        .check("interactive_p99 < bulk", interactiveP99Ms < bulkMs)
+        .check("closed", net.close())
+        .print();
+}
+
+// Messages from tiny to multi-segment, queued before the handshake finishes, must come out one per receiveMessage().
+static bool messageScenario(uint64_t seed, const LinkConfig& link) {
+    Report report("messages");
+    SimHarness net(seed, link);
+
+    std::vector<std::vector<uint8_t>> sent;
+    const size_t sizes[] = {0, 1, 7, 100, 999, 1000, 1001, 2500, 12};
+    for (size_t round = 0; round < 20; round++) {
+        for (size_t size : sizes) {
+            std::vector<uint8_t> message(size);
+            for (size_t j = 0; j < size; j++) message[j] = static_cast<uint8_t>(round * 31 + j);
+            net.client().sendMessage(SERVER_PORT, message);
+            sent.push_back(std::move(message));
+        }
+    }
+    net.start(SERVER_PORT);
+    net.start(CLIENT_PORT);
+
+    std::vector<std::vector<uint8_t>> received;
+    bool wrongPeer = false;
+    bool delivered = net.runUntil([&] {
+        std::pair<uint16_t, std::vector<uint8_t>> message;
+        while (net.server().receiveMessage(message)) {
+            if (message.first != CLIENT_PORT) wrongPeer = true;
+            received.push_back(std::move(message.second));
+        }
+        return received.size() >= sent.size();
+    }, std::chrono::minutes(10));
+
+    return report
+        .value("messages", received.size())
+        .value("data_segments", net.client().getStats().data_segments_sent.load())
+        .check("intact", delivered && !wrongPeer && received == sent)
+        .check("closed", net.close())
+        .print();
+}
+
+// A length prefix above MAX_MESSAGE_SIZE, followed by bytes that parse as frames and spread over several
+// segments, then a well formed message: nothing after the bad prefix may come out of receiveMessage().
+static bool brokenFrameScenario(uint64_t seed, const LinkConfig& link) {
+    Report report("broken-frame");
+    SimHarness net(seed, link);
+    if (!net.establish()) return report.check("established", false).print();
+
+    std::vector<uint8_t> first(100, 'f');
+    net.client().sendMessage(SERVER_PORT, first);
+    std::vector<uint8_t> bad(4 + 5000, 0);                  // zeros read as empty frames from any offset
+    std::fill(bad.begin(), bad.begin() + 4, 0xFF);
+    net.client().sendTo(SERVER_PORT, bad, Client::MESSAGE_STREAM);
+    net.client().sendMessage(SERVER_PORT, std::vector<uint8_t>(100, 'l'));
+
+    std::vector<std::vector<uint8_t>> received;
+    bool delivered = net.runUntil([&] {
+        std::pair<uint16_t, std::vector<uint8_t>> message;
+        while (net.server().receiveMessage(message)) received.push_back(std::move(message.second));
+        return net.client().getStats().data_bytes_sent > 0 && !net.clientSide().hasMessages() && !net.clientSide().hasUnsentStreamData();
+    }, std::chrono::minutes(1));
+
+    return report
+        .value("messages", received.size())
+        .check("all sent and ACK'd", delivered)
+        .check("only the message before the bad prefix", received.size() == 1 && received[0] == first)
+        .check("stream marked broken", net.serverSide().isMessageStreamBroken())
+        .check("closed", net.close())
+        .print();
+}
+
+// Messages from one peer that the application has not read close only that peer's window: a second peer that
+// sends afterwards is still advertised its whole buffer but for its own message (rounded to the window scale).
+static bool messageWindowScenario(uint64_t seed, const LinkConfig& link) {
+    static constexpr uint16_t OTHER_PORT = 9002;
+    static constexpr uint32_t WINDOW = 8000;
+    Report report("message-window");
+    SimHarness net(seed, link);
+    net.server().setWindowSize(WINDOW);
+    net.server().setWindowAutotune(false);
+    net.addPeer(OTHER_PORT, "10.0.0.3");
+    if (!net.establish()) return report.check("established", false).print();
+
+    std::vector<uint8_t> message(2000, 'm');
+    for (int i = 0; i < 3; i++) net.client().sendMessage(SERVER_PORT, message);
+    net.runFor(std::chrono::seconds(1));
+    net.client(OTHER_PORT).sendMessage(SERVER_PORT, std::vector<uint8_t>(10, 'o'));
+    net.runFor(std::chrono::seconds(1));
+
+    uint32_t busyWindow = net.clientSide(CLIENT_PORT).getWindowSize();
+    uint32_t otherWindow = net.clientSide(OTHER_PORT).getWindowSize();
+    size_t unread = 0;
+    std::pair<uint16_t, std::vector<uint8_t>> received;
+    while (net.server().receiveMessage(received)) unread++;
+
+    return report
+        .value("busy_window", busyWindow)
+        .value("other_window", otherWindow)
+        .value("messages", unread)
+        .check("all messages arrived", unread == 4)
+        .check("busy_window <= WINDOW - unread", busyWindow <= WINDOW - 3 * (message.size() + Client::FRAME_HEADER_SIZE))
+        .check("other_window not charged the busy peer's messages", otherWindow > WINDOW - message.size())
+        .check("closed", net.close())
+        .print();
+}
+
+// Two streams with the first stream 1 segment lost: while the connection sequence has a gap, every byte that
+// arrived must be counted against the window once, whether its stream delivered it or holds it.
+static bool streamWindowScenario(uint64_t seed, const LinkConfig& link, size_t size) {
+    static constexpr uint32_t WINDOW = 64000;
+    Report report("stream-window");
+    SimHarness net(seed, link);
+    net.server().setWindowSize(WINDOW);
+    net.server().setWindowAutotune(false);
+    if (!net.establish()) return report.check("established", false).print();
+
+    std::set<uint32_t> arrivedSeqs;
+    size_t arrivedBytes = 0;
+    bool dropped = false;
+    net.network().setDropFilter([&](uint32_t fromIP, uint16_t fromPort, uint32_t toIP, uint16_t, const std::vector<uint8_t>& bytes) {
+        if (fromPort != CLIENT_PORT) return false;
+        std::unique_ptr<Segment> seg = Segment::decode(fromIP, toIP, Transport::PROTOCOL, bytes);
+        if (!seg || seg->getProbeOption() || seg->payloadSize() == 0) return false;
+        if (!dropped && seg->getStreamId() == 1) {
+            dropped = true;
+            return true;
+        }
+        if (arrivedSeqs.insert(seg->getSeqNum()).second) arrivedBytes += seg->getData().size();
+        return false;
+    });
+
+    std::vector<uint8_t> bulk(size, 'b');
+    net.client().sendOnStream(1, bulk);
+    net.client().sendOnStream(2, bulk);
+
+    // The application reads nothing until the end, so every arrived byte stays unread or pending.
+    size_t maxCounted = 0;
+    size_t maxArrived = 0;
+    bool overCounted = false;
+    bool delivered = net.runUntil([&] {
+        size_t counted = net.serverSide().unreadBytes() + net.serverSide().reassemblyBytes();
+        if (counted > arrivedBytes) overCounted = true;
+        maxCounted = std::max(maxCounted, counted);
+        maxArrived = std::max(maxArrived, arrivedBytes);
+        return net.serverSide().unreadBytes() >= 2 * size;
+    }, std::chrono::minutes(1));
+
+    std::map<uint16_t, size_t> received;
+    std::pair<uint16_t, std::vector<uint8_t>> chunk;
+    while (net.serverSide().streamData.tryPop(chunk)) received[chunk.first] += chunk.second.size();
+
+    return report
+        .value("counted", maxCounted)
+        .value("arrived", maxArrived)
+        .check("dropped", dropped)
+        .check("intact", delivered && received[1] == size && received[2] == size)
+        .check("no byte counted twice", !overCounted)
+        .check("closed", net.close())
+        .print();
+}
+
+// Two peers on one server; sendTo() must reach only its target and cost only its own bytes.
+static bool unicastScenario(uint64_t seed, const LinkConfig& link, size_t size) {
+    static constexpr uint16_t OTHER_PORT = 9002;
+    Report report("unicast");
+    SimHarness net(seed, link);
+    net.addPeer(OTHER_PORT, "10.0.0.3");
+    if (!net.establish()) return report.check("established", false).print();
+
+    std::vector<uint8_t> forA(size, 'a'), forB(size / 2, 'b');
+    net.server().sendTo(CLIENT_PORT, forA);
+    net.server().sendTo(OTHER_PORT, forB);
+
+    std::vector<uint8_t> gotA, gotB;
+    net.runUntil([&] {
+        drain(net.clientSide(CLIENT_PORT), gotA);
+        drain(net.clientSide(OTHER_PORT), gotB);
+        return gotA.size() >= forA.size() && gotB.size() >= forB.size();
+    }, std::chrono::minutes(5));
+    net.runFor(std::chrono::seconds(1));
+    drain(net.clientSide(CLIENT_PORT), gotA);
+    drain(net.clientSide(OTHER_PORT), gotB);
+    uint64_t dataBytesSent = net.server().getStats().data_bytes_sent;
+
+    return report
+        .value("data_bytes_sent", dataBytesSent)
+        .check("isolated", gotA == forA && gotB == forB)
+        .check("data_bytes_sent < both payloads + 2 segments", dataBytesSent < forA.size() + forB.size() + 2 * 1000)
+        .check("closed", net.close())
+        .print();
+}
+
+// Bulk data over a 1500 byte MTU link whose MTU then drops to 1100 mid transfer: the search has to settle
+// just below each limit, and the black hole fallback has to re-cut in flight segments that no longer fit.
+static bool pathMtuScenario(uint64_t seed, LinkConfig link, size_t size) {
+    Report report("pmtu");
+    link.mtu = 1500;
+    SimHarness net(seed, link);
+    net.server().setWindowSize(16000);
+    net.client().setWindowSize(16000);
+    if (!net.establish()) return report.check("established", false).print();
+
+    std::vector<uint8_t> expected(2 * size);
+    for (size_t i = 0; i < expected.size(); i++) expected[i] = static_cast<uint8_t>(i * 11);
+    std::vector<uint8_t> received;
+    PathMtu& path = net.clientSide().getPathMtu();
+
+    net.input().push(std::vector<uint8_t>(expected.begin(), expected.begin() + size));
+    bool delivered = net.runUntil([&] {drain(net.serverSide(), received); return received.size() >= size && path.getState() == PathMtu::State::SEARCH_COMPLETE;}, std::chrono::minutes(2));
+    uint16_t plpmtu = path.getPlpmtu();
+
+    link.mtu = 1100;
+    net.network().setLink(0x0A000002, CLIENT_PORT, 0x0A000001, SERVER_PORT, link);
+    net.input().push(std::vector<uint8_t>(expected.begin() + size, expected.end()));
+    delivered = delivered && net.runUntil([&] {drain(net.serverSide(), received); return received.size() >= expected.size() && path.getState() == PathMtu::State::SEARCH_COMPLETE;}, std::chrono::minutes(2));
+    uint16_t plpmtuAfterDrop = path.getPlpmtu();
+
+    return report
+        .value("plpmtu", plpmtu)
+        .value("plpmtu_after_drop", plpmtuAfterDrop)
+        .value("probes", net.client().getStats().mtu_probes_sent.load())
+        .check("intact", delivered && received == expected)
+        .check("plpmtu just below 1472", plpmtu > 1472 - PathMtu::SEARCH_GRANULARITY && plpmtu <= 1472)
+        .check("plpmtu_after_drop just below 1072", plpmtuAfterDrop > 1072 - PathMtu::SEARCH_GRANULARITY && plpmtuAfterDrop <= 1072)
+        .check("closed", net.close())
+        .print();
+}
+
+// Bulk transfer with one parity segment per groupSize data segments, over a link with random loss or, with
+// exactLoss, one that loses exactly the last data segment of every full parity group and nothing else.
+static bool fecScenario(const char* name, uint64_t seed, const LinkConfig& link, size_t size, uint8_t groupSize, bool exactLoss = false) {
+    Report report(name);
+    SimHarness net(seed, link);
+    net.server().setWindowSize(8000);
+    net.server().setFecGroupSize(groupSize);
+    net.client().setFecGroupSize(groupSize);
+    if (!net.establish()) return report.check("established", false).print();
+
+    std::vector<uint8_t> expected(size);
+    for (size_t i = 0; i < size; i++) expected[i] = static_cast<uint8_t>(i * 13 + i / 256);
+    std::vector<uint8_t> received;
+
+    // The sender closes a group with its parity segment, so counting first transmissions since the last
+    // parity finds each group's members; retransmissions and probes are not part of any group. The first
+    // group is hit too: the receiver keeps segments from the handshake on.
+    std::set<uint32_t> sentSeqs;
+    uint8_t groupCount = 0;
+    uint64_t drops = 0;
+    if (exactLoss) net.network().setDropFilter([&](uint32_t fromIP, uint16_t fromPort, uint32_t toIP, uint16_t, const std::vector<uint8_t>& bytes) {
+        if (fromPort != CLIENT_PORT) return false;
+        std::unique_ptr<Segment> seg = Segment::decode(fromIP, toIP, Transport::PROTOCOL, bytes);
+        if (!seg || seg->getProbeOption()) return false;
+        if (seg->getParityCount()) {
+            groupCount = 0;
+            return false;
+        }
+        if (seg->payloadSize() == 0 || !sentSeqs.insert(seg->getSeqNum()).second) return false;
+        if (++groupCount < groupSize) return false;
+        drops++;
+        return true;
+    });
+
+    Clock::time_point start = net.now();
+    net.input().push(expected);
+    bool delivered = net.runUntil([&] {drain(net.serverSide(), received); return received.size() >= size;}, std::chrono::minutes(10));
+    double elapsedMs = net.msSince(start);
+    uint64_t retransmissions = net.client().getStats().retransmissions;
+    uint64_t recovered = net.server().getStats().fec_recovered;
+
+    report
+        .value("elapsed_ms", elapsedMs)
+        .value("retransmissions", retransmissions)
+        .value("parity", net.client().getStats().fec_parity_sent.load())
+        .value("recovered", recovered)
+        .value("drops", drops)
+        .check("intact", delivered && received == expected);
+    if (exactLoss) {
+        report
+            .check("drops > 0", drops > 0)
+            .check("recovered == drops", recovered == drops)
+            .check("retransmissions == 0", retransmissions == 0);
+    }
+    return report.check("closed", net.close()).print();
+}
+
+// FEC is negotiated like compression: a sender whose peer did not offer it in the handshake sends no parity.
+static bool fecOneSidedScenario(uint64_t seed, const LinkConfig& link, size_t size) {
+    Report report("fec-one-sided");
+    SimHarness net(seed, link);
+    net.client().setFecGroupSize(4);
+    if (!net.establish()) return report.check("established", false).print();
+
+    std::vector<uint8_t> expected(size, 'x');
+    std::vector<uint8_t> received;
+    net.input().push(expected);
+    bool delivered = net.runUntil([&] {drain(net.serverSide(), received); return received.size() >= size;}, std::chrono::minutes(10));
+    uint64_t parity = net.client().getStats().fec_parity_sent;
+
+    return report
+        .value("parity", parity)
+        .check("intact", delivered && received == expected)
+        .check("not agreed", !net.clientSide().getFec().isEnabled() && !net.serverSide().getFec().isEnabled())
+        .check("parity == 0", parity == 0)
+        .check("closed", net.close())
+        .print();
+}
+
+// Both sides start their sequence numbers just below 2^32, so the transfer crosses the wrap with loss,
+// reordering and FEC parity groups straddling it.
+static bool wrapScenario(uint64_t seed, const LinkConfig& link, size_t size) {
+    Report report("wrap");
+    SimHarness net(seed, link);
+    net.server().setDefaultSequenceNumber(0xFFFFFFFF - 3000);
+    net.client().setDefaultSequenceNumber(0xFFFFFFFF - 5000);
+    net.server().setFecGroupSize(4);
+    net.client().setFecGroupSize(4);
+    if (!net.establish()) return report.check("established", false).print();
+
+    std::vector<uint8_t> expected(size);
+    for (size_t i = 0; i < size; i++) expected[i] = static_cast<uint8_t>(i * 17 + i / 512);
+    std::vector<uint8_t> received;
+
+    net.input().push(expected);
+    bool delivered = net.runUntil([&] {drain(net.serverSide(), received); return received.size() >= size;}, std::chrono::minutes(5));
+
+    return report
+        .check("intact", delivered && received == expected)
+        .check("wrapped", net.clientSide().getExpectedSequence() < 0xFFFFFFFF - 5000)
+        .check("closed", net.close())
+        .print();
+}
+
+// The reader stalls while the sender has plenty to send: the window has to close without the receiver
+// buffering more than it advertised, the persist timer keeps probing it, and once the reader drains
+// the buffer grows with the rate it reads at.
+static bool receiveWindowScenario(uint64_t seed, const LinkConfig& link, size_t size) {
+    Report report("rwnd");
+    SimHarness net(seed, link);
+    net.server().setWindowSize(4000);
+    if (!net.establish()) return report.check("established", false).print();
+    Client& peer = net.serverSide();
+    uint32_t initialBuffer = peer.getReceiveWindow().getBuffer();
+
+    std::vector<uint8_t> expected(size);
+    for (size_t i = 0; i < size; i++) expected[i] = static_cast<uint8_t>(i * 31 + i / 256);
+    std::vector<uint8_t> received;
+
+    net.input().push(expected);
+    net.runFor(std::chrono::seconds(5));
+    uint64_t windowProbes = net.client().getStats().window_probes;
+    // Every probe may push one byte past the closed window.
+    bool bounded = peer.unreadBytes() + peer.reassemblyBytes() <= initialBuffer + windowProbes;
+
+    bool delivered = net.runUntil([&] {drain(peer, received); return received.size() >= size;}, std::chrono::minutes(5));
+    uint32_t finalBuffer = peer.getReceiveWindow().getBuffer();
+
+    return report
+        .value("window_probes", windowProbes)
+        .value("initial_buffer", initialBuffer)
+        .value("final_buffer", finalBuffer)
+        .check("intact", delivered && received == expected)
+        .check("bounded", bounded)
+        .check("window_probes > 0", windowProbes > 0)
+        .check("buffer grew", finalBuffer > initialBuffer)
+        .check("closed", net.close())
+        .print();
+}
+
+// Bulk transfer over a long fat pipe: without window scaling at most 64 KB is in flight per RTT. peak_window is
+// the largest window the client saw advertised, peak_in_flight the most unacknowledged bytes it had out.
+static bool windowScaleScenario(const char* name, uint64_t seed, const LinkConfig& link, size_t size, bool scaling) {
+    Report report(name);
+    SimHarness net(seed, link);
+    net.server().setWindowSize(64000);
+    net.server().setWindowScaling(scaling);
+    if (!net.establish()) return report.check("established", false).print();
+    bool scaled = net.clientSide().getWindowScaling() && net.serverSide().getWindowScaling();
+
+    std::vector<uint8_t> expected(size);
+    for (size_t i = 0; i < size; i++) expected[i] = static_cast<uint8_t>(i * 13 + i / 1024);
+    std::vector<uint8_t> received;
+    uint32_t peakWindow = 0;
+    uint32_t peakInFlight = 0;
+
+    Clock::time_point start = net.now();
+    net.input().push(expected);
+    bool delivered = net.runUntil([&] {
+        drain(net.serverSide(), received);
+        peakWindow = std::max(peakWindow, net.clientSide().getWindowSize());
+        peakInFlight = std::max(peakInFlight, net.clientSide().sizeMessageSent());
+        return received.size() >= size;
+    }, std::chrono::minutes(5));
+
+    report
+        .value("scaled", scaled)
+        .value("elapsed_ms", net.msSince(start))
+        .value("peak_window", peakWindow)
+        .value("peak_in_flight", peakInFlight)
+        .check("intact", delivered && received == expected)
+        .check(scaling ? "scaled" : "not scaled", scaled == scaling);
+    if (scaling) {
+        report
+            .check("peak_window > 65535", peakWindow > ReceiveWindow::MAX_WINDOW)
+            .check("peak_in_flight > 65535", peakInFlight > ReceiveWindow::MAX_WINDOW);
+    } else {
+        report
+            .check("peak_window <= 65535", peakWindow <= ReceiveWindow::MAX_WINDOW)
+            .check("peak_in_flight <= 65535", peakInFlight <= ReceiveWindow::MAX_WINDOW);
+    }
+    return report.check("closed", net.close()).print();
+}
+
+enum class FastOpenMode {OFF, ON, STALE_COOKIE};
+
+// The client gets a cookie from the server, then a second connection from the same host sends its first message
+// straight away. With the cookie the message rides on the SYN and is delivered while that connection is still in
+// SYN_SENT, before it sends the third handshake segment; a stale cookie must cost only that RTT, never the message.
+static bool fastOpenScenario(const char* name, uint64_t seed, const LinkConfig& link, FastOpenMode mode) {
+    static constexpr uint16_t SECOND_PORT = 9002;
+    Report report(name);
+    bool enabled = mode != FastOpenMode::OFF;
+    SimHarness net(seed, link);
+    net.server().setFastOpen(enabled);
+    net.client().setFastOpen(enabled);
+    if (!net.establish()) return report.check("established", false).print();
+
+    Connection& second = net.addPeer(SECOND_PORT, "10.0.0.2");
+    second.setFastOpen(enabled);
+    second.getFastOpenCookies() = net.client().getFastOpenCookies();
+    if (mode == FastOpenMode::STALE_COOKIE) {
+        uint32_t serverIP = net.clientSide().getIP();
+        second.getFastOpenCookies().storeCookie(serverIP, SERVER_PORT, net.client().getFastOpenCookies().cachedCookie(serverIP, SERVER_PORT) ^ 1);
+    }
+
+    std::vector<uint8_t> message(200);
+    for (size_t i = 0; i < message.size(); i++) message[i] = static_cast<uint8_t>(i * 7);
+
+    Clock::time_point start = net.now();
+    second.sendMessage(SERVER_PORT, message);
+    net.start(SECOND_PORT);
+
+    std::pair<uint16_t, std::vector<uint8_t>> received;
+    bool beforeHandshake = false;
+    bool delivered = net.runUntil([&] {
+        if (!net.server().receiveMessage(received)) return false;
+        beforeHandshake = net.clientSide(SECOND_PORT).getState() == static_cast<uint8_t>(STATE::SYN_SENT);
+        return true;
+    }, std::chrono::seconds(30));
+    uint64_t dataOnSyn = second.getStats().fast_open_data_sent;
+    uint64_t accepted = net.server().getStats().fast_open_accepted;
+
+    report
+        .value("latency_ms", net.msSince(start))
+        .value("data_on_syn", dataOnSyn)
+        .value("accepted", accepted)
+        .value("before_handshake", beforeHandshake)
+        .check("intact", delivered && received.first == SECOND_PORT && received.second == message);
+    if (mode == FastOpenMode::ON) {
+        report
+            .check("whole message on SYN", dataOnSyn == message.size() + Client::FRAME_HEADER_SIZE)
+            .check("accepted == 1", accepted == 1)
+            .check("before_handshake", beforeHandshake);
+    } else {
+        report
+            .check(enabled ? "data on SYN" : "no data on SYN", enabled ? dataOnSyn > 0 : dataOnSyn == 0)
+            .check("accepted == 0", accepted == 0)
+            .check("after handshake", !beforeHandshake);
+    }
+    return report.check("closed", net.close()).print();
+}
+
+// Chat style text over a bandwidth limited link; compression is used only when both sides enable it. wire_bytes
+// counts every datagram delivered in either direction, headers and ACKs included, against raw_bytes of text.
+static bool compressionScenario(const char* name, uint64_t seed, const LinkConfig& link, bool serverCompression, bool clientCompression) {
+    Report report(name);
+    SimHarness net(seed, link);
+    net.server().setWindowSize(16000);
+    net.server().setCompression(serverCompression);
+    net.client().setCompression(clientCompression);
+    if (!net.establish()) return report.check("established", false).print();
+
+    const char* names[] = {"alice", "bob", "carol", "dave"};
+    const char* words[] = {"hey", "are", "you", "joining", "the", "call", "later", "sounds", "good", "see", "you", "there"};
+    std::vector<uint8_t> expected;
+    for (size_t i = 0; i < 800; i++) {
+        std::string line = "{\"from\":\"" + std::string(names[i % 4]) + "\",\"room\":\"general\",\"seq\":" + std::to_string(i) + ",\"text\":\"";
+        for (size_t w = 0; w < 3 + i % 5; w++) line += std::string(words[(i * 7 + w * 3) % 12]) + " ";
+        line += "\"}\n";
+        expected.insert(expected.end(), line.begin(), line.end());
+    }
+    std::vector<uint8_t> received;
+    uint64_t wireBefore = net.network().getStats().bytes_delivered;
+
+    Clock::time_point start = net.now();
+    net.input().push(expected);
+    bool delivered = net.runUntil([&] {drain(net.serverSide(), received); return received.size() >= expected.size();}, std::chrono::minutes(10));
+    double elapsedMs = net.msSince(start);
+    uint64_t compressedSegments = net.client().getStats().compressed_segments;
+    uint64_t wireBytes = net.network().getStats().bytes_delivered - wireBefore;
+    bool compressed = serverCompression && clientCompression;
+
+    return report
+        .value("elapsed_ms", elapsedMs)
+        .value("compressed_segments", compressedSegments)
+        .value("raw_bytes", expected.size())
+        .value("wire_bytes", wireBytes)
+        .check("intact", delivered && received == expected)
+        .check(compressed ? "compressed_segments > 0" : "compressed_segments == 0", (compressedSegments > 0) == compressed)
+        .check(compressed ? "wire_bytes < raw_bytes" : "wire_bytes > raw_bytes", compressed ? wireBytes < expected.size() : wireBytes > expected.size())
+        .check("closed", net.close())
+        .print();
+}
+
+int main(int argc, char* argv[]) {
+    Logger::setPriority(LogLevel::CRITICAL);
+
+    uint64_t seed = (argc > 1) ? std::stoull(argv[1]) : 42;
+
+    LinkConfig clean;
+    clean.bandwidth_bps = 10e6;
+    clean.delay = std::chrono::milliseconds(20);
+
+    LinkConfig lossy = clean;
+    lossy.jitter = std::chrono::milliseconds(5);
+    lossy.loss = 0.02;
+    lossy.burst_start = 0.005;
+    lossy.burst_end = 0.5;
+    lossy.reorder = 0.01;
+    lossy.reorder_delay = std::chrono::milliseconds(15);
+
+    LinkConfig mobile = clean;
+    mobile.loss = 0.07;
+
+    LinkConfig narrow = clean;
+    narrow.bandwidth_bps = 1e6;
+
+    LinkConfig wan;
+    wan.delay = std::chrono::milliseconds(20);
+    wan.bandwidth_bps = 10e6;
+
+    LinkConfig longFat;
+    longFat.delay = std::chrono::milliseconds(50);
+    longFat.bandwidth_bps = 100e6;
+
+    LinkConfig distant = clean;
+    distant.delay = std::chrono::milliseconds(50);
+
+    int scenarios = 0;
+    int failed = 0;
+    auto run = [&](bool passed) {
+        scenarios++;
+        if (!passed) failed++;
+    };
+
+    run(transferScenario("clean", runTransfer(seed, clean, 50, 200)));
+
+    Transfer lossyRun = runTransfer(seed, lossy, 50, 200);
+    Transfer replayRun = runTransfer(seed, lossy, 50, 200);
+    run(transferScenario("lossy", lossyRun));
+    run(Report("replay")
+        .value("elapsed_ms", replayRun.elapsed_ms)
+        .value("sent", replayRun.stats.packets_sent)
+        .value("lost", replayRun.stats.packets_lost)
+        .check("same trace as lossy", replayRun.elapsed_ms == lossyRun.elapsed_ms && replayRun.p99_ms == lossyRun.p99_ms
+            && replayRun.stats.packets_sent == lossyRun.stats.packets_sent && replayRun.stats.packets_lost == lossyRun.stats.packets_lost)
+        .print());
+
+    run(streamScenario(seed, lossy, 20000, 20, 100));
+    run(messageScenario(seed, lossy));
+    run(brokenFrameScenario(seed, clean));
+    run(messageWindowScenario(seed, clean));
+    run(streamWindowScenario(seed, clean, 20000));
+    run(unicastScenario(seed, lossy, 6000));
+    run(pathMtuScenario(seed, clean, 30000));
+
+    run(fecScenario("arq", seed, mobile, 100000, 0));
+    run(fecScenario("fec", seed, mobile, 100000, 4));
+    run(fecScenario("fec-exact", seed, clean, 100000, 4, true));
+    run(fecOneSidedScenario(seed, clean, 30000));
+
+    run(compressionScenario("raw", seed, narrow, false, false));
+    run(compressionScenario("lz4", seed, narrow, true, true));
+    run(compressionScenario("one-sided", seed, narrow, true, false));
+
+    run(wrapScenario(seed, lossy, 30000));
+    run(receiveWindowScenario(seed, wan, 200000));
+
+    run(windowScaleScenario("wscale-off", seed, longFat, 4000000, false));
+    run(windowScaleScenario("wscale-on", seed, longFat, 4000000, true));
+
+    run(fastOpenScenario("tfo-off", seed, distant, FastOpenMode::OFF));
+    run(fastOpenScenario("tfo-on", seed, distant, FastOpenMode::ON));
+    run(fastOpenScenario("tfo-stale", seed, distant, FastOpenMode::STALE_COOKIE));
+
+    if (failed) std::cout << "FAIL " << failed << " of " << scenarios << " scenarios" << std::endl;
+    else std::cout << "PASS" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,312 @@
+// Turns a binary log (Logger::enableBinaryOutput) back into the text lines the other modes write, in order.
+// Each record's format string is applied one conversion at a time with the C type its length modifier names,
+// so the output matches what snprintf made of the original arguments.
+//
+//   make logdecode ARGS="logs/app_251019_120000.bin app.log"       (no output file = stdout)
+#include "Logger.hpp"
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+
+struct DecodedSite {
+    LogLevel level;
+    int line;
+    std::string sourceFile;
+    std::string format;
+    std::string kinds;
+};
+
+// Cursor over a whole file or one record's arguments; every read fails once the data runs out.
+class ByteReader {
+    private:
+        const char* data;
+        size_t size;
+        size_t pos = 0;
+
+    public:
+        ByteReader(const char* data, size_t size) : data(data), size(size) {}
+
+        template<typename T>
+        bool read(T& value) {
+            if (size - pos < sizeof(value)) return false;
+            std::memcpy(&value, data + pos, sizeof(value));
+            pos += sizeof(value);
+            return true;
+        }
+
+        bool readString(std::string& value) {
+            uint16_t length;
+            if (!read(length) || size - pos < length) return false;
+            value.assign(data + pos, length);
+            pos += length;
+            return true;
+        }
+
+        bool readBytes(size_t length, const char*& bytes) {
+            if (size - pos < length) return false;
+            bytes = data + pos;
+            pos += length;
+            return true;
+        }
+
+        bool done() const {return pos == size;}
+        size_t offset() const {return pos;}
+};
+
+// Arguments of one record in call order; a missing one (truncated record) reads as 0 / "".
+class ArgReader {
+    private:
+        ByteReader bytes;
+        const std::string& kinds;
+        size_t next = 0;
+
+    public:
+        ArgReader(const char* data, size_t size, const std::string& kinds) : bytes(data, size), kinds(kinds) {}
+
+        uint64_t integer() {
+            char kind = next < kinds.size() ? kinds[next++] : '\0';
+            if (kind == 's') {
+                std::string skipped;
+                bytes.readString(skipped);
+                return 0;
+            }
+            if (kind == 'd') return static_cast<uint64_t>(real(kind));
+            uint64_t value = 0;
+            bytes.read(value);
+            return value;
+        }
+
+        double real() {
+            char kind = next < kinds.size() ? kinds[next++] : '\0';
+            return real(kind);
+        }
+
+        std::string text() {
+            char kind = next < kinds.size() ? kinds[next++] : '\0';
+            std::string value;
+            uint64_t skipped;
+            if (kind == 's') bytes.readString(value);
+            else if (kind) bytes.read(skipped);
+            return value;
+        }
+
+    private:
+        double real(char kind) {
+            if (kind == 'd') {
+                double value = 0.0;
+                bytes.read(value);
+                return value;
+            }
+            uint64_t value = 0;
+            bytes.read(value);
+            return kind == 'i' ? static_cast<double>(static_cast<int64_t>(value)) : static_cast<double>(value);
+        }
+};
+
+template<typename T>
+static void printOne(std::string& out, const std::string& spec, const std::vector<int>& stars, T value) {
+    char buffer[1024];
+    int written;
+    if (stars.empty()) written = std::snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+    else if (stars.size() == 1) written = std::snprintf(buffer, sizeof(buffer), spec.c_str(), stars[0], value);
+    else written = std::snprintf(buffer, sizeof(buffer), spec.c_str(), stars[0], stars[1], value);
+    if (written > 0) out.append(buffer, std::min(static_cast<size_t>(written), sizeof(buffer) - 1));
+}
+
+static void printSigned(std::string& out, const std::string& spec, const std::vector<int>& stars, const std::string& length, uint64_t bits) {
+    int64_t value = static_cast<int64_t>(bits);
+    if (length == "hh") printOne(out, spec, stars, static_cast<signed char>(value));
+    else if (length == "h") printOne(out, spec, stars, static_cast<short>(value));
+    else if (length == "l") printOne(out, spec, stars, static_cast<long>(value));
+    else if (length == "ll" || length == "q") printOne(out, spec, stars, static_cast<long long>(value));
+    else if (length == "j") printOne(out, spec, stars, static_cast<intmax_t>(value));
+    else if (length == "z" || length == "t") printOne(out, spec, stars, static_cast<ptrdiff_t>(value));
+    else printOne(out, spec, stars, static_cast<int>(value));
+}
+
+static void printUnsigned(std::string& out, const std::string& spec, const std::vector<int>& stars, const std::string& length, uint64_t value) {
+    if (length == "hh") printOne(out, spec, stars, static_cast<unsigned char>(value));
+    else if (length == "h") printOne(out, spec, stars, static_cast<unsigned short>(value));
+    else if (length == "l") printOne(out, spec, stars, static_cast<unsigned long>(value));
+    else if (length == "ll" || length == "q") printOne(out, spec, stars, static_cast<unsigned long long>(value));
+    else if (length == "j") printOne(out, spec, stars, static_cast<uintmax_t>(value));
+    else if (length == "z" || length == "t") printOne(out, spec, stars, static_cast<size_t>(value));
+    else printOne(out, spec, stars, static_cast<unsigned>(value));
+}
+
+static std::string formatRecord(const DecodedSite& site, const char* data, size_t size) {
+    const std::string& format = site.format;
+    ArgReader args(data, size, site.kinds);
+    if (site.kinds.empty()) return format;          // logged as "%s" of the message, like Logger::format()
+
+    std::string out;
+    for (size_t i = 0; i < format.size(); i++) {
+        if (format[i] != '%') {
+            out += format[i];
+            continue;
+        }
+        size_t start = i++;
+        if (i < format.size() && format[i] == '%') {
+            out += '%';
+            continue;
+        }
+        std::vector<int> stars;
+        while (i < format.size() && std::strchr("-+ #0'", format[i])) i++;
+        if (i < format.size() && format[i] == '*') {
+            stars.push_back(static_cast<int>(args.integer()));
+            i++;
+        }
+        while (i < format.size() && std::isdigit(static_cast<unsigned char>(format[i]))) i++;
+        if (i < format.size() && format[i] == '.') {
+            i++;
+            if (i < format.size() && format[i] == '*') {
+                stars.push_back(static_cast<int>(args.integer()));
+                i++;
+            }
+            while (i < format.size() && std::isdigit(static_cast<unsigned char>(format[i]))) i++;
+        }
+        size_t lengthStart = i;
+        while (i < format.size() && std::strchr("hlLqjzt", format[i])) i++;
+        if (i >= format.size()) {
+            out.append(format, start, std::string::npos);
+            break;
+        }
+        std::string length = format.substr(lengthStart, i - lengthStart);
+        std::string spec = format.substr(start, i + 1 - start);
+
+        switch (format[i]) {
+            case 'd': case 'i':
+                printSigned(out, spec, stars, length, args.integer());
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                printUnsigned(out, spec, stars, length, args.integer());
+                break;
+            case 'c':
+                printOne(out, format.substr(start, lengthStart - start) + "c", stars, static_cast<int>(args.integer()));
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                if (length == "L") printOne(out, spec, stars, static_cast<long double>(args.real()));
+                else printOne(out, spec, stars, args.real());
+                break;
+            case 's':
+                printOne(out, format.substr(start, lengthStart - start) + "s", stars, args.text().c_str());
+                break;
+            case 'p':
+                printOne(out, spec, stars, reinterpret_cast<void*>(static_cast<uintptr_t>(args.integer())));
+                break;
+            default:                                // %n and anything unknown: print it as written
+                out.append(spec);
+                break;
+        }
+    }
+    return out;
+}
+
+static LogLevel toLevel(uint8_t level) {
+    return level <= static_cast<uint8_t>(LogLevel::CRITICAL) ? static_cast<LogLevel>(level) : LogLevel::CRITICAL;
+}
+
+// Writes the text lines of data to out; false when the file is not a binary log or ends inside an entry.
+static bool decode(const std::string& data, std::ostream& out) {
+    if (data.size() < sizeof(BinaryLog::MAGIC) || std::memcmp(data.data(), BinaryLog::MAGIC, sizeof(BinaryLog::MAGIC)) != 0) {
+        std::cerr << "not a binary log" << std::endl;
+        return false;
+    }
+    ByteReader reader(data.data() + sizeof(BinaryLog::MAGIC), data.size() - sizeof(BinaryLog::MAGIC));
+    std::map<uint32_t, DecodedSite> sites;
+    LogTimestamp timestamp = LogTimestamp::MILLISECONDS;
+    std::string lines;
+
+    while (!reader.done()) {
+        size_t entryStart = reader.offset();
+        char type;
+        bool ok = reader.read(type);
+        if (ok && type == BinaryLog::SITE) {
+            uint32_t id;
+            uint8_t level;
+            int32_t line;
+            DecodedSite site;
+            ok = reader.read(id) && reader.read(level) && reader.read(line) && reader.readString(site.sourceFile) && reader.readString(site.format) && reader.readString(site.kinds);
+            site.level = toLevel(level);
+            site.line = line;
+            if (ok) sites[id] = site;
+        } else if (ok && type == BinaryLog::RECORD) {
+            uint32_t id;
+            int64_t time;
+            uint16_t size;
+            const char* args;
+            ok = reader.read(id) && reader.read(time) && reader.read(size) && reader.readBytes(size, args);
+            if (ok) {
+                auto it = sites.find(id);
+                if (it == sites.end()) {
+                    std::string text = "logdecode - record of unknown call site " + std::to_string(id);
+                    Logger::appendLine(lines, time, timestamp, LogLevel::WARNING, nullptr, 0, text.data(), text.size());
+                } else {
+                    const DecodedSite& site = it->second;
+                    std::string text = formatRecord(site, args, size);
+                    Logger::appendLine(lines, time, timestamp, site.level, site.sourceFile.empty() ? nullptr : site.sourceFile.c_str(), site.line, text.data(), text.size());
+                }
+            }
+        } else if (ok && type == BinaryLog::TEXT) {
+            int64_t time;
+            uint8_t level;
+            int32_t line;
+            std::string sourceFile, text;
+            ok = reader.read(time) && reader.read(level) && reader.read(line) && reader.readString(sourceFile) && reader.readString(text);
+            if (ok) Logger::appendLine(lines, time, timestamp, toLevel(level), sourceFile.empty() ? nullptr : sourceFile.c_str(), line, text.data(), text.size());
+        } else if (ok && type == BinaryLog::DROPPED) {
+            int64_t time;
+            uint64_t count;
+            ok = reader.read(time) && reader.read(count);
+            if (ok) {
+                std::string text = "Logger - " + std::to_string(count) + " lines dropped, ring full";
+                Logger::appendLine(lines, time, timestamp, LogLevel::WARNING, nullptr, 0, text.data(), text.size());
+            }
+        } else if (ok && type == BinaryLog::CLOCK) {
+            uint8_t format;
+            ok = reader.read(format);
+            if (ok) timestamp = format <= static_cast<uint8_t>(LogTimestamp::TICKS) ? static_cast<LogTimestamp>(format) : LogTimestamp::MILLISECONDS;
+        } else if (ok) {
+            std::cerr << "unknown entry '" << type << "' at byte " << sizeof(BinaryLog::MAGIC) + entryStart << std::endl;
+            ok = false;
+        }
+
+        if (!ok) {
+            out << lines;
+            std::cerr << "log ends inside an entry at byte " << sizeof(BinaryLog::MAGIC) + entryStart << std::endl;
+            return false;
+        }
+        if (lines.size() >= 64 * 1024) {
+            out << lines;
+            lines.clear();
+        }
+    }
+    out << lines;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "usage: " << argv[0] << " <binary log> [text log]" << std::endl;
+        return 1;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    if (argc == 3) {
+        std::ofstream out(argv[2]);
+        if (!out) {
+            std::cerr << "cannot open " << argv[2] << std::endl;
+            return 1;
+        }
+        return decode(data, out) ? 0 : 1;
+    }
+    return decode(data, std::cout) ? 0 : 1;
+}
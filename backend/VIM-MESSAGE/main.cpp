@@ -1,5 +1,7 @@
 #include "VIMMessage.hpp"
+#include "ThreadPlacement.hpp"
 #include <csignal>
+#include <cstdlib>
 
 std::atomic<bool> running(true);
 
@@ -25,14 +27,24 @@ int main(int argc, const char* argv[]) {
 
     Logger::setPriority(LogLevel::TRACE);
     Logger::enableFileOutput();
+    Logger::enableAsync();
 
     INFO_SRC("main[main] - Initialized logger and enabled file output");
 
     std::signal(SIGINT, signalHandler);
 
+    // Optional thread placement, e.g. VIM_THREADS="tcp-receiver=2:fifo=50;tcp-sender=3;tcp-connection=4:numa"
+    if (const char* threads = std::getenv("VIM_THREADS")) {
+        if (!ThreadPlacement::configure(threads)) {
+            std::cout << "Invalid VIM_THREADS, expected name=cpus[:fifo=N][:numa];..." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
     VIMMessage vim_message(tcpIP, tcpPort, wsIP, wsPort);
 
     vim_message.start();
+    std::cout << "Thread layout:\n" << ThreadPlacement::report() << std::flush;
 
     while(running) {
         std::this_thread::sleep_for(std::chrono::milliseconds(200));
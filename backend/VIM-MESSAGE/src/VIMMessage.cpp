@@ -1,4 +1,5 @@
 #include "VIMMessage.hpp"
+#include "ThreadPlacement.hpp"
 
 VIMMessage::VIMMessage(
     std::string tcpIP,
@@ -12,6 +13,8 @@ VIMMessage::VIMMessage(
     ws_port(wsPort)
 {
     connection = std::make_unique<Connection>(tcp_port, tcp_IP, tcp_input_queue, clients);
+    connection->setCompression(true);   // chat text compresses well; peers that do not offer it get raw segments
+    connection->setFastOpen(true);      // peers seen before get the first message on the SYN
     TRACE_SRC("VIMMessage[constructor] - TCP[IP:PORT] %s:%u | WS[IP:PORT] %s:%u", tcpIP.c_str(), tcpPort, wsIP.c_str(), wsPort);
 }
 
@@ -50,8 +53,8 @@ bool VIMMessage::websocketHandler() {
                     if(data.getType() == 3 && clients.find(data.getPort()) == clients.end()) {
                         connection->addClient(data.getPort(), data.getIP());
                     }
-                    tcp_input_queue.push(std::move(payloadCopy));
-                    TRACE_SRC("VIMMessage[websocketHandler] - Forward data to tcp input queue");
+                    connection->broadcastMessage(payloadCopy);
+                    TRACE_SRC("VIMMessage[websocketHandler] - Forward data to tcp peers");
                 }
                 return true;
             }
@@ -60,54 +63,52 @@ bool VIMMessage::websocketHandler() {
 }
 
 bool VIMMessage::tcpHandler() {
-    std::vector<uint8_t> new_packet;
-    bool hasData = false;
-    for(auto& [port, client] : clients) {
-        if(client.receivedData.tryPop(new_packet)) {
-            auto decode_packet = VIMPacket::decodePacket(new_packet);
-            if(!decode_packet.has_value()) continue;
-            TRACE_SRC("VIMMessage[tcpHandler] - Received packet from client and pushing forward");
-            hasData = true;
-            auto decoded_packet = decode_packet.value();
-            switch(decoded_packet.getType()) {
-                case 1: {
-                        auto confirm_packet = VIMPacket::createPacket(2, decoded_packet.getUserId(), decoded_packet.getMsgId(), decoded_packet.getMsgData());
-                        auto frame = WebSocketFrame(true, false, false, false, static_cast<uint8_t>(WebSocketFrame::OPCODE::BINARY), false, static_cast<uint64_t>(confirm_packet.size()), 0, std::move(confirm_packet));
-                        ws_sender_queue.push(frame.encodeFrame());
-                        TRACE_SRC("VIMMessage[tcpHandler] - 1: Forwarded to WS sender queue");
-                        break;
-                    }
-                case 2: 
-                    TRACE_SRC("tcpHandler - Received type 2 packet");
-                    decoded_packet.printPacket();
-                    break;
-                case 3: { 
-                    auto confirm_packet = VIMPacket::createPacket(4, decoded_packet.getIP(), decoded_packet.getPort(), 1);
-                    auto confirm_packet_tcp = confirm_packet;
-                    auto frame = WebSocketFrame(true, false, false, false, static_cast<uint8_t>(WebSocketFrame::OPCODE::BINARY), false, static_cast<uint64_t>(confirm_packet.size()), 0, std::move(confirm_packet));
-                    ws_sender_queue.push(frame.encodeFrame());
-                    tcp_input_queue.push(std::move(confirm_packet_tcp));
-                    TRACE_SRC("VIMMessage[tcpHandler] - 3: Send confirm packet to WS + TCP");
-                    break;
-                }
-                case 4: {
-                    auto confirm_packet = VIMPacket::createPacket(4, decoded_packet.getIP(), decoded_packet.getPort(), 1);
-                    auto frame = WebSocketFrame(true, false, false, false, static_cast<uint8_t>(WebSocketFrame::OPCODE::BINARY), false, static_cast<uint64_t>(confirm_packet.size()), 0, std::move(confirm_packet));
-                    ws_sender_queue.push(frame.encodeFrame());
-                    TRACE_SRC("VIMMessage[tcpHandler] - 4: Send confirm to WS Sender");
-                    break;
-                }
-                default:
-                    hasData = false;
-                    continue;
+    std::pair<uint16_t, std::vector<uint8_t>> new_message;
+    if(!connection->receiveMessage(new_message)) return false;
+
+    auto decode_packet = VIMPacket::decodePacket(new_message.second);
+    if(!decode_packet.has_value()) return true;
+    TRACE_SRC("VIMMessage[tcpHandler] - Received packet from client[PORT=%u] and pushing forward", new_message.first);
+    bool hasData = true;
+    auto decoded_packet = decode_packet.value();
+    switch(decoded_packet.getType()) {
+        case 1: {
+                auto confirm_packet = VIMPacket::createPacket(2, decoded_packet.getUserId(), decoded_packet.getMsgId(), decoded_packet.getMsgData());
+                auto frame = WebSocketFrame(true, false, false, false, static_cast<uint8_t>(WebSocketFrame::OPCODE::BINARY), false, static_cast<uint64_t>(confirm_packet.size()), 0, std::move(confirm_packet));
+                ws_sender_queue.push(frame.encodeFrame());
+                TRACE_SRC("VIMMessage[tcpHandler] - 1: Forwarded to WS sender queue");
+                break;
             }
+        case 2: 
+            TRACE_SRC("tcpHandler - Received type 2 packet");
+            decoded_packet.printPacket();
+            break;
+        case 3: { 
+            auto confirm_packet = VIMPacket::createPacket(4, decoded_packet.getIP(), decoded_packet.getPort(), 1);
+            auto confirm_packet_tcp = confirm_packet;
+            auto frame = WebSocketFrame(true, false, false, false, static_cast<uint8_t>(WebSocketFrame::OPCODE::BINARY), false, static_cast<uint64_t>(confirm_packet.size()), 0, std::move(confirm_packet));
+            ws_sender_queue.push(frame.encodeFrame());
+            connection->sendMessage(new_message.first, confirm_packet_tcp);
+            TRACE_SRC("VIMMessage[tcpHandler] - 3: Send confirm packet to WS + requesting peer");
+            break;
+        }
+        case 4: {
+            auto confirm_packet = VIMPacket::createPacket(4, decoded_packet.getIP(), decoded_packet.getPort(), 1);
+            auto frame = WebSocketFrame(true, false, false, false, static_cast<uint8_t>(WebSocketFrame::OPCODE::BINARY), false, static_cast<uint64_t>(confirm_packet.size()), 0, std::move(confirm_packet));
+            ws_sender_queue.push(frame.encodeFrame());
+            TRACE_SRC("VIMMessage[tcpHandler] - 4: Send confirm to WS Sender");
+            break;
         }
+        default:
+            hasData = false;
+            break;
     }
     return hasData;
 }
 
 
 void VIMMessage::startMessageHandler() {
+    ThreadPlacement::apply("vim-handler");
     INFO_SRC("VIMMessage[startMessageHandler] - Started");
     while (running) {
         
@@ -0,0 +1,98 @@
+#ifndef BINARYLOG_HPP
+#define BINARYLOG_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// Wire format of Logger's binary mode, shared by the Logger writer and tools/logdecode. Host byte order.
+//
+//   file    = MAGIC entry*
+//   SITE    = 'S' u32 id, u8 level, i32 line, str file, str format, str kinds     one per call site, before its first RECORD
+//   RECORD  = 'R' u32 id, i64 time, u16 size, args[size]                          one log call through a macro
+//   TEXT    = 'T' i64 time, u8 level, i32 line, str file, str text                already formatted, Logger::trace() & co.
+//   DROPPED = 'D' i64 time, u64 lines                                             lines lost to a full ring
+//   CLOCK   = 'C' u8 LogTimestamp                                                 how to read the times after it
+//   str     = u16 size, bytes (file size 0 = no file:line)
+//   time    = ns since the system_clock epoch, or ticks after a CLOCK of TICKS (the file starts as MILLISECONDS)
+//
+// args holds one value per kind: 'i' i64, 'u' u64, 'd' double, 'p' u64 pointer, 's' str (truncated to fit).
+class BinaryLog {
+    public:
+        static constexpr char MAGIC[8] = {'T', 'C', 'P', 'L', 'O', 'G', '0', '1'};
+        static constexpr char SITE = 'S';
+        static constexpr char RECORD = 'R';
+        static constexpr char TEXT = 'T';
+        static constexpr char DROPPED = 'D';
+        static constexpr char CLOCK = 'C';
+
+        template<typename T>
+        static constexpr char kindOf() {
+            if constexpr (std::is_same_v<T, char*> || std::is_same_v<T, const char*>) return 's';
+            else if constexpr (std::is_pointer_v<T>) return 'p';
+            else if constexpr (std::is_enum_v<T>) return kindOf<std::underlying_type_t<T>>();
+            else if constexpr (std::is_floating_point_v<T>) return 'd';
+            else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) return 'i';
+            else if constexpr (std::is_integral_v<T>) return 'u';
+            else static_assert(std::is_integral_v<T>, "binary logging takes integers, floating point, pointers and C strings");
+        }
+
+        // Argument kinds of a call site as a type, so the macros can name it with decltype() without
+        // evaluating the arguments.
+        template<typename... Args>
+        struct Kinds {
+            static constexpr char value[sizeof...(Args) + 1] = {kindOf<std::decay_t<Args>>()..., '\0'};
+        };
+
+        // Appends value at out, never past end; out ends up after it.
+        template<typename T>
+        static void encode(char*& out, const char* end, T value) {
+            constexpr char kind = kindOf<T>();
+            if constexpr (kind == 's') {
+                const char* text = value ? value : "(null)";
+                size_t room = static_cast<size_t>(end - out);
+                if (room < sizeof(uint16_t)) return;
+                size_t size = std::min(std::strlen(text), room - sizeof(uint16_t));
+                put(out, static_cast<uint16_t>(size));
+                std::memcpy(out, text, size);
+                out += size;
+            } else if constexpr (kind == 'p') {
+                putWithin(out, end, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+            } else if constexpr (kind == 'd') {
+                putWithin(out, end, static_cast<double>(value));
+            } else if constexpr (std::is_enum_v<T>) {
+                encode(out, end, static_cast<std::underlying_type_t<T>>(value));
+            } else if constexpr (kind == 'i') {
+                putWithin(out, end, static_cast<int64_t>(value));
+            } else {
+                putWithin(out, end, static_cast<uint64_t>(value));
+            }
+        }
+
+        template<typename T>
+        static void put(char*& out, T value) {
+            std::memcpy(out, &value, sizeof(value));
+            out += sizeof(value);
+        }
+
+        template<typename T>
+        static void append(std::string& out, T value) {
+            out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+
+        static void appendString(std::string& out, const char* text, size_t size) {
+            append(out, static_cast<uint16_t>(size));
+            out.append(text, size);
+        }
+
+    private:
+        template<typename T>
+        static void putWithin(char*& out, const char* end, T value) {
+            if (static_cast<size_t>(end - out) >= sizeof(value)) put(out, value);
+        }
+};
+
+#endif
@@ -3,12 +3,34 @@
 
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <string>
 #include <mutex>
 #include <chrono>
-#include <iomanip>
-
+#include <charconv>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "BinaryLog.hpp"
+#include "SpscQueue.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+// Lowest level compiled in, as a number: 0 TRACE, 1 DEBUG, 2 INFO, 3 WARNING, 4 ERROR, 5 CRITICAL.
+// Log macros below it compile to nothing (their arguments are still type checked, never evaluated).
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
 
 enum class LogLevel {
     TRACE,      // Detailed and used for deep debugging internal functions or variables.
@@ -19,67 +41,404 @@ enum class LogLevel {
     CRITICAL    // Severe error causing program failure
 };
 
+// How lines are timestamped: local time to the millisecond (the default) or microsecond, or the raw monotonic
+// tick count (TSC on x86, steady_clock ns elsewhere), which is the cheapest to read and only good for intervals.
+enum class LogTimestamp : uint8_t {
+    MILLISECONDS,
+    MICROSECONDS,
+    TICKS
+};
+
+// One line waiting for the async writer. Fixed size, so logging never allocates and a full ring drops the line.
+struct LogRecord {
+    int64_t time;                                       // ns since the system_clock epoch, or ticks
+    const char* sourceFile;                             // nullptr = logged without file:line
+    int line;
+    LogLevel level;
+    uint16_t length;
+    LogTimestamp timestamp;                             // the setting when it was logged
+    char text[997];                                     // formatted message, not terminated
+};
+
+// One slot of a binary mode ring. A record is a BinaryLogHeader and its payload over as many consecutive
+// chunks as that takes, most take one.
+struct alignas(64) LogChunk {
+    char bytes[64];
+};
+
+struct BinaryLogHeader {
+    int64_t time;                                       // ns since the system_clock epoch, or ticks
+    uint32_t site;                                      // 0 = not from a log macro, the payload is a BinaryLog TEXT body after its time
+    uint16_t length;                                    // payload bytes
+    uint8_t chunks;
+    LogTimestamp timestamp;
+};
+
+// Renders "YYYY-MM-DD HH:MM:SS.mmm[uuu]" local time. The date and time part goes through localtime_r only
+// when the second changes; the fraction is written with integer arithmetic. One per thread.
+class TimestampCache {
+    private:
+        int64_t second = INT64_MIN;
+        char prefix[20];                                // "YYYY-MM-DD HH:MM:SS"
+        size_t prefixLength = 0;
+
+    public:
+        // fractionDigits: 3 or 6
+        void append(std::string& out, int64_t nanoseconds, int fractionDigits) {
+            int64_t now = nanoseconds / 1000000000;
+            int64_t fraction = nanoseconds % 1000000000;
+            if (fraction < 0) {
+                now--;
+                fraction += 1000000000;
+            }
+            if (now != second) {
+                std::time_t t = static_cast<std::time_t>(now);
+                std::tm tm{};
+                localtime_r(&t, &tm);
+                prefixLength = std::strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &tm);
+                second = now;
+            }
+            char digits[7];
+            int64_t value = fraction / (fractionDigits == 6 ? 1000 : 1000000);
+            for (int i = fractionDigits - 1; i >= 0; i--) {
+                digits[i] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+            out.append(prefix, prefixLength);
+            out += '.';
+            out.append(digits, fractionDigits);
+        }
+};
+
+// A log macro call site, registered the first time it logs. Binary mode writes it once per file.
+struct LogSite {
+    LogLevel level;
+    const char* sourceFile;                             // nullptr = logged without file:line
+    int line;
+    const char* format;
+    const char* kinds;                                  // BinaryLog::Kinds of the arguments
+};
+
+static_assert(sizeof(LogRecord) == 1024, "one LogRecord per ring slot, 1 KB");
+
 class Logger {
+    public:
+        static constexpr size_t DEFAULT_RING_CAPACITY = 1024;                       // records per thread
+        static constexpr size_t DEFAULT_BINARY_RING_CAPACITY = 16 * 1024;           // chunks per thread, the same 1 MB
+        static constexpr std::chrono::milliseconds DEFAULT_FLUSH_INTERVAL{100};
+
     private:
-        inline static LogLevel priority;
+        static constexpr size_t BATCH_SIZE = 64 * 1024;                             // bytes per file write
+        static constexpr std::chrono::milliseconds WRITER_IDLE_WAIT{1};
+        static constexpr size_t MAX_BINARY_RECORD = sizeof(LogRecord);             // header and payload, 16 chunks
+
+        inline static std::atomic<LogLevel> priority{LogLevel::TRACE};
+        inline static std::atomic<LogTimestamp> timestamp_format{LogTimestamp::MILLISECONDS};
         std::string filename;
         std::ofstream file;
 
-        inline static std::mutex log_mtx;
+        inline static std::mutex log_mtx;                                           // file
+
+        // Async mode: every thread that logs owns a ring only it writes to, the writer thread drains them all.
+        inline static std::atomic<bool> async{false};
+        inline static std::atomic<uint64_t> dropped{0};
+        std::mutex ring_mtx;                                                        // rings, taken once per thread and by the writer
+        std::vector<std::shared_ptr<SpscQueue<LogRecord>>> rings;
+        std::atomic<size_t> ring_capacity{DEFAULT_RING_CAPACITY};
+        std::chrono::milliseconds flush_interval{DEFAULT_FLUSH_INTERVAL};
+        std::atomic<bool> writer_running{false};
+        std::thread writer;
+
+        // Binary mode: macro calls copy their raw arguments instead of formatting, tools/logdecode formats them.
+        // Records go through rings of small chunks, so a record touches one or two cache lines, not 1 KB.
+        inline static std::atomic<bool> binary{false};
+        inline static std::mutex site_mtx;                                          // sites
+        inline static std::deque<LogSite> sites;                                    // id - 1
+        std::vector<std::shared_ptr<SpscQueue<LogChunk>>> binary_rings;             // ring_mtx
+        std::atomic<size_t> binary_ring_capacity{DEFAULT_BINARY_RING_CAPACITY};
+        bool binary_file = false;                                                   // log_mtx; from before the binary file opens until it closes
+        std::vector<bool> sites_written;                                            // writer only
+        LogTimestamp file_timestamp = LogTimestamp::MILLISECONDS;                   // writer only, last CLOCK entry
 
         
         Logger() = default;
         Logger(const Logger&) = delete;
         Logger& operator=(const Logger&) = delete;
-        ~Logger() {closeFile();}
+        ~Logger() {
+            stopWriter();
+            closeFile();
+        }
 
         static Logger& getInstance() {
             static Logger instance;
             return instance;
         }
 
+        template<typename... Args>
+        static size_t format(char* out, size_t size, const char* msg, Args... args) {
+            int written;
+            if constexpr (sizeof...(args) == 0) {
+                written = std::snprintf(out, size, "%s", msg);
+            } else {
+                written = std::snprintf(out, size, msg, args...);
+            }
+            return written < 0 ? 0 : std::min(static_cast<size_t>(written), size - 1);
+        }
 
+        // sourceFile == nullptr: no (file:line)
         template<typename... Args>
         void log(int line, const char* sourceFile, LogLevel level, const char* msg, Args... args) {
-            if (level < priority) return; 
+            if (!enabled(level)) return;
+            if (binary.load(std::memory_order_relaxed)) {
+                pushBinaryText(line, sourceFile, level, msg, args...);
+                return;
+            }
+            if (async.load(std::memory_order_relaxed)) {
+                push(line, sourceFile, level, msg, args...);
+                return;
+            }
             char buffer[1024];
+            size_t length = format(buffer, sizeof(buffer), msg, args...);
+
+            LogTimestamp format = timestamp_format.load(std::memory_order_relaxed);
+            std::string out;
+            appendLine(out, now(format), format, level, sourceFile, line, buffer, length);
+
+            // Switching binary mode on or off: a text line would make the binary file undecodable.
             std::lock_guard<std::mutex> lock(log_mtx);
-            
-            if constexpr(sizeof...(args) == 0) {
-                std::snprintf(buffer, sizeof(buffer), "%s", msg);
-            } else {
-                std::snprintf(buffer, sizeof(buffer), msg, args...);
+            if (binary_file) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            } else if (file.is_open()) {
+                file << out;
+                file.flush();
             }
-            
-            std::ostringstream oss;
-            oss << timestamp() << " [" << levelToStr(level) << "] (" 
-                << sourceFile << ":" << line << ") " << buffer << std::endl;
+        }
 
-            if (file.is_open()) {
-                file << oss.str();
-                file.flush();
+        // Caller's side of async mode: format the message into the thread's ring, nothing else.
+        template<typename... Args>
+        void push(int line, const char* sourceFile, LogLevel level, const char* msg, Args... args) {
+            SpscQueue<LogRecord>* ring = threadRing(rings, ring_capacity);
+            LogRecord* record = ring->claim();
+            if (!record) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
             }
+            record->timestamp = timestamp_format.load(std::memory_order_relaxed);
+            record->time = now(record->timestamp);
+            record->sourceFile = sourceFile;
+            record->line = line;
+            record->level = level;
+            record->length = static_cast<uint16_t>(format(record->text, sizeof(record->text), msg, args...));
+            ring->publish();
         }
 
+        // Caller's side of binary mode: copy the arguments, C strings by value, into the thread's ring.
         template<typename... Args>
-        void log(LogLevel level, const char* msg, Args... args) {
-            if (level < priority) return; 
-            char buffer[1024];
-            std::lock_guard<std::mutex> lock(log_mtx);
-           
-            if constexpr (sizeof...(args) == 0) {
-                std::snprintf(buffer, sizeof(buffer), "%s", msg);
-            } else {
-                std::snprintf(buffer, sizeof(buffer), msg, args...);
+        void pushBinary(uint32_t site, Args... args) {
+            char record[MAX_BINARY_RECORD];
+            char* out = record + sizeof(BinaryLogHeader);
+            (BinaryLog::encode(out, record + sizeof(record), args), ...);
+            commitBinary(site, record, static_cast<size_t>(out - record));
+        }
+
+        // Calls that do not come through a macro have no call site, they are formatted as in async mode.
+        template<typename... Args>
+        void pushBinaryText(int line, const char* sourceFile, LogLevel level, const char* msg, Args... args) {
+            char record[MAX_BINARY_RECORD];
+            char* end = record + sizeof(record);
+            char* out = record + sizeof(BinaryLogHeader);
+            BinaryLog::put(out, static_cast<uint8_t>(level));
+            BinaryLog::put(out, static_cast<int32_t>(line));
+            BinaryLog::encode(out, end, sourceFile ? sourceFile : "");
+            if (end - out < 3) return;
+            uint16_t length = static_cast<uint16_t>(format(out + sizeof(length), end - out - sizeof(length), msg, args...));
+            BinaryLog::put(out, length);
+            commitBinary(0, record, static_cast<size_t>(out + length - record));
+        }
+
+        // record holds the payload after room for the header, size bytes in all.
+        void commitBinary(uint32_t site, char* record, size_t size) {
+            LogTimestamp format = timestamp_format.load(std::memory_order_relaxed);
+            BinaryLogHeader header{now(format), site, static_cast<uint16_t>(size - sizeof(BinaryLogHeader)), static_cast<uint8_t>((size + sizeof(LogChunk) - 1) / sizeof(LogChunk)), format};
+            std::memcpy(record, &header, sizeof(header));
+
+            SpscQueue<LogChunk>* ring = threadRing(binary_rings, binary_ring_capacity);
+            if (!ring->reserve(header.chunks)) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            for (size_t i = 0; i < header.chunks; i++) {
+                size_t offset = i * sizeof(LogChunk);
+                std::memcpy(ring->reserved(i).bytes, record + offset, std::min(sizeof(LogChunk), size - offset));
             }
+            ring->publish(header.chunks);
+        }
 
-            std::ostringstream oss;
-            oss << timestamp() << " [" << levelToStr(level) << "] " 
-                << buffer << std::endl;
+        // One ring per thread and record type, registered for the writer the first time the thread logs.
+        template<typename T>
+        SpscQueue<T>* threadRing(std::vector<std::shared_ptr<SpscQueue<T>>>& registry, const std::atomic<size_t>& capacity) {
+            thread_local std::shared_ptr<SpscQueue<T>> ring;
+            if (!ring) {
+                ring = std::make_shared<SpscQueue<T>>(capacity.load(std::memory_order_relaxed));
+                std::lock_guard<std::mutex> lock(ring_mtx);
+                registry.push_back(ring);
+            }
+            return ring.get();
+        }
 
-            if (file.is_open()) {
-                file << oss.str();
-                file.flush();
+        static int64_t now(LogTimestamp format) {
+            if (format == LogTimestamp::TICKS) {
+#if defined(__x86_64__) || defined(__i386__)
+                return static_cast<int64_t>(__rdtsc());
+#else
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+            }
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        // Times in a binary file are read by the last CLOCK entry before them.
+        void appendClock(std::string& batch, LogTimestamp format) {
+            if (format == file_timestamp) return;
+            batch += BinaryLog::CLOCK;
+            BinaryLog::append(batch, static_cast<uint8_t>(format));
+            file_timestamp = format;
+        }
+
+        void appendBinary(std::string& batch, const BinaryLogHeader& header, const char* payload) {
+            appendClock(batch, header.timestamp);
+            if (!header.site) {
+                batch += BinaryLog::TEXT;
+                BinaryLog::append(batch, header.time);
+                batch.append(payload, header.length);
+                return;
+            }
+            if (sites_written.size() < header.site) sites_written.resize(header.site, false);
+            if (!sites_written[header.site - 1]) {
+                LogSite site;
+                {
+                    std::lock_guard<std::mutex> lock(site_mtx);
+                    site = sites[header.site - 1];
+                }
+                batch += BinaryLog::SITE;
+                BinaryLog::append(batch, header.site);
+                BinaryLog::append(batch, static_cast<uint8_t>(site.level));
+                BinaryLog::append(batch, static_cast<int32_t>(site.line));
+                BinaryLog::appendString(batch, site.sourceFile ? site.sourceFile : "", site.sourceFile ? std::strlen(site.sourceFile) : 0);
+                BinaryLog::appendString(batch, site.format, std::strlen(site.format));
+                BinaryLog::appendString(batch, site.kinds, std::strlen(site.kinds));
+                sites_written[header.site - 1] = true;
+            }
+            batch += BinaryLog::RECORD;
+            BinaryLog::append(batch, header.site);
+            BinaryLog::append(batch, header.time);
+            BinaryLog::append(batch, header.length);
+            batch.append(payload, header.length);
+        }
+
+        // Moves whole records into batch until it is full; rings of threads that exited go once empty. Records
+        // of the other mode (logged while switching) are counted as dropped.
+        size_t drain(std::string& batch) {
+            size_t lines = 0;
+            std::lock_guard<std::mutex> lock(ring_mtx);
+            for (auto it = rings.begin(); it != rings.end();) {
+                SpscQueue<LogRecord>& ring = **it;
+                while (batch.size() < BATCH_SIZE) {
+                    LogRecord* record = ring.peek();
+                    if (!record) break;
+                    if (binary_file) dropped.fetch_add(1, std::memory_order_relaxed);
+                    else appendLine(batch, record->time, record->timestamp, record->level, record->sourceFile, record->line, record->text, record->length);
+                    ring.release();
+                    lines++;
+                }
+                if (it->use_count() == 1 && ring.empty()) it = rings.erase(it);
+                else ++it;
+            }
+            char record[MAX_BINARY_RECORD];
+            for (auto it = binary_rings.begin(); it != binary_rings.end();) {
+                SpscQueue<LogChunk>& ring = **it;
+                while (batch.size() < BATCH_SIZE && ring.ready()) {
+                    BinaryLogHeader header;
+                    std::memcpy(&header, ring.peeked(0).bytes, sizeof(header));
+                    for (size_t i = 0; i < header.chunks; i++) std::memcpy(record + i * sizeof(LogChunk), ring.peeked(i).bytes, sizeof(LogChunk));
+                    ring.release(header.chunks);
+                    if (binary_file) appendBinary(batch, header, record + sizeof(header));
+                    else dropped.fetch_add(1, std::memory_order_relaxed);
+                    lines++;
+                }
+                if (it->use_count() == 1 && ring.empty()) it = binary_rings.erase(it);
+                else ++it;
+            }
+            return lines;
+        }
+
+        void writerLoop() {
+            std::string batch;
+            batch.reserve(2 * BATCH_SIZE);
+            uint64_t reported = dropped.load(std::memory_order_relaxed);
+            auto lastFlush = std::chrono::steady_clock::now();
+
+            while (true) {
+                // Read before draining, so everything logged before stopWriter() is written.
+                bool stopping = !writer_running.load(std::memory_order_acquire);
+                size_t lines = drain(batch);
+
+                uint64_t lost = dropped.load(std::memory_order_relaxed);
+                LogTimestamp format = timestamp_format.load(std::memory_order_relaxed);
+                if (lost != reported && binary_file) {
+                    appendClock(batch, format);
+                    batch += BinaryLog::DROPPED;
+                    BinaryLog::append(batch, now(format));
+                    BinaryLog::append(batch, lost - reported);
+                    reported = lost;
+                } else if (lost != reported) {
+                    char note[64];
+                    size_t length = std::snprintf(note, sizeof(note), "Logger - %llu lines dropped, ring full", static_cast<unsigned long long>(lost - reported));
+                    appendLine(batch, now(format), format, LogLevel::WARNING, nullptr, 0, note, length);
+                    reported = lost;
+                }
+
+                auto now = std::chrono::steady_clock::now();
+                bool flushDue = stopping || now - lastFlush >= flush_interval;
+                if (batch.size() >= BATCH_SIZE || (flushDue && !batch.empty())) {
+                    std::lock_guard<std::mutex> lock(log_mtx);
+                    if (file.is_open()) {
+                        file.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+                        if (flushDue) file.flush();
+                    }
+                    batch.clear();
+                }
+                if (flushDue) lastFlush = now;
+
+                if (stopping && !lines) break;
+                if (!lines) std::this_thread::sleep_for(WRITER_IDLE_WAIT);
+            }
+        }
+
+        void startWriter(std::chrono::milliseconds flushInterval, size_t ringCapacity, bool binaryFile) {
+            flush_interval = flushInterval;
+            if (binaryFile) binary_ring_capacity = std::max(ringCapacity, MAX_BINARY_RECORD / sizeof(LogChunk));
+            else ring_capacity = ringCapacity;
+            sites_written.clear();
+            file_timestamp = LogTimestamp::MILLISECONDS;
+            writer_running = true;
+            writer = std::thread(&Logger::writerLoop, this);
+            binary = binaryFile;
+            async = true;
+        }
+
+        // A binary file ends with its writer; log() drops text lines until it is closed, they could not be decoded.
+        void stopWriter() {
+            async = false;
+            binary = false;
+            if (writer.joinable()) {
+                writer_running.store(false, std::memory_order_release);
+                writer.join();
+            }
+            std::lock_guard<std::mutex> lock(log_mtx);
+            if (binary_file) {
+                closeFile();
+                binary_file = false;
             }
         }
 
@@ -93,7 +452,7 @@ class Logger {
             if (file.is_open()) file.close();
         }
         
-        static std::string levelToStr(LogLevel level) {
+        static const char* levelToStr(LogLevel level) {
             switch(level) {
                 case LogLevel::TRACE: return "TRACE";
                 case LogLevel::DEBUG: return "DEBUG";
@@ -107,40 +466,119 @@ class Logger {
 
 
 
-        static std::string timestamp() {
-            auto now = std::chrono::system_clock::now();
-            auto t = std::chrono::system_clock::to_time_t(now);
+        static std::string generateLogFileName(const std::string& prefix = "app", const std::string& extension = ".log") {
+            std::time_t t = std::time(nullptr);
             std::tm tm{};
-            localtime_r(&t, &tm); 
+            localtime_r(&t, &tm);
 
-            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-
-            std::ostringstream oss;
-            oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << "." << std::setfill('0') << std::setw(3) << ms.count();
-            return oss.str();
+            char stamp[16];
+            size_t length = std::strftime(stamp, sizeof(stamp), "%y%m%d_%H%M%S", &tm);
+            return "logs/" + prefix + "_" + std::string(stamp, length) + extension;
         }
 
-        static std::string generateLogFileName(const std::string& prefix = "app") {
-            auto now = std::chrono::system_clock::now();
-            auto t = std::chrono::system_clock::to_time_t(now);
-            std::tm tm{};
-            localtime_r(&t,  &tm);
+    public:
+        static void setPriority(LogLevel newPriority) {priority.store(newPriority, std::memory_order_relaxed);}
 
-            std::ostringstream oss;
+        // Applies to lines logged afterwards; lines already in a ring keep the setting they were logged with.
+        static void setTimestamp(LogTimestamp format) {timestamp_format.store(format, std::memory_order_relaxed);}
 
-            oss << "logs/" << prefix << "_" << std::put_time(&tm, "%y%m%d_%H%M%S") << ".log";
-            return oss.str();
-        }
+        // The runtime level check the log macros make before evaluating any argument.
+        static bool enabled(LogLevel level) {return level >= priority.load(std::memory_order_relaxed);}
 
-    public:
-        static void setPriority(LogLevel newPriority) {priority = newPriority;}
+        // Never called: the log macros pass their arguments to it in a dead branch so the compiler checks them
+        // against the format string (-Wformat), even where the level is compiled out.
+#if defined(__GNUC__)
+        __attribute__((format(printf, 1, 2)))
+#endif
+        static void checkFormat(const char*, ...) {}
         
         static void enableFileOutput(const std::string& newFileName = "") {
             Logger& logger = getInstance();
+            std::lock_guard<std::mutex> lock(log_mtx);
             logger.filename = (newFileName == "") ? generateLogFileName() : newFileName;
             logger.openFile();
         }
 
+        // Async mode: a log call only formats its message into a per thread ring of ringCapacity records, and
+        // a writer thread adds the prefix and writes the lines in batches, flushing every flushInterval. When a
+        // thread's ring is full its lines are dropped and counted instead of waiting; the writer logs how many.
+        // The capacity applies to threads that log for the first time afterwards. disableAsync() writes what is
+        // left and goes back to writing (and flushing) every line on the caller's thread.
+        static void enableAsync(std::chrono::milliseconds flushInterval = DEFAULT_FLUSH_INTERVAL, size_t ringCapacity = DEFAULT_RING_CAPACITY) {
+            Logger& logger = getInstance();
+            logger.stopWriter();
+            logger.startWriter(flushInterval, ringCapacity, false);
+        }
+
+        // Binary mode: async mode into a new binary file (truncated), where a log macro call only copies its
+        // raw arguments and the writer stores them with an id of the call site instead of formatting. Calls
+        // that do not go through a macro are formatted as usual. The per thread rings hold ringCapacity 64 byte
+        // chunks; a record takes 16 bytes and its arguments, 8 per number, 2 + length per string. tools/logdecode
+        // turns the file back into the text lines. disableAsync() writes what is left and closes the file;
+        // enableFileOutput() then starts a text file again.
+        static void enableBinaryOutput(const std::string& newFileName = "", std::chrono::milliseconds flushInterval = DEFAULT_FLUSH_INTERVAL, size_t ringCapacity = DEFAULT_BINARY_RING_CAPACITY) {
+            Logger& logger = getInstance();
+            logger.stopWriter();
+            {
+                std::lock_guard<std::mutex> lock(log_mtx);
+                logger.binary_file = true;
+                logger.filename = (newFileName == "") ? generateLogFileName("app", ".bin") : newFileName;
+                logger.closeFile();
+                logger.file.open(logger.filename, std::ios::binary | std::ios::trunc);
+                if (!logger.file) {
+                    logger.binary_file = false;
+                    throw std::runtime_error("Failed to open log file: " + logger.filename);
+                }
+                logger.file.write(BinaryLog::MAGIC, sizeof(BinaryLog::MAGIC));
+            }
+            logger.startWriter(flushInterval, ringCapacity, true);
+        }
+
+        static void disableAsync() {getInstance().stopWriter();}
+
+        static uint64_t droppedLines() {return dropped.load(std::memory_order_relaxed);}
+
+        // The text line format, also written by tools/logdecode. time is what now(format) returned.
+        static void appendLine(std::string& out, int64_t time, LogTimestamp format, LogLevel level, const char* sourceFile, int line, const char* text, size_t length) {
+            char number[24];
+            if (format == LogTimestamp::TICKS) {
+                out.append(number, std::to_chars(number, number + sizeof(number), time).ptr);
+            } else {
+                thread_local TimestampCache cache;
+                cache.append(out, time, format == LogTimestamp::MICROSECONDS ? 6 : 3);
+            }
+            out += " [";
+            out += levelToStr(level);
+            out += "] ";
+            if (sourceFile) {
+                out += "(";
+                out += sourceFile;
+                out += ":";
+                out.append(number, std::to_chars(number, number + sizeof(number), line).ptr);
+                out += ") ";
+            }
+            out.append(text, length);
+            out += '\n';
+        }
+
+        // For the log macros: each call site registers once, ids start at 1.
+        static uint32_t registerSite(LogLevel level, const char* sourceFile, int line, const char* format, const char* kinds) {
+            std::lock_guard<std::mutex> lock(site_mtx);
+            sites.push_back(LogSite{level, sourceFile, line, format, kinds});
+            return static_cast<uint32_t>(sites.size());
+        }
+
+        // Only named in decltype(), so the macros get the argument kinds without evaluating the arguments.
+        template<typename... Args>
+        static BinaryLog::Kinds<Args...> argKinds(Args... args);
+
+        template<typename... Args>
+        static void logSite(uint32_t site, int line, const char* sourceFile, LogLevel level, const char* msg, Args... args) {
+            Logger& logger = getInstance();
+            if (binary.load(std::memory_order_relaxed)) logger.pushBinary(site, args...);
+            else logger.log(line, sourceFile, level, msg, args...);
+        }
+
         // Logging w/ line+file info
         template<typename... Args>
         static void trace(int line, const char* sourceFile, const char* msg, Args... args) {
@@ -177,49 +615,96 @@ class Logger {
         // Logging w/o line+file info
         template<typename... Args>
         static void trace(const char* msg, Args... args) {
-            getInstance().log(LogLevel::TRACE, msg, args...);
+            getInstance().log(0, nullptr, LogLevel::TRACE, msg, args...);
         }
 
         template<typename... Args>
         static void debug(const char* msg, Args... args) {
-            getInstance().log(LogLevel::DEBUG, msg, args...);
+            getInstance().log(0, nullptr, LogLevel::DEBUG, msg, args...);
         }
 
         template<typename... Args>
         static void info(const char* msg, Args... args) {
-            getInstance().log(LogLevel::INFO, msg, args...);
+            getInstance().log(0, nullptr, LogLevel::INFO, msg, args...);
         }
     
         template<typename... Args>
         static void warning(const char* msg, Args... args) {
-            getInstance().log(LogLevel::WARNING, msg, args...);
+            getInstance().log(0, nullptr, LogLevel::WARNING, msg, args...);
         }
 
         template<typename... Args>
         static void error(const char* msg, Args... args) {
-            getInstance().log(LogLevel::ERROR, msg, args...);
+            getInstance().log(0, nullptr, LogLevel::ERROR, msg, args...);
         }
 
         template<typename... Args>
         static void critical(const char* msg, Args... args) {
-            getInstance().log(LogLevel::CRITICAL, msg, args...);
+            getInstance().log(0, nullptr, LogLevel::CRITICAL, msg, args...);
         }
 
 };
 
-#define TRACE_SRC(message, ...) Logger::trace(__LINE__, __FILE__, message, ##__VA_ARGS__)
-#define INFO_SRC(message, ...) Logger::info(__LINE__, __FILE__, message, ##__VA_ARGS__)
-#define DEBUG_SRC(message, ...) Logger::debug(__LINE__, __FILE__, message, ##__VA_ARGS__)
-#define WARNING_SRC(message, ...) Logger::warning(__LINE__, __FILE__, message, ##__VA_ARGS__)
-#define ERROR_SRC(message, ...) Logger::error(__LINE__, __FILE__, message, ##__VA_ARGS__)
-#define CRITICAL_SRC(message, ...) Logger::critical(__LINE__, __FILE__, message, ##__VA_ARGS__)
-
-#define TRACE(message, ...) Logger::trace(message, ##__VA_ARGS__)
-#define INFO(message, ...) Logger::info(message, ##__VA_ARGS__)
-#define DEBUG(message, ...) Logger::debug(message, ##__VA_ARGS__)
-#define WARNING(message, ...) Logger::warning(message, ##__VA_ARGS__)
-#define ERROR(message, ...) Logger::error(message, ##__VA_ARGS__)
-#define CRITICAL(message, ...) Logger::critical(message, ##__VA_ARGS__)
+static_assert(static_cast<int>(LogLevel::TRACE) == 0 && static_cast<int>(LogLevel::CRITICAL) == 5, "LOG_MIN_LEVEL numbers the levels in order");
+
+#define LOG_AT(level, sourceFile, line, message, ...) do { \
+        if (false) Logger::checkFormat(message, ##__VA_ARGS__); \
+        if (Logger::enabled(level)) { \
+            static const uint32_t logSiteId = Logger::registerSite(level, sourceFile, line, message, decltype(Logger::argKinds(__VA_ARGS__))::value); \
+            Logger::logSite(logSiteId, line, sourceFile, level, message, ##__VA_ARGS__); \
+        } \
+    } while (0)
+#define LOG_OFF(message, ...) do { \
+        if (false) Logger::checkFormat(message, ##__VA_ARGS__); \
+    } while (0)
+
+#if LOG_MIN_LEVEL <= 0
+#define TRACE_SRC(message, ...) LOG_AT(LogLevel::TRACE, __FILE__, __LINE__, message, ##__VA_ARGS__)
+#define TRACE(message, ...) LOG_AT(LogLevel::TRACE, nullptr, 0, message, ##__VA_ARGS__)
+#else
+#define TRACE_SRC(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#define TRACE(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= 1
+#define DEBUG_SRC(message, ...) LOG_AT(LogLevel::DEBUG, __FILE__, __LINE__, message, ##__VA_ARGS__)
+#define DEBUG(message, ...) LOG_AT(LogLevel::DEBUG, nullptr, 0, message, ##__VA_ARGS__)
+#else
+#define DEBUG_SRC(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#define DEBUG(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= 2
+#define INFO_SRC(message, ...) LOG_AT(LogLevel::INFO, __FILE__, __LINE__, message, ##__VA_ARGS__)
+#define INFO(message, ...) LOG_AT(LogLevel::INFO, nullptr, 0, message, ##__VA_ARGS__)
+#else
+#define INFO_SRC(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#define INFO(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= 3
+#define WARNING_SRC(message, ...) LOG_AT(LogLevel::WARNING, __FILE__, __LINE__, message, ##__VA_ARGS__)
+#define WARNING(message, ...) LOG_AT(LogLevel::WARNING, nullptr, 0, message, ##__VA_ARGS__)
+#else
+#define WARNING_SRC(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#define WARNING(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= 4
+#define ERROR_SRC(message, ...) LOG_AT(LogLevel::ERROR, __FILE__, __LINE__, message, ##__VA_ARGS__)
+#define ERROR(message, ...) LOG_AT(LogLevel::ERROR, nullptr, 0, message, ##__VA_ARGS__)
+#else
+#define ERROR_SRC(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#define ERROR(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= 5
+#define CRITICAL_SRC(message, ...) LOG_AT(LogLevel::CRITICAL, __FILE__, __LINE__, message, ##__VA_ARGS__)
+#define CRITICAL(message, ...) LOG_AT(LogLevel::CRITICAL, nullptr, 0, message, ##__VA_ARGS__)
+#else
+#define CRITICAL_SRC(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#define CRITICAL(message, ...) LOG_OFF(message, ##__VA_ARGS__)
+#endif
 
 #define RETURN_CRITICAL(message, ...) do {CRITICAL_SRC(message, ##__VA_ARGS__); return false; } while(0)
 #define RETURN_ERROR(message, ...) do {ERROR_SRC(message, ##__VA_ARGS__); return false; } while(0)
@@ -5,6 +5,9 @@
 #include <queue>
 #include <condition_variable>
 #include <optional>
+#include <utility>
+#include <vector>
+#include <cstdint>
 
 template<typename T>
 class ThreadSafeQueue {
@@ -13,6 +16,14 @@ class ThreadSafeQueue {
         std::condition_variable cv;
         std::queue<T> q;        
         bool closed = false;
+        size_t queued_bytes = 0;
+
+        // Payload bytes of an item, for the queues that hold received data; 0 for anything else.
+        template <typename U>
+        static size_t byteSize(const U&) {return 0;}
+        static size_t byteSize(const std::vector<uint8_t>& bytes) {return bytes.size();}
+        template <typename K>
+        static size_t byteSize(const std::pair<K, std::vector<uint8_t>>& item) {return item.second.size();}
 
     public:
 
@@ -24,7 +35,8 @@ class ThreadSafeQueue {
                 std::lock_guard<std::mutex> lock(mtx);
                 if (closed) throw std::runtime_error("Queue is closed");
                 q.push(std::forward<U>(value));
-            }
+                queued_bytes += byteSize(q.back());
+            } 
             cv.notify_one();
         }
 
@@ -33,6 +45,7 @@ class ThreadSafeQueue {
             cv.wait(lock, [this]() {return closed || !q.empty(); });
 
             if (q.empty()) return std::nullopt;
+            queued_bytes -= byteSize(q.front());
             T item = std::move(q.front());
             q.pop();
             return item;
@@ -41,6 +54,7 @@ class ThreadSafeQueue {
         bool tryPop(T& item) {
             std::lock_guard<std::mutex> lock(mtx);
             if (q.empty()) return false;
+            queued_bytes -= byteSize(q.front());
             item = std::move(q.front());
             q.pop();
             return true;
@@ -69,6 +83,11 @@ class ThreadSafeQueue {
             return q.size();
         }
 
+        size_t bytes() const {
+            std::lock_guard<std::mutex> lock(mtx);
+            return queued_bytes;
+        }
+
         
 
 };
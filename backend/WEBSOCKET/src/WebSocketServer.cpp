@@ -1,5 +1,6 @@
 #include "WebSocketServer.hpp" 
 #include "HttpHandler.hpp"
+#include "ThreadPlacement.hpp"
 
 WebSocketServer::WebSocketServer(
     ThreadSafeQueue<std::vector<uint8_t>>& recQ,
@@ -137,6 +138,7 @@ bool WebSocketServer::establishHttpConnection() {
 }
 
 bool WebSocketServer::sendData() {
+    ThreadPlacement::apply("ws-sender");
     INFO_SRC("WebSocketServer[sendData] - Function Called");
 
     while (running) {
@@ -162,6 +164,7 @@ bool WebSocketServer::sendData() {
 }
 
 bool WebSocketServer::receiveData() {
+    ThreadPlacement::apply("ws-receiver");
     INFO_SRC("WebSocketServer[receiveData] - Function Called");
     uint8_t buffer[1024];
 